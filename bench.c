@@ -0,0 +1,620 @@
+/***************************************************************
+    Namma Metro — routing core micro-benchmarks
+
+    Builds metro.c into this program (no separate library) and times
+    the hot entry points, each over every origin-destination pair
+    where that makes sense:
+
+        cc -O2 -o bench bench.c
+        ./bench                          writes bench_output.txt
+        ./bench --baseline old.txt       ... and fails on regressions
+
+    Options:
+      --network FILE     time against a stations.txt / network.bin
+      --out FILE         results file (default bench_output.txt)
+      --baseline FILE    compare p50 against an earlier results file
+      --tolerance PCT    allowed p50 slowdown before failing (default 25)
+      --quick            fewer repetitions (CI smoke run)
+
+    Every result line is "name samples ops_per_sample p50_ns p99_ns
+    ops_per_sec", so a results file is also a baseline. A sample times
+    several calls (BENCH_INNER for the tiny cases, BENCH_PAIR_INNER per
+    OD pair) so the clock's resolution and cost do not dominate.
+****************************************************************/
+
+#define METRO_NO_MAIN
+#include "metro.c"
+
+#define BENCH_INNER      64     // ops per sample for the sub-100ns cases
+#define BENCH_PAIR_INNER 8      // repeats of one OD pair per sample
+#define BENCH_MAX_CASES 32
+
+typedef struct {
+    char name[40];
+    int samples;
+    int inner;
+    double p50_ns;
+    double p99_ns;
+    double ops_per_sec;
+} BenchResult;
+
+BenchResult bench_results[BENCH_MAX_CASES];
+int bench_count = 0;
+
+// Station display names and their normalized keys, in ID order
+char bench_names[MAX][80];
+char bench_keys[MAX][80];
+int bench_stations = 0;
+
+int bench_quick = 0;
+
+// =============================================================
+// TIMING
+// =============================================================
+
+double bench_now_ns(void) {
+    return monotonic_ns();
+}
+
+int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/*
+    bench_record(name, ns, samples, inner)
+
+    ns[i] is the time of sample i (inner ops). Sorts ns in place and
+    appends p50 / p99 per op and overall throughput.
+*/
+void bench_record(const char *name, double *ns, int samples, int inner) {
+    if (bench_count == BENCH_MAX_CASES || samples <= 0) return;
+
+    double total = 0;
+    for (int i = 0; i < samples; i++) total += ns[i];
+    qsort(ns, (size_t)samples, sizeof *ns, cmp_double);
+
+    BenchResult *r = &bench_results[bench_count++];
+    snprintf(r->name, sizeof r->name, "%s", name);
+    r->samples = samples;
+    r->inner = inner;
+    r->p50_ns = ns[samples / 2] / inner;
+    r->p99_ns = ns[(int)((samples - 1) * 0.99)] / inner;
+    r->ops_per_sec = total > 0 ? (double)samples * inner * 1e9 / total : 0;
+
+    printf("%-22s p50 %10.0f ns   p99 %10.0f ns   %12.0f ops/s\n",
+           r->name, r->p50_ns, r->p99_ns, r->ops_per_sec);
+}
+
+// =============================================================
+// CASES
+// =============================================================
+/*
+    Each case fills one sample per OD pair (or per repetition) and
+    hands the timings to bench_record(). Results are folded into
+    bench_sink so the compiler cannot drop the work.
+*/
+volatile long bench_sink;
+
+// Network construction: built-in lines, or the --network file
+void bench_build(const char *network_file) {
+    int reps = bench_quick ? 10 : 100;
+    double *ns = malloc((size_t)reps * sizeof *ns);
+    if (!ns) return;
+
+    for (int i = 0; i < reps; i++) {
+        double t0 = bench_now_ns();
+        if (network_file) load_network_file(network_file);
+        else build_network(1);
+        ns[i] = bench_now_ns() - t0;
+        bench_sink += stationCount;
+    }
+    bench_record(network_file ? "network_load" : "build_network", ns, reps, 1);
+
+    for (int i = 0; i < reps; i++) {
+        double t0 = bench_now_ns();
+        build_route_table();
+        ns[i] = bench_now_ns() - t0;
+    }
+    bench_record("route_table_build", ns, reps, 1);
+    free(ns);
+}
+
+// Name -> ID as a typed query: normalize, then the hash lookup
+void bench_lookup(void) {
+    int reps = bench_quick ? 20 : 200;
+    int samples = reps * bench_stations;
+    double *ns = malloc((size_t)samples * sizeof *ns);
+    if (!ns) return;
+
+    int k = 0;
+    for (int r = 0; r < reps; r++) {
+        for (int s = 0; s < bench_stations; s++) {
+            char key[80];
+            double t0 = bench_now_ns();
+            for (int j = 0; j < BENCH_INNER; j++) {
+                memcpy(key, bench_names[s], sizeof key);
+                normalize_inplace(key);
+                bench_sink += find_station_id(key, 1);
+            }
+            ns[k++] = bench_now_ns() - t0;
+        }
+    }
+    bench_record("station_lookup", ns, samples, BENCH_INNER);
+
+    k = 0;
+    for (int r = 0; r < reps; r++) {
+        for (int s = 0; s < bench_stations; s++) {
+            double t0 = bench_now_ns();
+            for (int j = 0; j < BENCH_INNER; j++)
+                bench_sink += station_lookup(bench_keys[s]);
+            ns[k++] = bench_now_ns() - t0;
+        }
+    }
+    bench_record("station_lookup_key", ns, samples, BENCH_INNER);
+    free(ns);
+}
+
+// One sample per ordered station pair
+double *bench_pairs_alloc(int *samples) {
+    *samples = bench_stations * bench_stations;
+    return malloc((size_t)(*samples > 0 ? *samples : 1) * sizeof(double));
+}
+
+void bench_bfs(void) {
+    int samples;
+    double *ns = bench_pairs_alloc(&samples);
+    if (!ns) return;
+    static int parent[MAX];
+
+    int k = 0;
+    for (int s = 0; s < bench_stations; s++) {
+        for (int t = 0; t < bench_stations; t++) {
+            double t0 = bench_now_ns();
+            for (int j = 0; j < BENCH_PAIR_INNER; j++)
+                bench_sink += bfs_simple(s, t, parent);
+            ns[k++] = bench_now_ns() - t0;
+        }
+    }
+    bench_record("bfs_simple", ns, samples, BENCH_PAIR_INNER);
+    free(ns);
+}
+
+// find_route() with the all-pairs table, and with each search strategy
+void bench_find_route(void) {
+    static const struct { const char *name; int table; int strategy; } modes[] = {
+        { "find_route_table",    1, ROUTE_STRATEGY_ASTAR },
+        { "find_route_astar",    0, ROUTE_STRATEGY_ASTAR },
+        { "find_route_dijkstra", 0, ROUTE_STRATEGY_DIJKSTRA },
+        { "find_route_bidir",    0, ROUTE_STRATEGY_BIDIR },
+    };
+    static Route r;
+    int samples;
+    double *ns = bench_pairs_alloc(&samples);
+    if (!ns) return;
+
+    for (size_t m = 0; m < sizeof modes / sizeof modes[0]; m++) {
+        set_route_table_mode(modes[m].table);
+        set_route_strategy(modes[m].strategy);
+        route_table_usable();
+
+        int k = 0;
+        for (int s = 0; s < bench_stations; s++) {
+            for (int t = 0; t < bench_stations; t++) {
+                double t0 = bench_now_ns();
+                for (int j = 0; j < BENCH_PAIR_INNER; j++)
+                    bench_sink += find_route(s, t, &r);
+                ns[k++] = bench_now_ns() - t0;
+            }
+        }
+        bench_record(modes[m].name, ns, samples, BENCH_PAIR_INNER);
+    }
+
+    set_route_strategy(ROUTE_STRATEGY_ASTAR);
+    set_route_table_mode(1);
+    route_table_usable();
+    free(ns);
+}
+
+// Yen's alternates for every connected pair (the primary is found untimed)
+void bench_alternates(void) {
+    static Route primary;
+    static Route alts[MAX_ALTERNATES];
+    int samples;
+    double *ns = bench_pairs_alloc(&samples);
+    if (!ns) return;
+
+    int k = 0;
+    for (int s = 0; s < bench_stations; s++) {
+        for (int t = 0; t < bench_stations; t++) {
+            if (s == t || !find_route(s, t, &primary)) continue;
+            double t0 = bench_now_ns();
+            for (int j = 0; j < BENCH_PAIR_INNER; j++)
+                bench_sink += find_alternates(&primary, MAX_ALTERNATES, alts);
+            ns[k++] = bench_now_ns() - t0;
+        }
+    }
+    bench_record("find_alternates", ns, k, BENCH_PAIR_INNER);
+    free(ns);
+}
+
+void bench_edge_lines(void) {
+    static Route r;
+    static char edge_lines[MAX][30];
+    int samples;
+    double *ns = bench_pairs_alloc(&samples);
+    if (!ns) return;
+
+    int k = 0;
+    for (int s = 0; s < bench_stations; s++) {
+        for (int t = 0; t < bench_stations; t++) {
+            if (!find_route(s, t, &r)) continue;
+            double t0 = bench_now_ns();
+            for (int j = 0; j < BENCH_INNER; j++)
+                build_edge_lines(r.path, r.len, edge_lines);
+            ns[k++] = bench_now_ns() - t0;
+            bench_sink += edge_lines[0][0];
+        }
+    }
+    bench_record("build_edge_lines", ns, k, BENCH_INNER);
+    free(ns);
+}
+
+// The whole text API: resolve both names, route, format. The result
+// cache is off so repeats of a pair recompute; get_route_cached times
+// the hit path instead.
+void bench_get_route(void) {
+    int samples;
+    double *ns = bench_pairs_alloc(&samples);
+    if (!ns) return;
+
+    set_result_cache_size(0);
+    int k = 0;
+    for (int s = 0; s < bench_stations; s++) {
+        for (int t = 0; t < bench_stations; t++) {
+            const char *text = "";
+            double t0 = bench_now_ns();
+            for (int j = 0; j < BENCH_PAIR_INNER; j++)
+                text = get_route(bench_names[s], bench_names[t]);
+            ns[k++] = bench_now_ns() - t0;
+            bench_sink += text[0];
+        }
+    }
+    bench_record("get_route", ns, samples, BENCH_PAIR_INNER);
+
+    static char out[8192];
+    k = 0;
+    for (int s = 0; s < bench_stations; s++) {
+        for (int t = 0; t < bench_stations; t++) {
+            double t0 = bench_now_ns();
+            for (int j = 0; j < BENCH_PAIR_INNER; j++)
+                bench_sink += get_route_json(bench_names[s], bench_names[t], out, sizeof out);
+            ns[k++] = bench_now_ns() - t0;
+        }
+    }
+    bench_record("get_route_json", ns, samples, BENCH_PAIR_INNER);
+
+    // the typed-array record index.html uses, by station ID
+    static int packed[PACKED_ROUTE_INTS];
+    k = 0;
+    for (int s = 0; s < bench_stations; s++) {
+        for (int t = 0; t < bench_stations; t++) {
+            double t0 = bench_now_ns();
+            for (int j = 0; j < BENCH_PAIR_INNER; j++)
+                bench_sink += get_route_packed(s, t, packed);
+            ns[k++] = bench_now_ns() - t0;
+        }
+    }
+    bench_record("get_route_packed", ns, samples, BENCH_PAIR_INNER);
+
+    // A hot set of station pairs that fits the cache, warmed first
+    set_result_cache_size(RESULT_CACHE_DEFAULT);
+    int hot = bench_stations < 8 ? bench_stations : 8;
+    for (int s = 0; s < hot; s++)
+        for (int t = 0; t < hot; t++)
+            bench_sink += get_route(bench_names[s], bench_names[bench_stations - 1 - t])[0];
+    k = 0;
+    for (int s = 0; s < bench_stations; s++) {
+        for (int t = 0; t < bench_stations; t++) {
+            int a = s % hot, b = bench_stations - 1 - t % hot;
+            const char *text = "";
+            double t0 = bench_now_ns();
+            for (int j = 0; j < BENCH_PAIR_INNER; j++)
+                text = get_route(bench_names[a], bench_names[b]);
+            ns[k++] = bench_now_ns() - t0;
+            bench_sink += text[0];
+        }
+    }
+    bench_record("get_route_cached", ns, samples, BENCH_PAIR_INNER);
+    free(ns);
+}
+
+// Autocomplete on every station's first four characters
+void bench_autocomplete(void) {
+    int reps = bench_quick ? 10 : 100;
+    int samples = reps * bench_stations;
+    double *ns = malloc((size_t)(samples > 0 ? samples : 1) * sizeof *ns);
+    if (!ns) return;
+    int ids[8];
+
+    int k = 0;
+    for (int r = 0; r < reps; r++) {
+        for (int s = 0; s < bench_stations; s++) {
+            char prefix[5] = { 0 };
+            memcpy(prefix, bench_names[s], 4);
+            double t0 = bench_now_ns();
+            for (int j = 0; j < BENCH_PAIR_INNER; j++)
+                bench_sink += get_autocomplete(prefix, 1, ids, 8);
+            ns[k++] = bench_now_ns() - t0;
+        }
+    }
+    bench_record("autocomplete", ns, samples, BENCH_PAIR_INNER);
+    free(ns);
+}
+
+// Close + reopen every segment, then every station, with the route table patched each time
+void bench_edits(void) {
+    int samples = bench_stations > 0 ? adj_offset[bench_stations] : 0;
+    double *ns = malloc((size_t)(samples > 0 ? samples : 1) * sizeof *ns);
+    if (!ns) return;
+
+    set_route_table_mode(1);
+    route_table_usable();
+    int k = 0;
+    for (int a = 0; a < bench_stations; a++) {
+        for (int e = adj_offset[a]; e < adj_offset[a + 1]; e++) {
+            int b = adj_nbr[e];
+            double t0 = bench_now_ns();
+            bench_sink += set_segment_closed(a, b, 1);
+            bench_sink += set_segment_closed(a, b, 0);
+            ns[k++] = bench_now_ns() - t0;
+        }
+    }
+    bench_record("segment_close_open", ns, k, 2);
+
+    k = 0;
+    for (int s = 0; s < bench_stations; s++) {
+        double t0 = bench_now_ns();
+        bench_sink += set_station_closed(s, 1);
+        bench_sink += set_station_closed(s, 0);
+        ns[k++] = bench_now_ns() - t0;
+    }
+    bench_record("station_close_open", ns, k, 2);
+    free(ns);
+}
+
+// Whole OD matrix through get_fares_batch(), from the table and from source trees
+void bench_fares(void) {
+    int reps = bench_quick ? 5 : 50;
+    int pairs = bench_stations * bench_stations;
+    int *src = malloc((size_t)pairs * sizeof *src);
+    int *dst = malloc((size_t)pairs * sizeof *dst);
+    int *fare = malloc((size_t)pairs * sizeof *fare);
+    int *dist = malloc((size_t)pairs * sizeof *dist);
+    double *ns = malloc((size_t)reps * sizeof *ns);
+    if (!src || !dst || !fare || !dist || !ns || pairs == 0) {
+        free(src); free(dst); free(fare); free(dist); free(ns);
+        return;
+    }
+    for (int i = 0; i < pairs; i++) {
+        src[i] = i / bench_stations;
+        dst[i] = i % bench_stations;
+    }
+
+    for (int mode = 1; mode >= 0; mode--) {
+        set_route_table_mode(mode);
+        bench_sink += get_fares_batch(src, dst, pairs, fare, dist);     // warm: table / trees
+        for (int r = 0; r < reps; r++) {
+            double t0 = bench_now_ns();
+            bench_sink += get_fares_batch(src, dst, pairs, fare, dist);
+            ns[r] = bench_now_ns() - t0;
+        }
+        bench_record(mode ? "fares_batch_table" : "fares_batch_trees", ns, reps, pairs);
+    }
+    set_route_table_mode(1);
+    free(src); free(dst); free(fare); free(dist); free(ns);
+}
+
+// One bounded search per source: a 30-minute isochrone, then no budget
+void bench_isochrone(void) {
+    static int out[MAX * ISO_FIELDS];
+    int reps = bench_quick ? 2 : 10;
+    int samples = reps * bench_stations;
+    double *ns = malloc((size_t)(samples > 0 ? samples : 1) * sizeof *ns);
+    if (!ns || samples == 0) {
+        free(ns);
+        return;
+    }
+
+    for (int budget = 30; budget >= -1; budget -= 31) {
+        int k = 0;
+        for (int r = 0; r < reps; r++) {
+            for (int s = 0; s < bench_stations; s++) {
+                double t0 = bench_now_ns();
+                bench_sink += get_isochrone(s, budget, -1, out);
+                ns[k++] = bench_now_ns() - t0;
+            }
+        }
+        bench_record(budget >= 0 ? "isochrone_30min" : "isochrone_all", ns, samples, 1);
+    }
+    free(ns);
+}
+
+// Timetable: connection array build, then earliest arrival and the
+// Pareto options for every pair at 08:30
+void bench_timetable(void) {
+    static Journey j;
+    int reps = bench_quick ? 5 : 20;
+    int samples;
+    double *ns = bench_pairs_alloc(&samples);
+    if (!ns || samples < reps) {
+        free(ns);
+        return;
+    }
+
+    for (int r = 0; r < reps; r++) {
+        double t0 = bench_now_ns();
+        bench_sink += build_connections();
+        ns[r] = bench_now_ns() - t0;
+    }
+    bench_record("timetable_build", ns, reps, 1);
+
+    int depart = 8 * 3600 + 30 * 60;
+    int k = 0;
+    for (int s = 0; s < bench_stations; s++) {
+        for (int t = 0; t < bench_stations; t++) {
+            double t0 = bench_now_ns();
+            for (int i = 0; i < BENCH_PAIR_INNER; i++)
+                bench_sink += find_journey(s, t, depart, &j);
+            ns[k++] = bench_now_ns() - t0;
+        }
+    }
+    bench_record("journey_csa", ns, samples, BENCH_PAIR_INNER);
+
+    static int arrivals[MAX];
+    k = 0;
+    for (int s = 0; s < bench_stations; s++) {
+        double t0 = bench_now_ns();
+        bench_sink += get_arrivals_from(s, depart, arrivals);
+        ns[k++] = bench_now_ns() - t0;
+    }
+    bench_record("arrivals_from_csa", ns, k, 1);
+
+    static Journey options[MAX_PARETO];
+    k = 0;
+    for (int s = 0; s < bench_stations; s++) {
+        for (int t = 0; t < bench_stations; t++) {
+            double t0 = bench_now_ns();
+            bench_sink += find_pareto_journeys(s, t, depart, options, MAX_PARETO);
+            ns[k++] = bench_now_ns() - t0;
+        }
+    }
+    bench_record("pareto_raptor", ns, k, 1);
+    free(ns);
+}
+
+// =============================================================
+// RESULTS FILE + BASELINE CHECK
+// =============================================================
+
+int bench_write(const char *path, const char *network_file) {
+    FILE *f = fopen(path, "w");
+    if (!f) return -1;
+
+    char when[80];
+    report_timestamp(when, sizeof when);
+    fprintf(f, "# Namma Metro bench, %s\n", when);
+    fprintf(f, "# network: %s, %d stations, %d route nodes\n",
+            network_file ? network_file : "built-in", stationCount, nodeCount);
+    fprintf(f, "# name samples ops_per_sample p50_ns p99_ns ops_per_sec\n");
+    for (int i = 0; i < bench_count; i++) {
+        const BenchResult *r = &bench_results[i];
+        fprintf(f, "%s %d %d %.1f %.1f %.0f\n", r->name, r->samples, r->inner,
+                r->p50_ns, r->p99_ns, r->ops_per_sec);
+    }
+    return fclose(f) == 0 ? 0 : -1;
+}
+
+/*
+    bench_compare(path, tolerance)
+
+    Prints the p50 change of every case also present in the baseline
+    file. Returns the number of cases slower than tolerance percent.
+*/
+int bench_compare(const char *path, double tolerance) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "%s: cannot open baseline\n", path);
+        return -1;
+    }
+
+    int regressions = 0;
+    char line[256];
+    printf("\nAgainst %s (tolerance %.0f%%):\n", path, tolerance);
+    while (fgets(line, sizeof line, f)) {
+        char name[40];
+        int samples, inner;
+        double p50, p99, ops;
+        if (line[0] == '#') continue;
+        if (sscanf(line, "%39s %d %d %lf %lf %lf", name, &samples, &inner,
+                   &p50, &p99, &ops) != 6 || p50 <= 0)
+            continue;
+
+        for (int i = 0; i < bench_count; i++) {
+            if (strcmp(bench_results[i].name, name) != 0) continue;
+            double change = (bench_results[i].p50_ns / p50 - 1.0) * 100.0;
+            int slow = change > tolerance;
+            printf("  %-22s %10.0f -> %10.0f ns  %+6.1f%%%s\n", name, p50,
+                   bench_results[i].p50_ns, change, slow ? "  REGRESSION" : "");
+            regressions += slow;
+        }
+    }
+    fclose(f);
+    return regressions;
+}
+
+// =============================================================
+// MAIN
+// =============================================================
+
+int main(int argc, char **argv) {
+    const char *network_file = NULL;
+    const char *out = "bench_output.txt";
+    const char *baseline = NULL;
+    double tolerance = 25.0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--network") == 0 && i + 1 < argc) {
+            network_file = argv[++i];
+        } else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            out = argv[++i];
+        } else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+            baseline = argv[++i];
+        } else if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc) {
+            tolerance = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--quick") == 0) {
+            bench_quick = 1;
+        } else {
+            fprintf(stderr, "Usage: %s [--network FILE] [--out FILE] [--baseline FILE]"
+                            " [--tolerance PCT] [--quick]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    bench_build(network_file);
+    if (network_file && load_network_file(network_file) < 0) {
+        fprintf(stderr, "%s: %s\n", network_file, network_error);
+        return 1;
+    }
+    init_network(1);
+
+    bench_stations = stationCount;
+    for (int s = 0; s < stationCount; s++) {
+        snprintf(bench_names[s], sizeof bench_names[s], "%s", station_name(s));
+        snprintf(bench_keys[s], sizeof bench_keys[s], "%s", station_key(s));
+    }
+
+    bench_lookup();
+    bench_bfs();
+    bench_find_route();
+    bench_alternates();
+    bench_edge_lines();
+    bench_get_route();
+    bench_autocomplete();
+    bench_edits();
+    bench_fares();
+    bench_isochrone();
+    bench_timetable();
+
+    if (bench_write(out, network_file) < 0) {
+        fprintf(stderr, "Failed to write %s\n", out);
+        return 1;
+    }
+    printf("\nSaved %s\n", out);
+
+    if (baseline) {
+        int slow = bench_compare(baseline, tolerance);
+        if (slow != 0) return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,130 @@
+#!/bin/sh
+# Builds metro.js + metro.wasm from metro.c with Emscripten (emcc on PATH).
+#
+#   ./build_wasm.sh            debug profile: assertions and the checked
+#                              runtime
+#   ./build_wasm.sh release    what we ship: -O3 + LTO, wasm SIMD128
+#                              (search-reset and landmark kernels in metro.c),
+#                              no assertions or filesystem, closure-minified glue,
+#                              then staged into dist/ with content-hashed names
+#
+# release also builds metro-mt.js + metro-mt.wasm with -pthread: the same
+# engine with get_routes_batch() spread over wasm threads. It needs
+# SharedArrayBuffer, i.e. a cross-origin isolated page (served with
+# COOP: same-origin and COEP: require-corp); metro.worker.js only picks
+# it when self.crossOriginIsolated is true.
+#
+# The release dist/ holds metro.<hash>.js and metro.<hash>.wasm, the page
+# shell, and asset-manifest.js mapping the plain names to the hashed ones;
+# sw.js and metro.worker.js read that manifest, so a new build gets a new
+# cache and stale binaries never outlive it. A compiled network image
+# (./metro --compile stations.txt network.bin) is copied in unhashed; the
+# service worker revalidates it in the background instead.
+#
+# Both profiles run on the page or inside metro.worker.js, which loads
+# the same metro.js with importScripts and streams metro.wasm itself.
+#
+# metro.js and metro.wasm are build outputs and are not committed: run
+# one of the profiles before serving index.html or bench.html, and again
+# after every change to metro.c, so the glue and the exports below match
+# the source.
+#
+# METRO_STATS=1 ./build_wasm.sh [profile] compiles in the per-phase
+# counters read by get_stats() (the worker's "stats" message); without
+# it they cost nothing and report enabled = 0.
+#
+# The exports below are what index.html, metro.worker.js and
+# metro-client.js call; add new EMSCRIPTEN_KEEPALIVE entry points here.
+set -e
+cd "$(dirname "$0")"
+
+PROFILE="${1:-debug}"
+
+EXPORTS="_malloc,_free,\
+_init_network,_set_route_table_mode,_set_route_strategy,\
+_load_network_image,_load_network_text,_get_network_error,\
+_station_count,_get_station_name,_get_line_name,_get_autocomplete,\
+_get_route,_get_route_text,_get_route_json,\
+_get_route_result,_get_route_result_ids,_get_route_packed,_route_packed_size,_get_names_table,_get_line_stations,_get_alternates_ids,_route_result_size,\
+_get_routes_batch,_get_fares_batch,_set_batch_threads,_get_batch_threads,_get_etas_from,_get_isochrone,_last_nodes_expanded,\
+_get_stats,_stats_size,_reset_stats,\
+_set_segment_closed,_set_station_closed,_is_station_closed,_set_station_planned,\
+_set_result_cache_size,_get_result_cache_stats,_reset_result_cache_stats,\
+_load_timetable_text,_get_journey_ids,_get_arrivals_from,_get_pareto_journeys"
+
+RUNTIME="HEAP32,HEAPU8,HEAPF64,UTF8ToString,stringToUTF8,lengthBytesUTF8,ccall,cwrap"
+
+COMMON="-sENVIRONMENT=web,worker \
+    -sALLOW_MEMORY_GROWTH=1 \
+    -sEXPORTED_FUNCTIONS=$EXPORTS \
+    -sEXPORTED_RUNTIME_METHODS=$RUNTIME"
+
+case "$PROFILE" in
+debug)
+    FLAGS="-O1 -g -sASSERTIONS=1"
+    ;;
+release)
+    # low-end phones: smallest glue, fastest code, nothing checked at runtime
+    FLAGS="-O3 -flto -msimd128 \
+        -sASSERTIONS=0 -sSTACK_OVERFLOW_CHECK=0 \
+        -sFILESYSTEM=0 -sSUPPORT_LONGJMP=0 \
+        -sTEXTDECODER=2 -sINCOMING_MODULE_JS_API=locateFile,instantiateWasm,onRuntimeInitialized,print,printErr,mainScriptUrlOrBlob \
+        --closure 1"
+    ;;
+*)
+    echo "usage: $0 [debug|release]" >&2
+    exit 2
+    ;;
+esac
+
+[ "${METRO_STATS:-0}" = 1 ] && FLAGS="$FLAGS -DMETRO_STATS"
+
+# shellcheck disable=SC2086
+emcc metro.c $FLAGS $COMMON -o metro.js
+
+echo "Built metro.js + metro.wasm ($PROFILE)"
+
+[ "$PROFILE" = release ] || exit 0
+
+# threaded variant: workers are spawned up front so pthread_create never
+# has to wait for the event loop while the routing worker is blocked
+# shellcheck disable=SC2086
+emcc metro.c $FLAGS $COMMON -pthread \
+    -sPTHREAD_POOL_SIZE=navigator.hardwareConcurrency \
+    -o metro-mt.js
+
+echo "Built metro-mt.js + metro-mt.wasm (release, threads)"
+
+# --- stage dist/ with content-hashed binaries -----------------------------
+hash() { sha256sum "$1" | cut -c1-12; }
+
+rm -rf dist
+mkdir dist
+JS_NAME="metro.$(hash metro.js).js"
+WASM_NAME="metro.$(hash metro.wasm).wasm"
+MT_JS_NAME="metro-mt.$(hash metro-mt.js).js"
+MT_WASM_NAME="metro-mt.$(hash metro-mt.wasm).wasm"
+cp metro.js "dist/$JS_NAME"
+cp metro.wasm "dist/$WASM_NAME"
+cp metro-mt.js "dist/$MT_JS_NAME"
+cp metro-mt.wasm "dist/$MT_WASM_NAME"
+# older emcc releases ship the pthread bootstrap as a separate file
+[ -f metro-mt.worker.js ] && cp metro-mt.worker.js dist/
+cp index.html manifest.json sw.js metro.worker.js metro-client.js dist/
+[ -f network.bin ] && cp network.bin dist/
+
+VERSION=$(cat metro.js metro.wasm metro-mt.js metro-mt.wasm metro.worker.js metro-client.js index.html | sha256sum | cut -c1-12)
+cat > dist/asset-manifest.js <<MANIFEST
+// generated by build_wasm.sh release -- do not edit
+self.METRO_ASSETS = {
+  version: "$VERSION",
+  files: {
+    "metro.js": "$JS_NAME",
+    "metro.wasm": "$WASM_NAME",
+    "metro-mt.js": "$MT_JS_NAME",
+    "metro-mt.wasm": "$MT_WASM_NAME"
+  }
+};
+MANIFEST
+
+echo "Staged dist/ (assets $VERSION)"
@@ -0,0 +1,215 @@
+// =============================================================
+// Namma Metro — main-thread client for metro.worker.js
+// =============================================================
+/*
+    const router = new MetroRouter();            // no worker yet
+    router.warm();                               // optional: start it at idle / on focus
+    const { stations } = await router.init();    // spawns metro.worker.js if needed
+    const r = await router.route(src, dst, { channel: "map" });
+    // r.stations / r.lines / r.interchangeAt are Int32Array views of
+    // the transferred buffer; names come once, from init()
+
+    Every call returns a promise. Requests sharing a channel coalesce:
+    a newer one supersedes an older one (dropped if still queued in the
+    worker, ignored if already running), and the older promise rejects
+    with { cancelled: true }. router.cancel(p) drops one queued request.
+*/
+(function (global) {
+  "use strict";
+
+  const ROUTE_OK = 0;
+  const RESULT_HEADER = 6;
+
+  // Unpack a route buffer (layout documented in metro.worker.js);
+  // interchangeAt is empty for buffers without the packed tail
+  function decodeRoute(buffer) {
+    const a = new Int32Array(buffer);
+    const n = a[1];
+    const tail = RESULT_HEADER + n + Math.max(0, n - 1);
+    return {
+      status: a[0],
+      ok: a[0] === ROUTE_OK,
+      timeMin: a[2],
+      fare: a[3],
+      interchanges: a[4],
+      distanceM: a[5],
+      stations: a.subarray(RESULT_HEADER, RESULT_HEADER + n),
+      lines: a.subarray(RESULT_HEADER + n, tail),
+      interchangeAt: a.subarray(tail, tail + a[4])
+    };
+  }
+
+  function secondsToday() {
+    const d = new Date();
+    return d.getHours() * 3600 + d.getMinutes() * 60 + d.getSeconds();
+  }
+
+  class MetroRouter {
+    constructor(workerUrl = "metro.worker.js") {
+      this.workerUrl = workerUrl;
+      this.worker = null;                 // created lazily by warm() / the first request
+      this.nextId = 1;
+      this.pending = new Map();           // id -> { resolve, reject, decode }
+      this.channels = new Map();          // channel -> id of its newest request
+    }
+
+    // Start the worker (and with it the wasm download + compile) now
+    warm() {
+      if (this.worker) return;
+      this.worker = new Worker(this.workerUrl);
+      this.worker.onmessage = event => this._reply(event.data);
+      this.worker.onerror = event => {
+        for (const p of this.pending.values()) p.reject(new Error(event.message));
+        this.pending.clear();
+      };
+    }
+
+    init(includePlanned = true) {
+      return this._send({ type: "init", includePlanned });
+    }
+
+    // Switch to a compiled network image (ArrayBuffer; transferred)
+    loadImage(buffer) {
+      return this._send({ type: "loadImage", buffer }, [buffer]);
+    }
+
+    route(src, dst, { channel } = {}) {
+      return this._send({ type: "route", src, dst, channel }, null, msg => decodeRoute(msg.buffer));
+    }
+
+    // Earliest arrival by timetable, leaving at depart (seconds after
+    // midnight, default now); adds times: Int32Array of clock seconds
+    journey(src, dst, depart = secondsToday(), { channel } = {}) {
+      return this._send({ type: "journey", src, dst, depart, channel }, null, msg => {
+        const r = decodeRoute(msg.buffer);
+        r.times = new Int32Array(msg.times);
+        return r;
+      });
+    }
+
+    // The Pareto journeys leaving at depart (arrival, changes, fare), in
+    // arrival order; each is a journey() result. Empty when none runs
+    options(src, dst, depart = secondsToday(), { max = 4, channel } = {}) {
+      return this._send({ type: "options", src, dst, depart, max, channel }, null,
+                        msg => msg.buffers.map((buffer, i) => {
+                          const r = decodeRoute(buffer);
+                          r.times = new Int32Array(msg.times[i]);
+                          return r;
+                        }));
+    }
+
+    // Replace the service bands (GTFS-style frequencies CSV text; "" = built-in)
+    loadTimetable(text) {
+      return this._send({ type: "timetable", text }, null, msg => msg.bands);
+    }
+
+    // Fetch a compiled network image (served stale-while-revalidate by sw.js) and load it
+    fetchImage(url = "network.bin") {
+      return fetch(url).then(resp => {
+        if (!resp.ok) throw new Error(url + ": HTTP " + resp.status);
+        return resp.arrayBuffer();
+      }).then(buffer => this.loadImage(buffer));
+    }
+
+    alternates(src, dst, k = 3, { channel } = {}) {
+      return this._send({ type: "alternates", src, dst, k, channel }, null,
+                        msg => msg.buffers.map(decodeRoute));
+    }
+
+    autocomplete(text, { max = 8, includePlanned = true, channel = "autocomplete" } = {}) {
+      return this._send({ type: "autocomplete", text, max, includePlanned, channel }, null,
+                        msg => new Int32Array(msg.buffer));
+    }
+
+    // Score many OD pairs at once (station ID arrays); resolves to
+    // { answered, threads, records } with 4 Int32s per pair
+    batch(src, dst) {
+      return this._send({ type: "batch", src, dst }, null,
+                        msg => ({ answered: msg.answered, threads: msg.threads,
+                                  records: new Int32Array(msg.buffer) }));
+    }
+
+    // Fare (Rs) and route length (m) for many OD pairs; resolves to
+    // { answered, fares, distances } with Int32Arrays (-1 = no route)
+    fares(src, dst) {
+      return this._send({ type: "fares", src, dst }, null,
+                        msg => ({ answered: msg.answered, fares: new Int32Array(msg.fares),
+                                  distances: new Int32Array(msg.distances) }));
+    }
+
+    // Every station within minutes (and fare Rs, if given) of src, in
+    // one bounded search; resolves to { count, records } with 6 Int32s
+    // per station: ID, minutes, fare, changes, distance_m, line mask
+    isochrone(src, { minutes = 30, fare = -1, channel = "isochrone" } = {}) {
+      return this._send({ type: "isochrone", src, minutes, fare, channel }, null,
+                        msg => ({ count: msg.count, records: new Int32Array(msg.buffer) }));
+    }
+
+    // Live service edits; each resolves to true if it changed anything
+    setSegmentClosed(a, b, closed = true) {
+      return this._send({ type: "segment", a, b, closed }, null, msg => msg.changed > 0);
+    }
+
+    setStationClosed(station, closed = true) {
+      return this._send({ type: "station", station, closed }, null, msg => msg.changed > 0);
+    }
+
+    setStationPlanned(station, planned) {
+      return this._send({ type: "station", station, planned }, null, msg => msg.changed > 0);
+    }
+
+    // Engine phase counters ({ enabled, build_calls, build_us, ..., cache });
+    // enabled is 0 unless the wasm was built with METRO_STATS=1, while
+    // cache ({ hits, misses, evictions, stale, used, capacity }) is always set
+    stats({ reset = false } = {}) {
+      return this._send({ type: "stats", reset }, null, msg => msg.stats);
+    }
+
+    // Drop a request that has not started yet (the promise rejects)
+    cancel(promise) {
+      if (this.worker && promise && promise.requestId)
+        this.worker.postMessage({ type: "cancel", id: promise.requestId });
+    }
+
+    terminate() {
+      if (this.worker) this.worker.terminate();
+      this.worker = null;
+      for (const p of this.pending.values()) p.reject({ cancelled: true });
+      this.pending.clear();
+    }
+
+    _send(msg, transfer, decode = m => m) {
+      const id = this.nextId++;
+      msg.id = id;
+      if (msg.channel) this.channels.set(msg.channel, id);
+
+      const promise = new Promise((resolve, reject) => {
+        this.pending.set(id, { resolve, reject, decode, channel: msg.channel });
+      });
+      promise.requestId = id;
+      this.warm();
+      this.worker.postMessage(msg, transfer || []);
+      return promise;
+    }
+
+    _reply(msg) {
+      const p = this.pending.get(msg.id);
+      if (!p) return;
+      this.pending.delete(msg.id);
+
+      // a result that a newer request on its channel already superseded is stale
+      let stale = false;
+      if (p.channel) {
+        stale = this.channels.get(p.channel) !== msg.id;
+        if (!stale) this.channels.delete(p.channel);
+      }
+
+      if (msg.type === "cancelled" || stale) p.reject({ cancelled: true });
+      else if (msg.type === "error") p.reject(new Error(msg.message));
+      else p.resolve(p.decode(msg));
+    }
+  }
+
+  MetroRouter.decodeRoute = decodeRoute;
+  global.MetroRouter = MetroRouter;
+})(typeof self !== "undefined" ? self : this);
@@ -4,13 +4,37 @@
 
     Features:
     - UTF-8 safe (em-dash, arrows, emojis)
-    - BFS shortest path for routes
-    - Alternate route suggestions (by blocking edges)
+    - Fastest routes (A* over station+line nodes, interchange penalties)
+    - Alternate route suggestions (Yen's k-shortest loopless paths)
     - Autocomplete station suggestions
     - Pretty terminal UI with colors + simple table layout
-    - TXT + HTML route report export
+    - TXT + HTML route report export, including many routes per
+      file with a shared stylesheet: metro --report day.html A B C D
+    - Scriptable batch mode (metro --batch pairs.csv), spread over
+      every core when built with: cc -O2 -DMETRO_THREADS -pthread
     - Cross-platform "open in default app"
+    - Per-phase counters (metro --stats) in builds with -DMETRO_STATS
+    - Live closures of stations and segments without a rebuild:
+      metro --close "cubbon park" --close-segment trinity halasuru ...
+    - Timetable ETAs from per-line headways and first/last trains
+      (Connection Scan Algorithm): metro --timetable service.csv
+    - Journey options that trade arrival against changes and fare
+      (RAPTOR rounds): get_pareto_journeys(), listed by the summary
     - Planned station toggle (future-ready)
+    - Network from a source file (stations.txt) or a compiled
+      binary image: metro --compile stations.txt network.bin
+    - Measured segment lengths ("Kengeri [1.9 km]" in stations.txt)
+      and an all-pairs fare/distance matrix in the route table, for
+      bulk fare scoring: get_fares_batch()
+    - Packed int route records and a one-shot names table for the
+      PWA (get_route_packed, get_names_table): no text to parse
+    - Isochrones: every station within a time and/or fare budget of
+      a source in one bounded search (get_isochrone), for one or all
+      sources from the CLI: metro --isochrone 30 --max-fare 40 majestic
+    - HTTP/JSON server (/route, /alternates, /autocomplete,
+      /isochrone, POST /batch) on epoll/kqueue with a worker pool:
+      metro --serve 8080, built with
+      cc -O2 -DMETRO_SERVER -DMETRO_THREADS -pthread
 
     NOTE FOR WINDOWS USERS:
     - This program automatically sets console to UTF-8 using
@@ -19,12 +43,23 @@
 
 #define _CRT_SECURE_NO_WARNINGS
 
+// -std=c99 hides POSIX (clock_gettime, ...) unless asked for; gnu modes show it already
+#if !defined(_WIN32) && defined(__STRICT_ANSI__) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <stdarg.h>
+#include <stdint.h>
 #include <time.h>
 
+#ifdef __wasm_simd128__
+#include <wasm_simd128.h>
+#endif
+
 #ifdef __EMSCRIPTEN__
 #include <emscripten/emscripten.h>
 #else
@@ -35,14 +70,66 @@
 #include <windows.h>
 #endif
 
+// emcc -pthread: the batch pool runs on wasm threads (SharedArrayBuffer)
+#if defined(__EMSCRIPTEN_PTHREADS__) && !defined(METRO_THREADS)
+#define METRO_THREADS
+#endif
+
+#ifdef METRO_THREADS
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#if !defined(_WIN32) && !defined(__EMSCRIPTEN__)
+#define METRO_HAVE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// --serve: POSIX sockets; epoll on Linux, kqueue elsewhere
+#ifdef METRO_SERVER
+#if defined(_WIN32) || defined(__EMSCRIPTEN__)
+#error "METRO_SERVER needs POSIX sockets (Linux, macOS or a BSD)"
+#endif
+#include <errno.h>
+#include <signal.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#ifdef __linux__
+#define SERVER_EPOLL
+#include <sys/epoll.h>
+#else
+#include <sys/event.h>
+#endif
+#endif
+
 // =============================================================
 // CONSTANTS & METRO PARAMETERS
 // =============================================================
 #define MAX 400                     // Max stations
+#define MAX_LINES 16                // Max metro lines (one bit each in station_line_mask)
+#define MAX_EDGES (MAX * 4)         // Max undirected track segments
+#define STATION_HASH_SIZE 1024      // Key index slots (power of 2, > 2 * MAX)
 #define AVG_KM_PER_EDGE 1.1         // Approx. km between stations
 #define TIME_PER_EDGE_MIN 2         // Travel time between adjacent stations (minutes)
 #define INTERCHANGE_TIME_MIN 3      // Extra time when you change lines
 #define MAX_ALTERNATES 3            // Max alternate routes
+#define MAX_NODES (MAX * 2)         // Max (station, line) nodes in the routing graph
+#define MAX_LANDMARKS 8             // Max A* landmark stations
+
+// Average running speed implied by the per-edge constants above (km/h)
+#define AVG_SPEED_KMPH (AVG_KM_PER_EDGE * 60.0 / TIME_PER_EDGE_MIN)
+#define INTERCHANGE_SEC (INTERCHANGE_TIME_MIN * 60)
+
+// Approximate end-to-end line lengths (km); spacing = length / segments
+#define PURPLE_LINE_KM 43.5
+#define GREEN_LINE_KM  33.5
+#define PINK_LINE_KM   21.3
 
 // =============================================================
 // TERMINAL COLORS (ANSI ESCAPE CODES)
@@ -58,27 +145,246 @@
 #define CLR_YELLOW "\x1b[33m"
 
 // =============================================================
-// STATION STRUCTURE
+// INSTRUMENTATION (OPT-IN: -DMETRO_STATS)
 // =============================================================
 /*
-    display_name : Human-friendly name (e.g., "M.G. Road")
-    key_name     : Normalized, lowercase name used for matching
-    line_count   : Number of lines that pass via this station
-    lines        : Names of lines (e.g., "purple", "green", "pink")
-    planned      : 0 = open, 1 = planned (future/under construction)
+    Per-phase call counts and time, so a slow query can be pinned on
+    a network rebuild, name resolution, the search, alternates or
+    formatting. Compiled with -DMETRO_STATS the STATS_* macros below
+    update metro_stats; without it they expand to nothing and
+    get_stats() reports enabled = 0.
+
+      build      : network_finish (source/built-in), image loads and
+                   route table builds
+      resolve    : station names -> IDs
+      search     : find_route (table walks and searches)
+      alternates : find_alternates (its spur searches included)
+      render     : text / JSON / HTML / TXT formatting
+
+    Every field is a double so JS reads the struct as one
+    Float64Array (stats_size() bytes). Counters are not synchronized:
+    under a threaded batch they are approximate.
 */
 typedef struct {
-    char display_name[80];
-    char key_name[80];
-    int  line_count;
-    char lines[6][30];
-    int  planned;
-} Station;
-
-// Global data
-Station stations[MAX];
+    double enabled;             // 1 = built with METRO_STATS
+    double build_calls, build_us;
+    double resolve_calls, resolve_us;
+    double search_calls, search_us;
+    double alternates_calls, alternates_us;
+    double render_calls, render_us;
+    double nodes_expanded;      // nodes settled, over every search
+    double queue_peak;          // largest priority-queue size seen
+} MetroStats;
+
+MetroStats metro_stats;
+
+// Nanoseconds on a monotonic clock (only differences mean anything)
+double monotonic_ns(void) {
+#if defined(_WIN32)
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER now;
+    if (!freq.QuadPart) QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (double)now.QuadPart * 1e9 / (double)freq.QuadPart;
+#elif defined(__EMSCRIPTEN__)
+    return emscripten_get_now() * 1e6;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+#endif
+}
+
+#ifdef METRO_STATS
+double stats_now_us(void) {
+    return monotonic_ns() / 1e3;
+}
+
+#define STATS_START(t)       double t = stats_now_us()
+#define STATS_STOP(phase, t) (metro_stats.phase##_calls++, \
+                              metro_stats.phase##_us += stats_now_us() - (t))
+#define STATS_ADD(field, n)  (metro_stats.field += (n))
+#define STATS_PEAK(field, v) ((v) > metro_stats.field ? (void)(metro_stats.field = (v)) : (void)0)
+#else
+#define STATS_START(t)       ((void)0)
+#define STATS_STOP(phase, t) ((void)0)
+#define STATS_ADD(field, n)  ((void)0)
+#define STATS_PEAK(field, v) ((void)0)
+#endif
+
+/*
+    get_stats(out)
+
+    Copies the counters into *out. Returns 1, or 0 when the build has
+    no METRO_STATS (out is then all zeros).
+*/
+EMSCRIPTEN_KEEPALIVE
+int get_stats(MetroStats *out) {
+    *out = metro_stats;
+#ifdef METRO_STATS
+    out->enabled = 1;
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+EMSCRIPTEN_KEEPALIVE
+int stats_size(void) {
+    return (int)sizeof(MetroStats);
+}
+
+EMSCRIPTEN_KEEPALIVE
+void reset_stats(void) {
+    memset(&metro_stats, 0, sizeof metro_stats);
+}
+
+// =============================================================
+// STATION STRUCTURE
+// =============================================================
+/*
+    Stations are stored as parallel arrays indexed by station ID, so
+    the fields searches touch stay small and contiguous:
+
+      station_line_mask[id] : bit l set = served by line ID l
+      station_planned[id]   : 0 = open, 1 = planned (future/under construction)
+      station_key_off[id]   : normalized, lowercase name used for matching
+      station_display_off[id] : human-friendly name (e.g., "M.G. Road"),
+                                0 = none (the key is shown instead)
+
+    Names live in name_pool (NUL-terminated, offset 0 = ""), which is
+    only read for key comparisons and output.
+*/
+#define NAME_POOL_SIZE (MAX * 160)
+
+unsigned short station_line_mask[MAX];
+unsigned char station_planned[MAX];
+int station_key_off[MAX];
+int station_display_off[MAX];
 int stationCount = 0;
-int adj[MAX][MAX];   // adjacency matrix: 1 if two stations are connected
+
+char name_pool_store[NAME_POOL_SIZE];
+char *name_pool = name_pool_store;
+int name_pool_used = 1;
+
+// Copy a name into the pool; returns its offset (0 = "" when the pool is full)
+int name_pool_add(const char *str, int len) {
+    if (len <= 0 || name_pool_used + len + 1 > NAME_POOL_SIZE) return 0;
+    int off = name_pool_used;
+    memcpy(name_pool + off, str, (size_t)len);
+    name_pool[off + len] = '\0';
+    name_pool_used += len + 1;
+    return off;
+}
+
+// Normalized key of a station
+const char *station_key(int id) {
+    return name_pool + station_key_off[id];
+}
+
+// Display name of a station, falling back to its key
+const char *station_name(int id) {
+    return station_display_off[id] ? name_pool + station_display_off[id]
+                                   : station_key(id);
+}
+
+// Number of lines serving a station
+int station_line_count(int id) {
+    int c = 0;
+    for (unsigned m = station_line_mask[id]; m; m &= m - 1) c++;
+    return c;
+}
+
+/*
+    Track segments are collected as an edge list while lines are added,
+    then packed into a compressed-sparse-row (CSR) neighbor index:
+
+      neighbors of u = adj_nbr[adj_offset[u] .. adj_offset[u + 1] - 1]
+      adj_line[k]    = line ID of the segment stored at adj_nbr[k]
+      adj_km[k]      = segment length in km
+      adj_sec[k]     = running time over the segment in seconds
+
+    Each undirected segment appears once in each endpoint's row.
+*/
+char line_names[MAX_LINES][30];     // line ID -> name ("purple", ...)
+int lineCount = 0;
+
+int edge_a[MAX_EDGES];
+int edge_b[MAX_EDGES];
+int edge_line[MAX_EDGES];
+double edge_km[MAX_EDGES];
+int edgeCount = 0;
+
+int line_first[MAX_LINES];          // terminal stations of each line
+int line_last[MAX_LINES];
+
+/*
+    The arrays below are reached through pointers so that a network
+    loaded from a binary image (see load_network_image) can be used in
+    place. build_network() points them back at the *_store arrays.
+*/
+int adj_offset_store[MAX + 1];
+int adj_nbr_store[2 * MAX_EDGES];
+int adj_line_store[2 * MAX_EDGES];
+double adj_km_store[2 * MAX_EDGES];
+int adj_sec_store[2 * MAX_EDGES];
+
+int *adj_offset = adj_offset_store;
+int *adj_nbr = adj_nbr_store;
+int *adj_line = adj_line_store;
+double *adj_km = adj_km_store;
+int *adj_sec = adj_sec_store;
+
+/*
+    Line-expanded routing graph (built from the CSR index):
+
+      node = one (station, line) pair
+      nodes of station s = node_offset[s] .. node_offset[s + 1] - 1
+      adj_to_node[k]     = node (adj_nbr[k], adj_line[k]) for CSR slot k
+
+    Riding a segment moves between nodes of the same line; changing
+    lines moves between nodes of the same station and costs
+    INTERCHANGE_SEC.
+*/
+int node_offset_store[MAX + 1];
+int node_station_store[MAX_NODES];
+int node_line_store[MAX_NODES];
+int adj_to_node_store[2 * MAX_EDGES];
+
+int *node_offset = node_offset_store;
+int *node_station = node_station_store;
+int *node_line = node_line_store;
+int *adj_to_node = adj_to_node_store;
+int nodeCount = 0;
+
+/*
+    A* landmarks, station-major so one station's distances are one
+    contiguous row (two SIMD vectors on wasm):
+
+      lm_dist[s * MAX_LANDMARKS + l] = seconds from landmark l to station s
+
+    Lanes l >= landmark_count stay 0 and never raise the bound.
+    landmark_station[l] is the terminal landmark l was grown from
+    (set by build_landmarks(); not stored in network images).
+*/
+int landmark_count = 0;
+int landmark_station[MAX_LANDMARKS];
+int lm_dist_store[MAX_LANDMARKS * MAX];
+int *lm_dist = lm_dist_store;
+
+// key_name -> station ID index (open addressing, linear probing, -1 = empty)
+int station_hash_store[STATION_HASH_SIZE];
+int *station_hash = station_hash_store;
+
+// Network cache state (see ensure_network)
+#define NETWORK_BUILTIN 0       // built from the arrays in build_network()
+#define NETWORK_LOADED  1       // loaded from a source file or binary image
+
+int network_ready = 0;          // 1 once build_network() has run
+int network_planned = -1;       // include_planned flag of the last ensure_network()
+unsigned network_version = 0;   // bumped on every rebuild or edit
+unsigned network_build = 0;     // bumped only when the graph itself is replaced
+int network_origin = NETWORK_BUILTIN;
 
 // =============================================================
 // STRING UTILITIES
@@ -181,22 +487,134 @@ void normalize_inplace(char *s) {
 // =============================================================
 // FARE CALCULATION (DISTANCE-BASED SLABS)
 // =============================================================
+/*
+    Slab i covers trips up to fare_slab_km[i] km; the last one has no
+    upper bound. The route table stores the slab index per pair (one
+    byte), so a fare revision only has to touch fare_slab_rs[].
+*/
+#define FARE_SLABS 9
+
+const double fare_slab_km[FARE_SLABS - 1] = { 2, 4, 6, 8, 10, 15, 20, 25 };
+const int fare_slab_rs[FARE_SLABS] = { 10, 20, 30, 40, 50, 60, 70, 80, 90 };
+
+// Index of the slab a trip of km falls in
+int fare_slab(double km) {
+    int i = 0;
+    while (i < FARE_SLABS - 1 && km > fare_slab_km[i]) i++;
+    return i;
+}
+
 int fare_from_distance(double km) {
-    if (km <= 2)  return 10;
-    if (km <= 4)  return 20;
-    if (km <= 6)  return 30;
-    if (km <= 8)  return 40;
-    if (km <= 10) return 50;
-    if (km <= 15) return 60;
-    if (km <= 20) return 70;
-    if (km <= 25) return 80;
-    return 90;
+    return fare_slab_rs[fare_slab(km)];
 }
 
 // =============================================================
 // STATION AND NETWORK BUILDING
 // =============================================================
 
+// =============================================================
+// STATION KEY INDEX (HASH TABLE)
+// =============================================================
+
+// FNV-1a hash of a normalized key
+unsigned hash_key(const char *key) {
+    unsigned h = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)key; *p; p++) {
+        h ^= *p;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// Empty the key index (called before the network is rebuilt)
+void station_index_reset(void) {
+    for (int i = 0; i < STATION_HASH_SIZE; i++)
+        station_hash[i] = -1;
+}
+
+/*
+    station_index_slot(key)
+
+    Probe the table starting at hash(key). Returns the slot holding
+    the station with this key, or the empty slot where it belongs.
+*/
+int station_index_slot(const char *key) {
+    unsigned mask = STATION_HASH_SIZE - 1;
+    unsigned slot = hash_key(key) & mask;
+
+    while (station_hash[slot] != -1 &&
+           strcmp(station_key(station_hash[slot]), key) != 0) {
+        slot = (slot + 1) & mask;
+    }
+    return (int)slot;
+}
+
+// Station ID for a normalized key, or -1 if unknown
+int station_lookup(const char *key) {
+    return station_hash[station_index_slot(key)];
+}
+
+/*
+    Display-name index: a station whose display name normalizes to
+    something other than its key ("Mysuru Road", keyed "mysore road")
+    is found by either. Rebuilt with the network; when a display name
+    matches another station's key, the key wins.
+*/
+int display_hash[STATION_HASH_SIZE];
+
+// Normalized display name of a station into out (80 bytes)
+void station_display_key(int id, char *out) {
+    strncpy(out, station_name(id), 79);
+    out[79] = '\0';
+    normalize_inplace(out);
+}
+
+// Slot holding the station displayed as key, or the empty slot for it
+int display_index_slot(const char *key) {
+    unsigned mask = STATION_HASH_SIZE - 1;
+    unsigned slot = hash_key(key) & mask;
+    char text[80];
+
+    while (display_hash[slot] != -1) {
+        station_display_key(display_hash[slot], text);
+        if (strcmp(text, key) == 0) break;
+        slot = (slot + 1) & mask;
+    }
+    return (int)slot;
+}
+
+// Empty the display-name index (called before the network is rebuilt)
+void display_index_reset(void) {
+    for (int i = 0; i < STATION_HASH_SIZE; i++)
+        display_hash[i] = -1;
+}
+
+void build_display_index(void) {
+    display_index_reset();
+    for (int s = 0; s < stationCount; s++) {
+        char text[80];
+        station_display_key(s, text);
+        if (strcmp(text, station_key(s)) == 0) continue;
+        int slot = display_index_slot(text);
+        if (display_hash[slot] == -1) display_hash[slot] = s;
+    }
+}
+
+/*
+    find_station_id(key, include_planned)
+
+    Query-side lookup: like station_lookup(), falling back to display
+    names, but planned stations are treated as missing when
+    include_planned is 0.
+*/
+int find_station_id(const char *key, int include_planned) {
+    int id = station_lookup(key);
+    if (id == -1) id = display_hash[display_index_slot(key)];
+    if (id != -1 && !include_planned && station_planned[id])
+        return -1;
+    return id;
+}
+
 /*
     find_or_add_by_key_with_plan(key, display, planned)
 
@@ -204,21 +622,23 @@ int fare_from_distance(double km) {
         - return its ID
     Otherwise:
         - create new station,
-        - store key_name + cleaned display_name,
+        - pool the key + cleaned display name,
         - store planned flag,
-        - return new ID
+        - return new ID (-1 when the tables are full)
 */
 int find_or_add_by_key_with_plan(const char *key, const char *display, int planned) {
     // check if station exists
-    for (int i = 0; i < stationCount; i++) {
-        if (strcmp(stations[i].key_name, key) == 0) {
-            return i;
-        }
+    int slot = station_index_slot(key);
+    if (station_hash[slot] != -1) {
+        return station_hash[slot];
     }
+    if (stationCount >= MAX) return -1;
 
     // create new
-    strncpy(stations[stationCount].key_name, key, 79);
-    stations[stationCount].key_name[79] = '\0';
+    int key_len = (int)strlen(key);
+    if (key_len > 79) key_len = 79;
+    int key_off = name_pool_add(key, key_len);
+    if (key_off == 0) return -1;
 
     // trim spaces in display name
     char tmp[80];
@@ -231,165 +651,631 @@ int find_or_add_by_key_with_plan(const char *key, const char *display, int plann
     int e = (int)strlen(tmp) - 1;
     while (e >= 0 && isspace((unsigned char)tmp[e])) e--;
 
-    if (s <= e) {
-        int len = e - s + 1;
-        if (len > 79) len = 79;
-        strncpy(stations[stationCount].display_name, tmp + s, len);
-        stations[stationCount].display_name[len] = '\0';
-    } else {
-        stations[stationCount].display_name[0] = '\0';
-    }
-
-    stations[stationCount].line_count = 0;
-    stations[stationCount].planned = planned;
+    station_key_off[stationCount] = key_off;
+    station_display_off[stationCount] = s <= e ? name_pool_add(tmp + s, e - s + 1) : 0;
+    station_line_mask[stationCount] = 0;
+    station_planned[stationCount] = (unsigned char)(planned ? 1 : 0);
 
+    station_hash[slot] = stationCount;
     return stationCount++;
 }
 
-// Attach a line name (like "purple") to a station
-void add_line_tag(int id, const char *line) {
-    for (int i = 0; i < stations[id].line_count; i++) {
-        if (strcmp(stations[id].lines[i], line) == 0) {
-            return; // already present
+// Mark a station as served by line ID line_id
+void add_line_tag(int id, int line_id) {
+    if (line_id < 0 || line_id >= MAX_LINES) return;
+    station_line_mask[id] |= (unsigned short)(1u << line_id);
+}
+
+// Return the ID of a line name, registering it on first use
+int find_or_add_line(const char *line) {
+    for (int i = 0; i < lineCount; i++) {
+        if (strcmp(line_names[i], line) == 0) {
+            return i;
         }
     }
-    strncpy(stations[id].lines[stations[id].line_count], line, 29);
-    stations[id].lines[stations[id].line_count][29] = '\0';
-    stations[id].line_count++;
+    if (lineCount >= MAX_LINES) return -1;
+    strncpy(line_names[lineCount], line, 29);
+    line_names[lineCount][29] = '\0';
+    return lineCount++;
 }
 
-// Connect two station IDs in adjacency matrix
-void connect_ids(int a, int b) {
+// Record a track segment between two station IDs on a line
+void connect_ids(int a, int b, int line_id, double km) {
     if (a < 0 || b < 0 || a == b) return;
-    adj[a][b] = 1;
-    adj[b][a] = 1;
+    if (edgeCount >= MAX_EDGES) return;
+    edge_a[edgeCount] = a;
+    edge_b[edgeCount] = b;
+    edge_line[edgeCount] = line_id;
+    edge_km[edgeCount] = km;
+    edgeCount++;
+}
+
+/*
+    build_adjacency_index()
+
+    Packs the edge list into the CSR arrays:
+      1. count the degree of every station,
+      2. prefix-sum degrees into adj_offset[],
+      3. scatter both directions of every segment,
+      4. sort each row by neighbor ID, then line ID, and drop
+         duplicate segments (BFS then visits neighbors in the same
+         order as before). Two lines over the same track keep a slot
+         each, so both have the segment in the routing graph.
+*/
+void build_adjacency_index(void) {
+    int fill[MAX];
+
+    for (int i = 0; i <= stationCount; i++)
+        adj_offset[i] = 0;
+
+    for (int e = 0; e < edgeCount; e++) {
+        adj_offset[edge_a[e] + 1]++;
+        adj_offset[edge_b[e] + 1]++;
+    }
+    for (int i = 0; i < stationCount; i++) {
+        adj_offset[i + 1] += adj_offset[i];
+        fill[i] = adj_offset[i];
+    }
+
+    for (int e = 0; e < edgeCount; e++) {
+        int a = edge_a[e], b = edge_b[e];
+        adj_nbr[fill[a]] = b;
+        adj_line[fill[a]] = edge_line[e];
+        adj_km[fill[a]] = edge_km[e];
+        fill[a]++;
+        adj_nbr[fill[b]] = a;
+        adj_line[fill[b]] = edge_line[e];
+        adj_km[fill[b]] = edge_km[e];
+        fill[b]++;
+    }
+
+    // sort + dedupe rows in place, compacting the arrays as we go
+    int out = 0;
+    for (int u = 0; u < stationCount; u++) {
+        int start = adj_offset[u];
+        int end = adj_offset[u + 1];
+
+        for (int k = start + 1; k < end; k++) {
+            int nb = adj_nbr[k], ln = adj_line[k];
+            double km = adj_km[k];
+            int j = k - 1;
+            while (j >= start && (adj_nbr[j] > nb || (adj_nbr[j] == nb && adj_line[j] > ln))) {
+                adj_nbr[j + 1] = adj_nbr[j];
+                adj_line[j + 1] = adj_line[j];
+                adj_km[j + 1] = adj_km[j];
+                j--;
+            }
+            adj_nbr[j + 1] = nb;
+            adj_line[j + 1] = ln;
+            adj_km[j + 1] = km;
+        }
+
+        adj_offset[u] = out;
+        for (int k = start; k < end; k++) {
+            if (k > start && adj_nbr[k] == adj_nbr[k - 1] && adj_line[k] == adj_line[k - 1])
+                continue;
+            adj_nbr[out] = adj_nbr[k];
+            adj_line[out] = adj_line[k];
+            adj_km[out] = adj_km[k];
+            adj_sec[out] = (int)(adj_km[k] * 3600.0 / AVG_SPEED_KMPH + 0.5);
+            out++;
+        }
+    }
+    adj_offset[stationCount] = out;
+}
+
+// CSR slot of segment a -> b, or -1 if the stations are not adjacent
+// (on shared track: the slot of the lowest line ID)
+int find_edge_slot(int a, int b) {
+    for (int k = adj_offset[a]; k < adj_offset[a + 1]; k++) {
+        if (adj_nbr[k] == b) return k;
+    }
+    return -1;
+}
+
+// CSR slot of segment a -> b on line line_id, or -1 if that line does not ride it
+int find_edge_slot_on_line(int a, int b, int line_id) {
+    for (int k = adj_offset[a]; k < adj_offset[a + 1]; k++) {
+        if (adj_nbr[k] == b && adj_line[k] == line_id) return k;
+    }
+    return -1;
+}
+
+// Routing-graph node for (station, line), or -1 if the line skips it
+int node_of(int station, int line_id) {
+    for (int x = node_offset[station]; x < node_offset[station + 1]; x++) {
+        if (node_line[x] == line_id) return x;
+    }
+    return -1;
+}
+
+/*
+    build_route_graph()
+
+    Creates one routing node per distinct line in each station's CSR
+    row, then resolves every CSR slot to the node it leads to.
+*/
+void build_route_graph(void) {
+    nodeCount = 0;
+    for (int s = 0; s < stationCount; s++) {
+        node_offset[s] = nodeCount;
+        for (int k = adj_offset[s]; k < adj_offset[s + 1]; k++) {
+            int seen = 0;
+            for (int x = node_offset[s]; x < nodeCount; x++) {
+                if (node_line[x] == adj_line[k]) seen = 1;
+            }
+            if (seen) continue;
+            if (nodeCount >= MAX_NODES) break;
+            node_station[nodeCount] = s;
+            node_line[nodeCount] = adj_line[k];
+            nodeCount++;
+        }
+    }
+    node_offset[stationCount] = nodeCount;
+
+    for (int s = 0; s < stationCount; s++) {
+        for (int k = adj_offset[s]; k < adj_offset[s + 1]; k++) {
+            adj_to_node[k] = node_of(adj_nbr[k], adj_line[k]);
+        }
+    }
 }
 
 /*
-    add_line_with_plan(lineName, list, n, planned_flags)
+    add_line_with_plan(lineName, list, n, planned_flags, line_km, seg_km)
 
     For each station name in the list:
-      - normalize to key
+      - normalize to key ("key = Display Name" keys on the text before
+        the '=' and shows the text after it)
       - find or create station
       - tag with lineName
-    Then connect them sequentially as edges.
+    Then connect them sequentially as edges. seg_km[i] (when seg_km
+    is not NULL and the entry is > 0) is the measured length from
+    station i - 1 to station i; the other segments share what is left
+    of line_km evenly, or get AVG_KM_PER_EDGE when nothing is left.
 */
-void add_line_with_plan(const char *lineName, const char *list[], int n, int planned_flags[]) {
+void add_line_with_plan(const char *lineName, const char *list[], int n, int planned_flags[],
+                        double line_km, const double seg_km[]) {
     int ids[MAX];
+    int line_id = find_or_add_line(lineName);
+    double known_km = 0.0;
+    int unknown = 0;
+
+    for (int i = 1; i < n; i++) {
+        if (seg_km && seg_km[i] > 0) known_km += seg_km[i];
+        else unknown++;
+    }
+    double even_km = (unknown > 0 && line_km > known_km) ? (line_km - known_km) / unknown
+                                                         : AVG_KM_PER_EDGE;
 
     for (int i = 0; i < n; i++) {
         char display[80];
         char key[80];
+        const char *eq = strchr(list[i], '=');
+        int key_len = eq ? (int)(eq - list[i]) : (int)strlen(list[i]);
+        if (key_len > 79) key_len = 79;
 
-        strncpy(display, list[i], 79);
+        strncpy(display, eq ? eq + 1 : list[i], 79);
         display[79] = '\0';
 
-        strncpy(key, list[i], 79);
-        key[79] = '\0';
+        memcpy(key, list[i], (size_t)key_len);
+        key[key_len] = '\0';
         normalize_inplace(key);
 
         ids[i] = find_or_add_by_key_with_plan(key, display,
                                               planned_flags ? planned_flags[i] : 0);
-        add_line_tag(ids[i], lineName);
+        if (ids[i] >= 0)
+            add_line_tag(ids[i], line_id);
     }
 
     // connect consecutive stations in this line
     for (int i = 0; i < n - 1; i++) {
-        connect_ids(ids[i], ids[i + 1]);
+        double km = (seg_km && seg_km[i + 1] > 0) ? seg_km[i + 1] : even_km;
+        connect_ids(ids[i], ids[i + 1], line_id, km);
+    }
+
+    if (line_id >= 0 && n > 0) {
+        line_first[line_id] = ids[0];
+        line_last[line_id] = ids[n - 1];
     }
 }
 
+// =============================================================
+// ARRAY KERNELS (WASM SIMD128 WHEN AVAILABLE)
+// =============================================================
 /*
-    build_network(include_planned)
+    Every search starts by resetting its per-node arrays, so these run
+    once per query over all nodes. Built with -msimd128 (the release
+    profile in build_wasm.sh) they store four ints per instruction;
+    landmark_bound() has a SIMD path for the same reason, and
+    od_index() turns bulk fare pairs into table offsets four at a time.
+*/
+#if defined(__wasm_simd128__) && MAX_LANDMARKS != 8
+#error "the SIMD landmark_bound() assumes MAX_LANDMARKS == 8 (two i32x4 rows)"
+#endif
 
-    Rebuilds the entire graph from scratch.
-    For now, all stations have planned flag 0.
-    In future, you can mark some as planned and
-    toggle them using include_planned.
+// a[0..n) = v
+void fill_int(int *a, int n, int v) {
+    int i = 0;
+#ifdef __wasm_simd128__
+    v128_t splat = wasm_i32x4_splat(v);
+    for (; i + 4 <= n; i += 4)
+        wasm_v128_store(a + i, splat);
+#endif
+    for (; i < n; i++)
+        a[i] = v;
+}
+
+// idx[i] = src[i] * n + dst[i], or -1 when either ID is outside [0, n)
+void od_index(const int *src, const int *dst, int count, int n, int *idx) {
+    int i = 0;
+#ifdef __wasm_simd128__
+    v128_t vn = wasm_i32x4_splat(n);
+    for (; i + 4 <= count; i += 4) {
+        v128_t s = wasm_v128_load(src + i);
+        v128_t t = wasm_v128_load(dst + i);
+        // unsigned compares reject negative IDs too
+        v128_t ok = wasm_v128_and(wasm_u32x4_lt(s, vn), wasm_u32x4_lt(t, vn));
+        v128_t x = wasm_i32x4_add(wasm_i32x4_mul(s, vn), t);
+        wasm_v128_store(idx + i, wasm_v128_or(x, wasm_v128_not(ok)));
+    }
+#endif
+    for (; i < count; i++) {
+        idx[i] = ((unsigned)src[i] < (unsigned)n && (unsigned)dst[i] < (unsigned)n)
+                 ? src[i] * n + dst[i] : -1;
+    }
+}
+
+// =============================================================
+// PRIORITY QUEUE (INDEXED BINARY MIN-HEAP)
+// =============================================================
+/*
+    Keys are search costs in seconds. Each node is queued at most once
+    (pos[] tracks its heap index), so a cheaper cost found later is a
+    decrease-key instead of a duplicate entry. Ties break on node ID
+    to keep routes deterministic.
 */
-void build_network(int include_planned) {
-    stationCount = 0;
+typedef struct {
+    int size;
+    int node[MAX_NODES];
+    int key[MAX_NODES];
+    int pos[MAX_NODES];     // heap index of a node, -1 when not queued
+} MinHeap;
+
+void heap_reset(MinHeap *h, int n) {
+    h->size = 0;
+    fill_int(h->pos, n, -1);
+}
 
-    // reset adjacency matrix
-    for (int i = 0; i < MAX; i++)
-        for (int j = 0; j < MAX; j++)
-            adj[i][j] = 0;
+int heap_less(const MinHeap *h, int i, int j) {
+    if (h->key[i] != h->key[j]) return h->key[i] < h->key[j];
+    return h->node[i] < h->node[j];
+}
 
-    // =======================
-    // PURPLE LINE
-    // =======================
-    const char *purple[] = {
-        "challaghatta", "kengeri","Kengeri Bus Terminal","Pattanagere","Jnanbharati","Rajarajeshwari Nagar",
-        "Nayandahalli","mysore road", "deepanjali nagar", "attiguppe",
-        "vijayanagar", "Hosahalli", "magadi road", "majestic", "Central Road","Vidhana Soudha",
-        "Cubbon Park","m.g. road", "trinity", "halasuru", "indiranagar",
-        "swami vivekananda road", "baiyappanahalli","Benniganahalli", "kr puram","Singayyanapalya","Garudacharpalaya",
-        "hoodi","Seetharampalya","Kundalahalli","Nallurhalli","Sri Satya Sai Hospital","Pattandur Agrahara","Kadugodi Tree Park",
-        "Channasandra(HopeFarm)", "whitefield(Kadugodi)"
-    };
-    int purple_planned[sizeof(purple) / sizeof(purple[0])];
-    for (int i = 0; i < (int)(sizeof(purple) / sizeof(purple[0])); i++)
-        purple_planned[i] = 0;
+void heap_swap(MinHeap *h, int i, int j) {
+    int tn = h->node[i], tk = h->key[i];
+    h->node[i] = h->node[j];
+    h->key[i] = h->key[j];
+    h->node[j] = tn;
+    h->key[j] = tk;
+    h->pos[h->node[i]] = i;
+    h->pos[h->node[j]] = j;
+}
 
-    // =======================
-    // GREEN LINE
-    // =======================
-    const char *green[] = {
-        "Madavara", "Chikkabidarakallu", "Manjunathanagar", "nagasandra", "Dasarhalli","Jalahalli",
-        "Peenya Industry", "Peenya", "Gorguntepalya", "Yeswantpur", "Sandal Soap Factory", "Mahalakshmi",
-        "Rajijnagar", "Kuvempu road", "Srirampura", "Sampige Road", "majestic",
-        "Chickpete", "Krishna Rajendra Market", "National College", "Lalbagh", "South End Circle",
-        "Jayanagar", "Rashtreeya Vidyalaya Road", "Banashankari","jayadeva hospital", "Yelachenahalli", "Konanakunte Cross",
-        "Vajarahalli","Thalaghattapura","Silk Institute"
-    };
-    int green_planned[sizeof(green) / sizeof(green[0])];
-    for (int i = 0; i < (int)(sizeof(green) / sizeof(green[0])); i++)
-        green_planned[i] = 0;
+void heap_sift_up(MinHeap *h, int i) {
+    while (i > 0) {
+        int p = (i - 1) / 2;
+        if (!heap_less(h, i, p)) break;
+        heap_swap(h, i, p);
+        i = p;
+    }
+}
 
-    // =======================
-    // PINK LINE
-    // =======================
-    const char *pink[] = {
-        "kalena agrahara", "hulimavu", "iim bangalore", "jp nagar 4th phase",
-        "jayadeva hospital", "Tavarekere","dairy circle", "lakkasandra", "langford town",
-        "rashtriya military school", "mg road", "shivajinagar", "Cantonment","Pottery Town",
-        "tannery road","Venkateshpura","kadugundanahalli", "nagawara"
-    };
-    int pink_planned[sizeof(pink) / sizeof(pink[0])];
-    for (int i = 0; i < (int)(sizeof(pink) / sizeof(pink[0])); i++)
-        pink_planned[i] = 0;
+void heap_sift_down(MinHeap *h, int i) {
+    for (;;) {
+        int l = 2 * i + 1, r = l + 1, m = i;
+        if (l < h->size && heap_less(h, l, m)) m = l;
+        if (r < h->size && heap_less(h, r, m)) m = r;
+        if (m == i) break;
+        heap_swap(h, i, m);
+        i = m;
+    }
+}
 
-    // add lines to graph
-    add_line_with_plan("purple", purple, (int)(sizeof(purple) / sizeof(purple[0])), purple_planned);
-    add_line_with_plan("green",  green,  (int)(sizeof(green)  / sizeof(green[0])),  green_planned);
-    add_line_with_plan("pink",   pink,   (int)(sizeof(pink)   / sizeof(pink[0])),   pink_planned);
+// Queue node with key, or lower its key if it is already queued
+void heap_push(MinHeap *h, int node, int key) {
+    int i = h->pos[node];
+    if (i == -1) {
+        i = h->size++;
+        STATS_PEAK(queue_peak, h->size);
+        h->node[i] = node;
+        h->key[i] = key;
+        h->pos[node] = i;
+    } else if (key < h->key[i]) {
+        h->key[i] = key;
+    } else {
+        return;
+    }
+    heap_sift_up(h, i);
+}
 
-    // include_planned parameter reserved for future when some nodes are planned=1
-    (void)include_planned; // silence unused warning for now
+// Remove and return the cheapest node (the heap must not be empty)
+int heap_pop(MinHeap *h) {
+    int top = h->node[0];
+    h->size--;
+    if (h->size > 0) {
+        h->node[0] = h->node[h->size];
+        h->key[0] = h->key[h->size];
+        h->pos[h->node[0]] = 0;
+        heap_sift_down(h, 0);
+    }
+    h->pos[top] = -1;
+    return top;
 }
 
 // =============================================================
-// BFS: SHORTEST PATH (UNWEIGHTED GRAPH)
+// A* LANDMARKS
 // =============================================================
-
 /*
-    bfs_with_blocked_edges(src, dest, parent, blocked_a, blocked_b, blocked_count)
+    build_landmarks()
 
-    Standard BFS to find shortest path in terms of station hops.
-
-    Algorithm:
-      - Use a queue.
-      - visited[] to mark visited nodes.
-      - parent[] to reconstruct path later.
-      - blocked edges: skip edges (u,v) that match any blocked pair.
+    Line terminals make good landmarks: they sit at the ends of the
+    network, so differences in distance to them bound the distance
+    between any two stations from below (triangle inequality):
 
-    Returns:
-      1 if path found, 0 otherwise.
+        h(v, t) = max over landmarks L of |d(L, t) - d(L, v)|
 
-    parent[v] will contain the station from which we reached v.
+    Distances here ignore interchange time, so the bound never
+    overestimates a line-expanded route cost.
 */
-int bfs_with_blocked_edges(
-    int src,
+void build_landmarks(void) {
+    static MinHeap h;
+    static int dist[MAX];
+    landmark_count = 0;
+    fill_int(lm_dist, stationCount * MAX_LANDMARKS, 0);
+
+    for (int ln = 0; ln < lineCount; ln++) {
+        int ends[2] = { line_first[ln], line_last[ln] };
+        for (int e = 0; e < 2 && landmark_count < MAX_LANDMARKS; e++) {
+            // a terminal shared by two lines is one landmark (compare IDs:
+            // a distance of 0 also marks a station the landmark cannot reach)
+            int dup = 0;
+            for (int l = 0; l < landmark_count; l++) {
+                if (landmark_station[l] == ends[e]) dup = 1;
+            }
+            if (dup) continue;
+
+            // plain station-level Dijkstra from this terminal
+            fill_int(dist, stationCount, -1);
+            heap_reset(&h, stationCount);
+            dist[ends[e]] = 0;
+            heap_push(&h, ends[e], 0);
+
+            while (h.size > 0) {
+                int u = heap_pop(&h);
+                for (int k = adj_offset[u]; k < adj_offset[u + 1]; k++) {
+                    int v = adj_nbr[k];
+                    int nd = dist[u] + adj_sec[k];
+                    if (dist[v] == -1 || nd < dist[v]) {
+                        dist[v] = nd;
+                        heap_push(&h, v, nd);
+                    }
+                }
+            }
+
+            // stations this landmark cannot reach contribute no bound
+            for (int i = 0; i < stationCount; i++)
+                lm_dist[i * MAX_LANDMARKS + landmark_count] = dist[i] < 0 ? 0 : dist[i];
+            landmark_station[landmark_count++] = ends[e];
+        }
+    }
+}
+
+// Lower bound (seconds) on any route cost from station v to station t
+int landmark_bound(int v, int t) {
+    const int *a = lm_dist + v * MAX_LANDMARKS;
+    const int *b = lm_dist + t * MAX_LANDMARKS;
+#ifdef __wasm_simd128__
+    // all eight lanes at once: max |b - a|
+    v128_t d0 = wasm_i32x4_abs(wasm_i32x4_sub(wasm_v128_load(b), wasm_v128_load(a)));
+    v128_t d1 = wasm_i32x4_abs(wasm_i32x4_sub(wasm_v128_load(b + 4), wasm_v128_load(a + 4)));
+    v128_t m = wasm_i32x4_max(d0, d1);
+    m = wasm_i32x4_max(m, wasm_i32x4_shuffle(m, m, 2, 3, 0, 1));
+    m = wasm_i32x4_max(m, wasm_i32x4_shuffle(m, m, 1, 0, 3, 2));
+    return wasm_i32x4_extract_lane(m, 0);
+#else
+    int best = 0;
+    for (int l = 0; l < landmark_count; l++) {
+        int d = b[l] - a[l];
+        if (d < 0) d = -d;
+        if (d > best) best = d;
+    }
+    return best;
+#endif
+}
+
+void release_network_image(void);
+void closures_reset(void);
+
+/*
+    network_begin()
+
+    Empties the network and points every table back at its static
+    store, ready for add_line_with_plan() calls.
+*/
+void network_begin(void) {
+    release_network_image();
+
+    adj_offset = adj_offset_store;
+    adj_nbr = adj_nbr_store;
+    adj_line = adj_line_store;
+    adj_km = adj_km_store;
+    adj_sec = adj_sec_store;
+    node_offset = node_offset_store;
+    node_station = node_station_store;
+    node_line = node_line_store;
+    adj_to_node = adj_to_node_store;
+    lm_dist = lm_dist_store;
+    station_hash = station_hash_store;
+    name_pool = name_pool_store;
+    name_pool[0] = '\0';
+    name_pool_used = 1;
+
+    stationCount = 0;
+    lineCount = 0;
+    edgeCount = 0;
+    nodeCount = 0;
+    landmark_count = 0;
+    station_index_reset();
+    display_index_reset();
+    closures_reset();
+}
+
+/*
+    network_finish(include_planned)
+
+    Derives the search tables from the lines added since
+    network_begin() and marks the network ready.
+*/
+void network_finish(int include_planned) {
+    STATS_START(started);
+
+    // pack segments into the CSR neighbor index used by every search
+    build_adjacency_index();
+
+    // (station, line) routing graph + A* landmark tables
+    build_route_graph();
+    build_landmarks();
+    build_display_index();
+
+    // include_planned parameter reserved for future when some nodes are planned=1
+    network_ready = 1;
+    network_planned = include_planned;
+    network_version++;
+    network_build++;
+    STATS_STOP(build, started);
+}
+
+/*
+    build_network(include_planned)
+
+    Rebuilds the entire graph from scratch.
+    For now, all stations have planned flag 0.
+    In future, you can mark some as planned and
+    toggle them using include_planned.
+*/
+void build_network(int include_planned) {
+    network_begin();
+
+    // =======================
+    // PURPLE LINE
+    // =======================
+    const char *purple[] = {
+        "Challaghatta", "Kengeri", "Kengeri Bus Terminal", "Pattanagere",
+        "Jnanbharati = Jnanabharathi", "Rajarajeshwari Nagar", "Nayandahalli",
+        "mysore road = Mysuru Road", "Deepanjali Nagar", "Attiguppe", "Vijayanagar",
+        "Hosahalli", "Magadi Road", "majestic = Nadaprabhu Kempegowda Stn., Majestic",
+        "Central Road = Sir M. Visveshwaraya Stn., Central College",
+        "Vidhana Soudha = Dr. B.R. Ambedkar Station, Vidhana Soudha", "Cubbon Park",
+        "m.g. road = Mahatma Gandhi Road", "Trinity", "Halasuru", "Indiranagar",
+        "Swami Vivekananda Road", "Baiyappanahalli", "Benniganahalli",
+        "kr puram = Krishnarajapura", "Singayyanapalya", "Garudacharpalaya = Garudacharpalya",
+        "Hoodi", "Seetharampalya", "Kundalahalli", "Nallurhalli",
+        "Sri Satya Sai Hospital = Sri Sathya Sai Hospital", "Pattandur Agrahara",
+        "Kadugodi Tree Park", "Channasandra(HopeFarm) = Hopefarm Channasandra",
+        "whitefield(Kadugodi) = Whitefield (Kadugodi)"
+    };
+    int purple_planned[sizeof(purple) / sizeof(purple[0])];
+    for (int i = 0; i < (int)(sizeof(purple) / sizeof(purple[0])); i++)
+        purple_planned[i] = 0;
+
+    // =======================
+    // GREEN LINE
+    // =======================
+    const char *green[] = {
+        "Madavara", "Chikkabidarakallu", "Manjunathanagar = Manjunath Nagar", "Nagasandra",
+        "Dasarhalli = Dasarahalli", "Jalahalli", "Peenya Industry", "Peenya",
+        "Gorguntepalya = Goraguntepalya", "Yeswantpur = Yeshwanthpur", "Sandal Soap Factory",
+        "Mahalakshmi", "Rajijnagar = Rajajinagar", "Kuvempu road = Mahakavi Kuvempu Road",
+        "Srirampura", "Sampige Road = Mantri Square Sampige Road",
+        "majestic = Nadaprabhu Kempegowda Stn., Majestic", "Chickpete",
+        "Krishna Rajendra Market", "National College", "Lalbagh", "South End Circle",
+        "Jayanagar", "Rashtreeya Vidyalaya Road", "Banashankari", "Jayadeva Hospital",
+        "Yelachenahalli", "Konanakunte Cross = Konankunte Cross", "Vajarahalli",
+        "Thalaghattapura", "Silk Institute"
+    };
+    int green_planned[sizeof(green) / sizeof(green[0])];
+    for (int i = 0; i < (int)(sizeof(green) / sizeof(green[0])); i++)
+        green_planned[i] = 0;
+
+    // =======================
+    // PINK LINE
+    // =======================
+    const char *pink[] = {
+        "Kalena Agrahara", "Hulimavu", "iim bangalore = IIM-Bangalore", "JP Nagar 4th Phase",
+        "Jayadeva Hospital", "Tavarekere = Swagath Road Cross", "Dairy Circle", "Lakkasandra",
+        "Langford Town", "Rashtriya Military School", "mg road = Mahatma Gandhi Road",
+        "Shivajinagar", "Cantonment", "Pottery Town", "Tannery Road", "Venkateshpura",
+        "Kadugundanahalli", "Nagawara"
+    };
+    int pink_planned[sizeof(pink) / sizeof(pink[0])];
+    for (int i = 0; i < (int)(sizeof(pink) / sizeof(pink[0])); i++)
+        pink_planned[i] = 0;
+
+    // add lines to graph
+    add_line_with_plan("purple", purple, (int)(sizeof(purple) / sizeof(purple[0])), purple_planned,
+                       PURPLE_LINE_KM, NULL);
+    add_line_with_plan("green",  green,  (int)(sizeof(green)  / sizeof(green[0])),  green_planned,
+                       GREEN_LINE_KM, NULL);
+    add_line_with_plan("pink",   pink,   (int)(sizeof(pink)   / sizeof(pink[0])),   pink_planned,
+                       PINK_LINE_KM, NULL);
+
+    network_finish(include_planned);
+    network_origin = NETWORK_BUILTIN;
+}
+
+/*
+    ensure_network(include_planned)
+
+    Builds the graph only when it has never been built. Query paths
+    call this instead of build_network() so repeated lookups reuse
+    the same prebuilt graph.
+
+    Planned stations are always part of the graph (find_station_id()
+    hides them while include_planned is 0), so the planned toggle
+    only changes the lookup flag: no rebuild, and closures and warm
+    caches survive it. A network loaded from a file is never replaced
+    by the built-in lines.
+*/
+void ensure_network(int include_planned) {
+    if (!network_ready)
+        build_network(include_planned);
+    network_planned = include_planned;
+}
+
+// =============================================================
+// BFS: SHORTEST PATH (UNWEIGHTED GRAPH)
+// =============================================================
+
+/*
+    bfs_with_blocked_edges(src, dest, parent, blocked_a, blocked_b, blocked_count)
+
+    Standard BFS to find shortest path in terms of station hops.
+
+    Algorithm:
+      - Use a queue.
+      - visited[] to mark visited nodes.
+      - parent[] to reconstruct path later.
+      - blocked edges: skip edges (u,v) that match any blocked pair.
+      - neighbors come from the CSR index, so the whole search
+        is O(V + E) instead of O(V^2).
+
+    Returns:
+      1 if path found, 0 otherwise.
+
+    parent[v] will contain the station from which we reached v.
+*/
+int bfs_with_blocked_edges(
+    int src,
     int dest,
     int parent[],
     int blocked_a[],
@@ -412,8 +1298,8 @@ int bfs_with_blocked_edges(
             return 1; // found path
         }
 
-        for (int v = 0; v < stationCount; v++) {
-            if (!adj[u][v]) continue;   // not connected
+        for (int k = adj_offset[u]; k < adj_offset[u + 1]; k++) {
+            int v = adj_nbr[k];
             if (visited[v]) continue;   // already visited
 
             // check if this edge is blocked
@@ -443,808 +1329,7352 @@ int bfs_simple(int src, int dest, int parent[]) {
 }
 
 // =============================================================
-// ROUTE HELPERS
+// WEIGHTED ROUTING (A* OVER THE LINE-EXPANDED GRAPH)
 // =============================================================
-
-// Compare two paths (arrays of indices)
-int route_equals(int a[], int lena, int b[], int lenb) {
-    if (lena != lenb) return 0;
-    for (int i = 0; i < lena; i++) {
-        if (a[i] != b[i]) return 0;
-    }
-    return 1;
-}
-
 /*
-    build_edge_lines(path, len, edgeLines)
-
-    For each consecutive pair in the path, find the line that
-    connects them (if there is one common line between the stations).
+    Route: one journey, as produced by the weighted router.
+
+    path[0..len-1]      : station IDs from source to destination
+    edge_slot[i]        : CSR slot ridden from path[i] to path[i + 1]
+                          (adj_line/adj_km/adj_sec give its line,
+                          length and running time)
+    interchanges        : number of line changes
+    time_sec            : running time + INTERCHANGE_SEC per change
+    km                  : sum of segment lengths
 */
-void build_edge_lines(int path[], int len, char edgeLines[][30]) {
-    for (int i = 0; i < len - 1; i++) {
-        int a = path[i];
-        int b = path[i + 1];
-        int found = 0;
-
-        for (int ai = 0; ai < stations[a].line_count && !found; ai++) {
-            for (int bi = 0; bi < stations[b].line_count && !found; bi++) {
-                if (strcmp(stations[a].lines[ai], stations[b].lines[bi]) == 0) {
-                    strncpy(edgeLines[i], stations[a].lines[ai], 29);
-                    edgeLines[i][29] = '\0';
-                    found = 1;
-                }
-            }
-        }
+typedef struct {
+    int len;
+    int path[MAX];
+    int edge_slot[MAX];
+    int interchanges;
+    int time_sec;
+    double km;
+} Route;
 
-        if (!found) {
-            strcpy(edgeLines[i], "unknown");
-        }
-    }
+// Per-search working memory (kept out of the call stack)
+typedef struct {
+    int dist[MAX_NODES];        // best known cost in seconds, -1 = unseen
+    int parent[MAX_NODES];      // previous node, -1 at a source node
+    int via[MAX_NODES];         // CSR slot ridden to reach the node, -1 = interchange
+    unsigned char done[MAX_NODES];
+    MinHeap heap;
+    int expanded;               // nodes settled by the last search
+} SearchScratch;
+
+SearchScratch route_scratch;
+
+// Line ID ridden on edge i of a route
+int route_line(const Route *r, int i) {
+    return adj_line[r->edge_slot[i]];
 }
 
 // =============================================================
-// UI HELPERS (COLORS, EMOJIS)
+// BITSETS (BLOCKED SEGMENTS / STATIONS)
 // =============================================================
+#define SLOT_BITSET_BYTES    ((2 * MAX_EDGES + 7) / 8)
+#define STATION_BITSET_BYTES ((MAX + 7) / 8)
 
-const char* line_color(const char *line) {
-    if (strcmp(line, "purple") == 0) return CLR_PURPLE;
-    if (strcmp(line, "green")  == 0) return CLR_GREEN;
-    if (strcmp(line, "pink")   == 0) return CLR_PINK;
-    return CLR_CYAN;
+void bitset_clear(unsigned char *bits, int nbytes) {
+    memset(bits, 0, (size_t)nbytes);
 }
 
-const char* line_emoji(const char *line) {
-    if (strcmp(line, "purple") == 0) return "🟣";
-    if (strcmp(line, "green")  == 0) return "🟢";
-    if (strcmp(line, "pink")   == 0) return "🌸";
-    return "◼️";
+void bit_set(unsigned char *bits, int i) {
+    bits[i >> 3] |= (unsigned char)(1u << (i & 7));
+}
+
+int bit_test(const unsigned char *bits, int i) {
+    return (bits[i >> 3] >> (i & 7)) & 1;
+}
+
+void bit_clear(unsigned char *bits, int i) {
+    bits[i >> 3] &= (unsigned char)~(1u << (i & 7));
 }
 
 /*
-    print_final_output_professional()
+    Service closures (set through the NETWORK EDITS entry points),
+    checked by every search on top of its own SearchMask:
 
-    CLI-only: pretty colored summary.
-*/
-void print_final_output_professional(int path[], int len, char edgeLines[][30]) {
-    // Top header
-    printf("\n%s%s%s\n", CLR_BOLD CLR_CYAN,
-           "════════════════════════════════════════════════════════════════════",
-           CLR_RESET);
-    printf("%s%*s%s\n", CLR_BOLD, 18, "", "NAMMA METRO — ROUTE SUMMARY");
-    printf("%s%s%s\n\n", CLR_BOLD CLR_CYAN,
-           "════════════════════════════════════════════════════════════════════",
-           CLR_RESET);
+      closed_slot    : bit k set = CSR slot k is out of service (a
+                       segment's two directions are closed together)
+      closed_station : bit s set = no boarding, alighting or changing
+                       lines at s; trains still run through it
 
-    // Route line
-    printf("%s%-12s%s", CLR_BOLD, "Route:", CLR_RESET);
-    for (int i = 0; i < len; i++) {
-        const char *nm = stations[path[i]].display_name[0]
-                         ? stations[path[i]].display_name
-                         : stations[path[i]].key_name;
-        printf("%s", nm);
-        if (i < len - 1) {
-            printf(" %s→%s ", CLR_DIM, CLR_RESET);
-        }
-    }
-    printf("\n\n");
+    The counts let searches skip the tests while nothing is closed.
+    Slots are renumbered by a rebuild, so a new network reopens all.
+*/
+unsigned char closed_slot[SLOT_BITSET_BYTES];
+unsigned char closed_station[STATION_BITSET_BYTES];
+int closed_slot_count = 0;
+int closed_station_count = 0;
+
+// 1 if station s is closed
+int station_closed(int s) {
+    return closed_station_count > 0 && bit_test(closed_station, s);
+}
 
-    // Segment table
-    printf("%s%-6s | %-20s | %-20s | %-10s%s\n",
-           CLR_BOLD, "Line", "Start", "End", "Segment", CLR_RESET);
-    printf("%s----------------------------------------------------------------------%s\n",
-           CLR_DIM, CLR_RESET);
+void closures_reset(void) {
+    bitset_clear(closed_slot, SLOT_BITSET_BYTES);
+    bitset_clear(closed_station, STATION_BITSET_BYTES);
+    closed_slot_count = 0;
+    closed_station_count = 0;
+}
 
-    int i = 0;
-    while (i < len - 1) {
-        char curr[30];
-        strncpy(curr, edgeLines[i], 29);
-        curr[29] = '\0';
+/*
+    SearchMask: optional restrictions for one search.
 
-        int s = i;
-        int e = i;
+      blocked_slot    : bit k set = CSR slot k may not be ridden
+      blocked_station : bit s set = station s may not be entered
+      max_cost        : give up once the cheapest queued estimate
+                        exceeds this many seconds (-1 = no limit)
+      no_heuristic    : 1 = plain Dijkstra even when dest >= 0
+*/
+typedef struct {
+    const unsigned char *blocked_slot;
+    const unsigned char *blocked_station;
+    int max_cost;
+    int no_heuristic;
+} SearchMask;
 
-        // group consecutive edges on same line
-        while (e + 1 < len - 1 && strcmp(edgeLines[e + 1], curr) == 0) {
-            e++;
-        }
+/*
+    weighted_search_from(sc, src, start_node, dest, mask)
 
-        const char *emoji = line_emoji(curr);
-        const char *color = line_color(curr);
-        const char *start = stations[path[s]].display_name[0]
-                            ? stations[path[s]].display_name
-                            : stations[path[s]].key_name;
-        const char *end   = stations[path[e + 1]].display_name[0]
-                            ? stations[path[e + 1]].display_name
-                            : stations[path[e + 1]].key_name;
-        int seg_stops = e - s + 1;
+    Dijkstra over (station, line) nodes, guided by the landmark bound
+    when dest >= 0 (A*). With start_node == -1 all nodes of src start
+    at cost 0, so the first boarding is free; otherwise the search
+    starts on that one node (used to continue a partial journey on the
+    line it arrived on). Every change of line costs INTERCHANGE_SEC.
 
-        printf("%s%-2s %-3s%s | %-20s | %-20s | %4d stops\n",
-               color, emoji, curr, CLR_RESET, start, end, seg_stops);
+    dest == -1 settles the whole network (single-source tree).
+    mask may be NULL.
 
-        i = e + 1;
+    Returns:
+      the settled node of dest (or 0 for a full tree), -1 if unreachable.
+*/
+int weighted_search_from(SearchScratch *sc, int src, int start_node, int dest,
+                         const SearchMask *mask) {
+    const unsigned char *bslot = mask ? mask->blocked_slot : NULL;
+    const unsigned char *bstation = mask ? mask->blocked_station : NULL;
+    int max_cost = mask ? mask->max_cost : -1;
+    int guided = dest >= 0 && !(mask && mask->no_heuristic);
+    const unsigned char *cslot = closed_slot_count ? closed_slot : NULL;
+    const unsigned char *cstation = closed_station_count ? closed_station : NULL;
+
+    fill_int(sc->dist, nodeCount, -1);
+    memset(sc->done, 0, sizeof sc->done);
+    heap_reset(&sc->heap, nodeCount);
+    sc->expanded = 0;
+
+    // no trip starts or ends at a closed station (a spur continuing
+    // on the line it arrived on is passing through, not starting)
+    if (cstation && ((start_node < 0 && bit_test(cstation, src)) ||
+                     (dest >= 0 && bit_test(cstation, dest))))
+        return dest >= 0 ? -1 : 0;
+
+    int first = start_node >= 0 ? start_node : node_offset[src];
+    int last = start_node >= 0 ? start_node + 1 : node_offset[src + 1];
+    for (int x = first; x < last; x++) {
+        sc->dist[x] = 0;
+        sc->parent[x] = -1;
+        sc->via[x] = -1;
+        heap_push(&sc->heap, x, guided ? landmark_bound(src, dest) : 0);
     }
 
-    // Interchanges
-    printf("\n%sInterchanges:%s\n", CLR_BOLD, CLR_RESET);
-    int interchanges = 0;
-    for (int ii = 0; ii < len; ii++) {
-        if (stations[path[ii]].line_count > 1) {
-            const char *nm = stations[path[ii]].display_name[0]
-                             ? stations[path[ii]].display_name
-                             : stations[path[ii]].key_name;
-            printf(" - %s (", nm);
-            for (int j = 0; j < stations[path[ii]].line_count; j++) {
-                printf("%s", stations[path[ii]].lines[j]);
-                if (j + 1 < stations[path[ii]].line_count) printf(", ");
-            }
-            printf(")\n");
-            interchanges++;
-        }
-    }
-    if (interchanges == 0) {
-        printf(" None\n");
-    }
+    while (sc->heap.size > 0) {
+        if (max_cost >= 0 && sc->heap.key[0] > max_cost) break;
 
-    // Per-stop breakdown
-    printf("\n%sPer-stop breakdown:%s\n", CLR_BOLD, CLR_RESET);
-    printf("%-28s -> %-28s | %-6s | %-6s | %-6s\n",
-           "From", "To", "Dist", "Time", "Fare");
-    printf("---------------------------------------------------------------------------------\n");
+        int x = heap_pop(&sc->heap);
+        int u = node_station[x];
+        sc->done[x] = 1;
+        sc->expanded++;
+        STATS_ADD(nodes_expanded, 1);
 
-    int edges = len - 1;
-    int total_time = 0;
-    double total_dist = 0.0;
+        if (u == dest) {
+            return x;
+        }
 
-    for (int k = 0; k < edges; k++) {
-        const char *a = stations[path[k]].display_name[0]
-                        ? stations[path[k]].display_name
-                        : stations[path[k]].key_name;
-        const char *b = stations[path[k + 1]].display_name[0]
-                        ? stations[path[k + 1]].display_name
-                        : stations[path[k + 1]].key_name;
-        double dist = AVG_KM_PER_EDGE;
-        int tmin = TIME_PER_EDGE_MIN;
-        int fare = fare_from_distance(dist);
-        total_dist += dist;
-        total_time += tmin;
+        // ride along this node's line
+        for (int k = adj_offset[u]; k < adj_offset[u + 1]; k++) {
+            if (adj_line[k] != node_line[x]) continue;
+            if (cslot && bit_test(cslot, k)) continue;
+            if (bslot && bit_test(bslot, k)) continue;
+            if (bstation && bit_test(bstation, adj_nbr[k])) continue;
+            int y = adj_to_node[k];
+            int nd = sc->dist[x] + adj_sec[k];
+            if (sc->done[y] || (sc->dist[y] != -1 && nd >= sc->dist[y])) continue;
+            sc->dist[y] = nd;
+            sc->parent[y] = x;
+            sc->via[y] = k;
+            heap_push(&sc->heap, y,
+                      nd + (guided ? landmark_bound(adj_nbr[k], dest) : 0));
+        }
 
-        printf("%-28s -> %-28s | %5.2f | %4d m | Rs%3d\n",
-               a, b, dist, tmin, fare);
+        // change to another line at the same station (not at a closed one)
+        if (cstation && bit_test(cstation, u)) continue;
+        for (int y = node_offset[u]; y < node_offset[u + 1]; y++) {
+            if (y == x) continue;
+            int nd = sc->dist[x] + INTERCHANGE_SEC;
+            if (sc->done[y] || (sc->dist[y] != -1 && nd >= sc->dist[y])) continue;
+            sc->dist[y] = nd;
+            sc->parent[y] = x;
+            sc->via[y] = -1;
+            heap_push(&sc->heap, y,
+                      nd + (guided ? landmark_bound(u, dest) : 0));
+        }
     }
 
-    int extra_interchange_time = interchanges * INTERCHANGE_TIME_MIN;
-    int est_time = total_time + extra_interchange_time;
-    int est_fare = fare_from_distance(total_dist);
-
-    printf("\n%sTrip summary:%s\n", CLR_BOLD, CLR_RESET);
-    printf(" - Stops travelled : %d\n", edges);
-    printf(" - Distance        : %.2f km\n", total_dist);
-    printf(" - Travel time     : %d min (incl. %d min interchange buffer)\n",
-           est_time, extra_interchange_time);
-    printf(" - Fare estimate   : Rs %d\n", est_fare);
+    return dest >= 0 ? -1 : 0;
+}
 
-    // current time & ETA
-    time_t now = time(NULL);
-    time_t arrive = now + est_time * 60;
-    struct tm *tnow = localtime(&now);
-    struct tm *tarr = localtime(&arrive);
-    char nowbuf[40];
-    char arrbuf[40];
+// Unrestricted search from every line at src (see weighted_search_from)
+int weighted_search(SearchScratch *sc, int src, int dest) {
+    return weighted_search_from(sc, src, -1, dest, NULL);
+}
 
-    strftime(nowbuf, sizeof nowbuf, "%I:%M %p", tnow);
-    strftime(arrbuf, sizeof arrbuf, "%I:%M %p", tarr);
+/*
+    route_from_search(sc, src, target, r)
 
-    printf("\n - Current time    : %s\n", nowbuf);
-    printf(" - ETA             : %s\n", arrbuf);
+    Walks parent[] back from target node and fills r. Interchange
+    steps (same station, different line) add no station to the path
+    but are counted in r->interchanges.
+*/
+void route_from_search(const SearchScratch *sc, int src, int target, Route *r) {
+    int rev_path[MAX];
+    int rev_slot[MAX];
+    int n = 0;
+
+    r->interchanges = 0;
+    r->km = 0.0;
+    r->time_sec = target >= 0 ? sc->dist[target] : 0;
+
+    if (target < 0) {
+        r->path[0] = src;
+        r->len = 1;
+        return;
+    }
 
-    printf("\n%s════════════════════════════════════════════════════════════════════%s\n\n",
-           CLR_CYAN, CLR_RESET);
-}
+    for (int x = target; x != -1; x = sc->parent[x]) {
+        if (sc->parent[x] != -1 && sc->via[x] == -1) {
+            r->interchanges++;
+            continue;
+        }
+        rev_path[n] = node_station[x];
+        rev_slot[n] = sc->via[x];
+        n++;
+    }
 
-// Simple ASCII preview of the route
-void print_ascii_map_preview(int path[], int len) {
-    printf("%sASCII Preview:%s\n\n", CLR_BOLD, CLR_RESET);
-    for (int i = 0; i < len; i++) {
-        const char *n = stations[path[i]].display_name[0]
-                        ? stations[path[i]].display_name
-                        : stations[path[i]].key_name;
-        printf("[ %s ]", n);
-        if (i < len - 1) printf("==");
+    // rev_slot[i] is the segment that arrived at rev_path[i]
+    r->len = n;
+    for (int i = 0; i < n; i++) {
+        r->path[i] = rev_path[n - 1 - i];
+    }
+    for (int i = 0; i < n - 1; i++) {
+        r->edge_slot[i] = rev_slot[n - 2 - i];
+        r->km += adj_km[r->edge_slot[i]];
     }
-    printf("\n\n");
 }
 
+// =============================================================
+// ALL-PAIRS ROUTE TABLE (O(1) LOOKUP MODE)
+// =============================================================
 /*
-    find_alternates()
+    One full search per destination t (the graph is undirected, so a
+    tree grown from t gives every station's fastest route *to* t):
 
-    Idea:
-      - Take the primary shortest path.
-      - For each edge in that path, temporarily block it.
-      - Run BFS again to see if a different route exists.
-      - This gives alternate paths that avoid certain segments.
+      rt_next[t * nodeCount + x]  : next node from x toward t
+      rt_start[s * n + t]         : node to board at s for a trip to t
+      rt_time / rt_dam / rt_hops / rt_changes / rt_fare [s * n + t]
+                                  : seconds, decametres, stops, line changes,
+                                    fare slab (fare_slab_rs[] gives the Rs)
 
-    Returns:
-      Number of alternate routes found.
-*/
-int find_alternates(int primary[], int plen,
-                    int alternates[][MAX], int altlens[]) {
-    int altcount = 0;
-
-    for (int e = 0; e < plen - 1 && altcount < MAX_ALTERNATES; e++) {
-        int blocked_a[1];
-        int blocked_b[1];
-        blocked_a[0] = primary[e];
-        blocked_b[0] = primary[e + 1];
-
-        int parent[MAX];
-        for (int i = 0; i < MAX; i++) parent[i] = -1;
-
-        if (bfs_with_blocked_edges(primary[0], primary[plen - 1],
-                                   parent, blocked_a, blocked_b, 1)) {
-            // reconstruct path
-            int path[MAX];
-            int len = 0;
-            int cur = primary[plen - 1];
-
-            while (cur != -1) {
-                path[len++] = cur;
-                cur = parent[cur];
-            }
-
-            // reverse
-            for (int i = 0; i < len / 2; i++) {
-                int t = path[i];
-                path[i] = path[len - 1 - i];
-                path[len - 1 - i] = t;
-            }
+    A lookup walks rt_next from rt_start with no search at all. The
+    table is tied to network_version and rebuilt after a rebuild.
+*/
+#define RT_NONE 0xFFFF
+
+int route_table_enabled = 1;            // build + use the table in find_route()
+int route_table_ready = 0;
+int route_table_owned = 1;              // 0 = arrays live inside a network image
+unsigned route_table_version = 0;
+
+unsigned short *rt_next = NULL;
+unsigned short *rt_start = NULL;
+unsigned short *rt_time = NULL;
+unsigned short *rt_dam = NULL;
+unsigned short *rt_hops = NULL;
+unsigned char *rt_changes = NULL;
+unsigned char *rt_fare = NULL;
+
+void free_route_table(void) {
+    if (route_table_owned) {
+        free(rt_next);
+        free(rt_start);
+        free(rt_time);
+        free(rt_dam);
+        free(rt_hops);
+        free(rt_changes);
+        free(rt_fare);
+    }
+    route_table_owned = 1;
+    rt_next = rt_start = rt_time = rt_dam = rt_hops = NULL;
+    rt_changes = rt_fare = NULL;
+    route_table_ready = 0;
+}
 
-            // check duplicates
-            int dup = 0;
-            if (route_equals(path, len, primary, plen)) {
-                dup = 1;
-            }
-            for (int a = 0; a < altcount && !dup; a++) {
-                if (route_equals(path, len, alternates[a], altlens[a])) {
-                    dup = 1;
-                }
-            }
+/*
+    route_table_walk(src, dest, r)
 
-            if (!dup) {
-                for (int i = 0; i < len; i++)
-                    alternates[altcount][i] = path[i];
-                altlens[altcount] = len;
-                altcount++;
-            }
+    Rebuilds the route src -> dest from the table. Returns 0 when the
+    pair is unreachable, or when the chain outgrows a Route or takes a
+    hop that is not a segment (only a damaged table does either).
+*/
+int route_table_walk(int src, int dest, Route *r) {
+    int n = stationCount;
+    int x = rt_start[src * n + dest];
+    if (x == RT_NONE) return 0;
+
+    const unsigned short *next = rt_next + (size_t)dest * nodeCount;
+
+    r->len = 0;
+    r->km = 0.0;
+    r->interchanges = 0;
+    r->time_sec = rt_time[src * n + dest];
+    r->path[r->len++] = node_station[x];
+
+    for (int steps = 0; next[x] != RT_NONE; steps++) {
+        int y = next[x];
+        if (steps >= nodeCount) return 0;
+        if (node_station[y] == node_station[x]) {
+            r->interchanges++;
+        } else {
+            int k = find_edge_slot_on_line(node_station[x], node_station[y], node_line[x]);
+            if (k < 0 || r->len >= MAX) return 0;
+            r->edge_slot[r->len - 1] = k;
+            r->km += adj_km[k];
+            r->path[r->len++] = node_station[y];
         }
+        x = y;
+    }
+    return 1;
+}
+
+// Cheapest settled node of station s in a search, -1 if unreached or closed
+int best_node(const SearchScratch *sc, int s) {
+    int best = -1;
+    if (station_closed(s)) return -1;
+    for (int x = node_offset[s]; x < node_offset[s + 1]; x++) {
+        if (sc->dist[x] >= 0 && (best == -1 || sc->dist[x] < sc->dist[best]))
+            best = x;
     }
+    return best;
+}
+
+// Per-pair summary of s -> t, from the same walk a lookup performs
+void route_table_summarize(int s, int t) {
+    static Route r;
+    int idx = s * stationCount + t;
+
+    if (s == t || rt_start[idx] == RT_NONE || !route_table_walk(s, t, &r)) {
+        rt_dam[idx] = 0;
+        rt_hops[idx] = 0;
+        rt_changes[idx] = 0;
+        rt_fare[idx] = 0;
+        return;
+    }
+    rt_dam[idx] = (unsigned short)(r.km * 100.0 + 0.5);
+    rt_hops[idx] = (unsigned short)(r.len - 1);
+    rt_changes[idx] = (unsigned char)r.interchanges;
+    rt_fare[idx] = (unsigned char)fare_slab(r.km);
+}
+
+/*
+    route_table_column(sc, t)
+
+    Fills everything the table holds for destination t (its rt_next
+    row and every [s * n + t] entry) from one full search in sc.
+    Network edits call it for just the columns they change.
+*/
+void route_table_column(SearchScratch *sc, int t) {
+    int n = stationCount;
+    weighted_search(sc, t, -1);
+
+    unsigned short *next = rt_next + (size_t)t * nodeCount;
+    for (int x = 0; x < nodeCount; x++) {
+        next[x] = (sc->dist[x] < 0 || sc->parent[x] == -1)
+                  ? RT_NONE : (unsigned short)sc->parent[x];
+    }
+
+    for (int s = 0; s < n; s++) {
+        int best = best_node(sc, s);
+        rt_start[s * n + t] = best == -1 ? RT_NONE : (unsigned short)best;
+        rt_time[s * n + t] = best == -1 ? RT_NONE : (unsigned short)sc->dist[best];
+    }
+    // a station is always reachable from itself
+    rt_time[t * n + t] = 0;
+
+    for (int s = 0; s < n; s++)
+        route_table_summarize(s, t);
+}
+
+/*
+    build_route_table()
+
+    Runs one single-source search per station and fills the tables
+    above. Leaves route_table_ready = 0 (find_route() then falls back
+    to A*) if memory cannot be allocated.
+*/
+void build_route_table(void) {
+    int n = stationCount;
+    size_t pairs = (size_t)n * n;
+
+    free_route_table();
+    if (n == 0) return;
+    STATS_START(started);
+
+    rt_next = malloc((size_t)n * nodeCount * sizeof *rt_next);
+    rt_start = malloc(pairs * sizeof *rt_start);
+    rt_time = malloc(pairs * sizeof *rt_time);
+    rt_dam = malloc(pairs * sizeof *rt_dam);
+    rt_hops = malloc(pairs * sizeof *rt_hops);
+    rt_changes = malloc(pairs);
+    rt_fare = malloc(pairs);
+    if (!rt_next || !rt_start || !rt_time || !rt_dam || !rt_hops || !rt_changes || !rt_fare) {
+        free_route_table();
+        return;
+    }
+
+    SearchScratch *sc = &route_scratch;
+    for (int t = 0; t < n; t++)
+        route_table_column(sc, t);
+
+    route_table_ready = 1;
+    route_table_version = network_version;
+    STATS_STOP(build, started);
+}
+
+// 1 when the table matches the current network (building it on demand)
+int route_table_usable(void) {
+    if (!route_table_enabled) return 0;
+    if (!route_table_ready || route_table_version != network_version)
+        build_route_table();
+    return route_table_ready;
+}
+
+// =============================================================
+// NETWORK FILES (SOURCE TEXT + BINARY IMAGE)
+// =============================================================
+/*
+    The built-in lines of build_network() can be replaced by a network
+    read at startup, in one of two forms.
+
+    Source text (stations.txt): stations in line order, grouped under
+    "line <name> [km]" directives. "[<km> km]" after a station gives
+    the measured length of the segment from the station before it;
+    segments without one share the rest of the line length evenly.
+    "[planned]" marks a station not yet open. "key = Display Name"
+    matches the station by key and shows the display name.
+
+        # comment
+        line purple 43.5
+        Challaghatta
+        Kengeri [1.9 km]
+        majestic = Nadaprabhu Kempegowda Stn., Majestic
+        Future Stop [planned]
+
+    Binary image (metro --compile stations.txt network.bin): the
+    finished search tables, so loading does no parsing or building.
+
+        header    : magic "NMRT", version, byte-order mark, counts
+        directory : {id, offset, size, reserved} per section
+        sections  : 8-byte aligned arrays in host byte order
+
+    Sections hold the string pool, station and line records, the CSR
+    and routing-graph arrays, landmark distances, the key hash and,
+    optionally, the all-pairs route table. The loader validates every
+    index once and then points the tables straight into the image, so
+    a memory-mapped file is used without copying.
+*/
+#define NET_IMAGE_MAGIC   0x54524D4Eu      // "NMRT" stored little-endian
+#define NET_IMAGE_VERSION 3u                // 3: route table fares are slab indices
+#define NET_IMAGE_BOM     0x01020304u      // reads back differently on a foreign byte order
+#define NET_IMAGE_ALIGN   8
+
+#define NET_SEC_STRINGS      1
+#define NET_SEC_STATIONS     2
+#define NET_SEC_LINES        3
+#define NET_SEC_ADJ_OFFSET   4
+#define NET_SEC_ADJ_NBR      5
+#define NET_SEC_ADJ_LINE     6
+#define NET_SEC_ADJ_KM       7
+#define NET_SEC_ADJ_SEC      8
+#define NET_SEC_NODE_OFFSET  9
+#define NET_SEC_NODE_STATION 10
+#define NET_SEC_NODE_LINE    11
+#define NET_SEC_ADJ_TO_NODE  12
+#define NET_SEC_LANDMARKS    13
+#define NET_SEC_KEY_HASH     14
+#define NET_SEC_RT_NEXT      15
+#define NET_SEC_RT_START     16
+#define NET_SEC_RT_TIME      17
+#define NET_SEC_RT_DAM       18
+#define NET_SEC_RT_HOPS      19
+#define NET_SEC_RT_CHANGES   20
+#define NET_SEC_RT_FARE      21
+#define NET_SEC_COUNT        22            // one past the last section ID
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t station_count;
+    uint32_t line_count;
+    uint32_t slot_count;        // CSR slots (two per segment)
+    uint32_t node_count;
+    uint32_t landmark_count;
+    uint32_t section_count;
+    uint32_t total_size;        // bytes, header included
+} NetImageHeader;
+
+typedef struct {
+    uint32_t id;
+    uint32_t offset;            // from the start of the image
+    uint32_t size;              // bytes
+    uint32_t reserved;
+} NetImageSection;
+
+typedef struct {
+    uint32_t display_off;       // into the string pool
+    uint32_t key_off;
+    uint32_t planned;
+    uint32_t line_mask;         // bit l = served by line ID l
+} NetImageStation;
+
+typedef struct {
+    uint32_t name_off;
+    uint32_t first;             // terminal station IDs
+    uint32_t last;
+    uint32_t reserved;
+} NetImageLine;
+
+// How the memory behind the current image was obtained
+#define IMAGE_BORROWED 0        // caller's buffer (e.g. the wasm heap)
+#define IMAGE_MALLOC   1
+#define IMAGE_MMAP     2
+
+unsigned char *network_image = NULL;
+size_t network_image_size = 0;
+int network_image_kind = IMAGE_BORROWED;
+
+char network_error[160] = "";   // why the last load / compile failed
+
+// Record a load error; always returns -1
+int network_fail(const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(network_error, sizeof network_error, fmt, ap);
+    va_end(ap);
+    return -1;
+}
+
+// Release a buffer returned by read_network_file()
+void free_network_buffer(unsigned char *buf, size_t size, int kind) {
+    if (!buf) return;
+#ifdef METRO_HAVE_MMAP
+    if (kind == IMAGE_MMAP) {
+        munmap(buf, size);
+        return;
+    }
+#else
+    (void)size;
+#endif
+    if (kind == IMAGE_MALLOC) free(buf);
+}
+
+// Drop the current image (and a route table living inside it)
+void release_network_image(void) {
+    if (!network_image) return;
+    if (!route_table_owned) free_route_table();
+    free_network_buffer(network_image, network_image_size, network_image_kind);
+    network_image = NULL;
+    network_image_size = 0;
+}
+
+/*
+    parse_network_source(text, len, apply)
+
+    Reads the source format above. With apply = 0 it only checks the
+    text; with apply = 1 it also adds each line to the network being
+    built. Returns the number of lines, or -1 (see network_error).
+*/
+int parse_network_source(const char *text, size_t len, int apply) {
+    static char names[MAX][80];
+    static const char *list[MAX];
+    static int planned[MAX];
+    static double seg_km[MAX];
+    char line_name[30] = "";
+    double line_km = 0.0;
+    int n = 0, lines = 0, lineno = 0, in_line = 0;
+    size_t pos = 0;
+
+    while (pos < len || in_line) {
+        char buf[160];
+        char *p = buf;
+        int at_end = pos >= len;
+        int directive = 0;
+
+        if (!at_end) {
+            size_t end = pos;
+            while (end < len && text[end] != '\n') end++;
+            lineno++;
+            if (end - pos >= sizeof buf)
+                return network_fail("line %d: too long", lineno);
+            memcpy(buf, text + pos, end - pos);
+            buf[end - pos] = '\0';
+            pos = end + 1;
+
+            // trim; skip blank and comment lines
+            while (*p && isspace((unsigned char)*p)) p++;
+            int e = (int)strlen(p) - 1;
+            while (e >= 0 && isspace((unsigned char)p[e])) p[e--] = '\0';
+            if (*p == '\0' || *p == '#') continue;
+            directive = strncmp(p, "line", 4) == 0 && isspace((unsigned char)p[4]);
+        }
+
+        // a directive or the end of text closes the open line
+        if ((directive || at_end) && in_line) {
+            if (n == 0)
+                return network_fail("line '%s' has no stations", line_name);
+            if (apply)
+                add_line_with_plan(line_name, list, n, planned, line_km, seg_km);
+            lines++;
+            in_line = 0;
+            n = 0;
+        }
+        if (at_end) break;
+
+        if (directive) {
+            char *q = p + 4;
+            while (*q && isspace((unsigned char)*q)) q++;
+            int nl = 0;
+            while (q[nl] && !isspace((unsigned char)q[nl])) nl++;
+            if (nl == 0 || nl >= (int)sizeof line_name)
+                return network_fail("line %d: bad line name", lineno);
+            memcpy(line_name, q, nl);
+            line_name[nl] = '\0';
+
+            char *rest = q + nl;
+            line_km = strtod(rest, &rest);
+            while (*rest && isspace((unsigned char)*rest)) rest++;
+            if (*rest || line_km < 0)
+                return network_fail("line %d: expected 'line <name> [km]'", lineno);
+            if (lines >= MAX_LINES)
+                return network_fail("line %d: more than %d lines", lineno, MAX_LINES);
+            in_line = 1;
+            continue;
+        }
+
+        if (!in_line)
+            return network_fail("line %d: station before any 'line' directive", lineno);
+        if (n >= MAX)
+            return network_fail("line '%s' has more than %d stations", line_name, MAX);
+
+        // trailing "[planned]" and "[<km> km]" tags, in either order
+        int is_planned = 0;
+        double km = 0.0;
+        size_t pl = strlen(p);
+        while (pl > 0 && p[pl - 1] == ']') {
+            char *open = strrchr(p, '[');
+            if (!open) break;
+            if (strcmp(open, "[planned]") == 0) {
+                is_planned = 1;
+            } else {
+                char *end;
+                km = strtod(open + 1, &end);
+                while (isspace((unsigned char)*end)) end++;
+                if (end == open + 1 || strcmp(end, "km]") != 0 || !(km > 0) || km > 100)
+                    return network_fail("line %d: expected '[<km> km]' or '[planned]'", lineno);
+                if (n == 0)
+                    return network_fail("line %d: first station of a line has no segment", lineno);
+            }
+            pl = (size_t)(open - p);
+            while (pl > 0 && isspace((unsigned char)p[pl - 1])) pl--;
+            p[pl] = '\0';
+        }
+        if (pl == 0 || pl >= sizeof names[0])
+            return network_fail("line %d: bad station name", lineno);
+        char *eq = strchr(p, '=');
+        if (eq && (eq == p || eq[1 + strspn(eq + 1, " \t")] == '\0'))
+            return network_fail("line %d: expected 'key = Display Name'", lineno);
+
+        strcpy(names[n], p);
+        list[n] = names[n];
+        planned[n] = is_planned;
+        seg_km[n] = km;
+        n++;
+    }
+
+    if (lines == 0)
+        return network_fail("no lines defined");
+    return lines;
+}
+
+/*
+    load_network_source(text, len)
+
+    Replaces the network with the one described by source text.
+    The current network is kept when the text does not parse.
+    Returns the station count, or -1.
+*/
+int load_network_source(const char *text, size_t len) {
+    if (parse_network_source(text, len, 0) < 0) return -1;
+    network_begin();
+    parse_network_source(text, len, 1);
+    network_finish(1);
+    network_origin = NETWORK_LOADED;
+    return stationCount;
+}
+
+/*
+    write_network_image(path, with_table)
+
+    Serializes the current network (and, with with_table = 1, the
+    all-pairs route table) as a binary image. Returns 0, or -1.
+*/
+int write_network_image(const char *path, int with_table) {
+    int n = stationCount;
+    struct { uint32_t id; const void *data; size_t size; } part[NET_SEC_COUNT];
+    int np = 0;
+
+    if (!network_ready || n == 0)
+        return network_fail("no network to write");
+    if (with_table && !(route_table_ready && route_table_version == network_version))
+        build_route_table();
+    if (with_table && !route_table_ready)
+        return network_fail("out of memory building the route table");
+
+    // string pool: the station name pool as-is, then the line names
+    size_t pool_size = (size_t)name_pool_used;
+    for (int l = 0; l < lineCount; l++)
+        pool_size += strlen(line_names[l]) + 1;
+
+    char *pool = malloc(pool_size);
+    NetImageStation *srec = malloc((size_t)n * sizeof *srec);
+    NetImageLine lrec[MAX_LINES];
+    if (!pool || !srec) {
+        free(pool);
+        free(srec);
+        return network_fail("out of memory");
+    }
+
+    size_t used = (size_t)name_pool_used;
+    memcpy(pool, name_pool, used);
+    for (int l = 0; l < lineCount; l++) {
+        lrec[l].name_off = (uint32_t)used;
+        lrec[l].first = (uint32_t)line_first[l];
+        lrec[l].last = (uint32_t)line_last[l];
+        lrec[l].reserved = 0;
+        strcpy(pool + used, line_names[l]);
+        used += strlen(line_names[l]) + 1;
+    }
+    for (int i = 0; i < n; i++) {
+        srec[i].display_off = (uint32_t)station_display_off[i];
+        srec[i].key_off = (uint32_t)station_key_off[i];
+        srec[i].planned = station_planned[i];
+        srec[i].line_mask = station_line_mask[i];
+    }
+
+    int slots = adj_offset[n];
+    size_t pairs = (size_t)n * n;
+#define NET_PART(sec, ptr, bytes) \
+    (part[np].id = (sec), part[np].data = (ptr), part[np].size = (bytes), np++)
+    NET_PART(NET_SEC_STRINGS, pool, used);
+    NET_PART(NET_SEC_STATIONS, srec, (size_t)n * sizeof *srec);
+    NET_PART(NET_SEC_LINES, lrec, (size_t)lineCount * sizeof lrec[0]);
+    NET_PART(NET_SEC_ADJ_OFFSET, adj_offset, (size_t)(n + 1) * sizeof(int));
+    NET_PART(NET_SEC_ADJ_NBR, adj_nbr, (size_t)slots * sizeof(int));
+    NET_PART(NET_SEC_ADJ_LINE, adj_line, (size_t)slots * sizeof(int));
+    NET_PART(NET_SEC_ADJ_KM, adj_km, (size_t)slots * sizeof(double));
+    NET_PART(NET_SEC_ADJ_SEC, adj_sec, (size_t)slots * sizeof(int));
+    NET_PART(NET_SEC_NODE_OFFSET, node_offset, (size_t)(n + 1) * sizeof(int));
+    NET_PART(NET_SEC_NODE_STATION, node_station, (size_t)nodeCount * sizeof(int));
+    NET_PART(NET_SEC_NODE_LINE, node_line, (size_t)nodeCount * sizeof(int));
+    NET_PART(NET_SEC_ADJ_TO_NODE, adj_to_node, (size_t)slots * sizeof(int));
+    NET_PART(NET_SEC_LANDMARKS, lm_dist, (size_t)n * MAX_LANDMARKS * sizeof(int));
+    NET_PART(NET_SEC_KEY_HASH, station_hash, STATION_HASH_SIZE * sizeof(int));
+    if (with_table) {
+        NET_PART(NET_SEC_RT_NEXT, rt_next, (size_t)n * nodeCount * sizeof *rt_next);
+        NET_PART(NET_SEC_RT_START, rt_start, pairs * sizeof *rt_start);
+        NET_PART(NET_SEC_RT_TIME, rt_time, pairs * sizeof *rt_time);
+        NET_PART(NET_SEC_RT_DAM, rt_dam, pairs * sizeof *rt_dam);
+        NET_PART(NET_SEC_RT_HOPS, rt_hops, pairs * sizeof *rt_hops);
+        NET_PART(NET_SEC_RT_CHANGES, rt_changes, pairs);
+        NET_PART(NET_SEC_RT_FARE, rt_fare, pairs);
+    }
+#undef NET_PART
+
+    // lay out: header, directory, then each section on an aligned offset
+    NetImageHeader h;
+    NetImageSection dir[NET_SEC_COUNT];
+    size_t total = sizeof h + (size_t)np * sizeof dir[0];
+    for (int i = 0; i < np; i++) {
+        total = (total + NET_IMAGE_ALIGN - 1) & ~(size_t)(NET_IMAGE_ALIGN - 1);
+        dir[i].id = part[i].id;
+        dir[i].offset = (uint32_t)total;
+        dir[i].size = (uint32_t)part[i].size;
+        dir[i].reserved = 0;
+        total += part[i].size;
+    }
+
+    h.magic = NET_IMAGE_MAGIC;
+    h.version = NET_IMAGE_VERSION;
+    h.byte_order = NET_IMAGE_BOM;
+    h.station_count = (uint32_t)n;
+    h.line_count = (uint32_t)lineCount;
+    h.slot_count = (uint32_t)slots;
+    h.node_count = (uint32_t)nodeCount;
+    h.landmark_count = (uint32_t)landmark_count;
+    h.section_count = (uint32_t)np;
+    h.total_size = (uint32_t)total;
+
+    unsigned char *img = calloc(1, total);
+    if (!img) {
+        free(pool);
+        free(srec);
+        return network_fail("out of memory");
+    }
+    memcpy(img, &h, sizeof h);
+    memcpy(img + sizeof h, dir, (size_t)np * sizeof dir[0]);
+    for (int i = 0; i < np; i++)
+        memcpy(img + dir[i].offset, part[i].data, part[i].size);
+    free(pool);
+    free(srec);
+
+    FILE *f = fopen(path, "wb");
+    int ok = f && fwrite(img, 1, total, f) == total;
+    if (f && fclose(f) != 0) ok = 0;
+    free(img);
+    if (!ok) return network_fail("cannot write %s", path);
+    return 0;
+}
+
+// 1 when every entry of a[0..count) is in [lo, hi)
+int image_range_ok(const int *a, int count, int lo, int hi) {
+    for (int i = 0; i < count; i++)
+        if (a[i] < lo || a[i] >= hi) return 0;
+    return 1;
+}
+
+// 1 when every table entry is RT_NONE or below hi
+int image_u16_ok(const unsigned short *a, size_t count, int hi) {
+    for (size_t i = 0; i < count; i++)
+        if (a[i] != RT_NONE && a[i] >= hi) return 0;
+    return 1;
+}
+
+// 1 when every byte of a[0..count) is below hi
+int image_u8_ok(const unsigned char *a, size_t count, int hi) {
+    for (size_t i = 0; i < count; i++)
+        if (a[i] >= hi) return 0;
+    return 1;
+}
+
+/*
+    image_route_table_ok(next, start, n, nodes, adj_offset, adj_nbr, adj_line,
+                         node_station, node_line)
+
+    Checks that route_table_walk() can trust the table: every rt_start
+    entry is a node of its source station, every rt_next hop is a line
+    change at the same station or a ride along a CSR slot of the node's
+    own line to the same line's node at the neighbour, and every
+    chain of a destination column ends at RT_NONE (no cycles). One pass
+    per column: state[] marks nodes whose chain is known to end.
+*/
+int image_route_table_ok(const unsigned short *next, const unsigned short *start,
+                         int n, int nodes, const int *adj_offset, const int *adj_nbr,
+                         const int *adj_line, const int *node_station, const int *node_line) {
+    int state[MAX_NODES];       // 2t+1 = on the chain being followed, 2t+2 = ends
+
+    for (size_t i = 0; i < (size_t)n * n; i++) {
+        if (start[i] != RT_NONE && node_station[start[i]] != (int)(i / (size_t)n)) return 0;
+    }
+    for (int x = 0; x < nodes; x++) state[x] = 0;
+
+    for (int t = 0; t < n; t++) {
+        const unsigned short *col = next + (size_t)t * nodes;
+        int visiting = 2 * t + 1, ends = 2 * t + 2;
+
+        for (int x0 = 0; x0 < nodes; x0++) {
+            int x = x0;
+            while (state[x] != ends) {
+                if (state[x] == visiting) return 0;         // cycle
+                state[x] = visiting;
+                int y = col[x];
+                if (y == RT_NONE) break;
+                int u = node_station[x], v = node_station[y];
+                if (y == x) return 0;
+                if (u != v) {
+                    int ln = node_line[x];
+                    int k = adj_offset[u];
+                    while (k < adj_offset[u + 1] && (adj_nbr[k] != v || adj_line[k] != ln)) k++;
+                    if (k == adj_offset[u + 1] || node_line[y] != ln)
+                        return 0;                           // not a segment of this line
+                }
+                x = y;
+            }
+            // everything on this chain ends now
+            for (x = x0; state[x] == visiting; x = col[x]) {
+                state[x] = ends;
+                if (col[x] == RT_NONE) break;
+            }
+        }
+    }
+    return 1;
+}
+
+// 1 when off[0..n] is a valid offset array ending at total
+int image_offsets_ok(const int *off, int n, int total) {
+    if (off[0] != 0 || off[n] != total) return 0;
+    for (int i = 0; i < n; i++)
+        if (off[i] > off[i + 1]) return 0;
+    return 1;
+}
+
+/*
+    load_network_image_mem(data, size, kind)
+
+    Validates a binary image and makes it the current network. On
+    success the image owns data (released according to kind when
+    the network is next replaced); on failure the caller keeps it
+    and the current network is untouched. Returns the station
+    count, or -1 (see network_error).
+*/
+int load_network_image_mem(unsigned char *data, size_t size, int kind) {
+    NetImageHeader h;
+    unsigned char *sec[NET_SEC_COUNT] = { 0 };
+    size_t sec_size[NET_SEC_COUNT] = { 0 };
+    STATS_START(started);
+
+    if (sizeof(int) != 4 || sizeof(double) != 8)
+        return network_fail("images need 32-bit int and 64-bit double");
+    if (((uintptr_t)data & (NET_IMAGE_ALIGN - 1)) != 0)
+        return network_fail("image buffer is not %d-byte aligned", NET_IMAGE_ALIGN);
+    if (size < sizeof h)
+        return network_fail("file too small for a network image");
+    memcpy(&h, data, sizeof h);
+    if (h.magic != NET_IMAGE_MAGIC)
+        return network_fail("not a network image");
+    if (h.byte_order != NET_IMAGE_BOM)
+        return network_fail("image was written on a machine with another byte order");
+    if (h.version != NET_IMAGE_VERSION)
+        return network_fail("unsupported image version %u", h.version);
+    if (h.total_size != size)
+        return network_fail("image is %lu bytes, header says %u",
+                            (unsigned long)size, h.total_size);
+    if (h.station_count == 0 || h.station_count > MAX || h.line_count > MAX_LINES ||
+        h.slot_count > 2 * MAX_EDGES || h.node_count > MAX_NODES ||
+        h.landmark_count > MAX_LANDMARKS)
+        return network_fail("image exceeds the limits this build was compiled with");
+    if (h.section_count > (size - sizeof h) / sizeof(NetImageSection))
+        return network_fail("section directory runs past the end of the image");
+
+    for (uint32_t i = 0; i < h.section_count; i++) {
+        NetImageSection e;
+        memcpy(&e, data + sizeof h + i * sizeof e, sizeof e);
+        if (e.offset % NET_IMAGE_ALIGN != 0 || e.offset > size || e.size > size - e.offset)
+            return network_fail("section %u is out of bounds", e.id);
+        if (e.id == 0 || e.id >= NET_SEC_COUNT) continue;   // from a newer writer
+        if (sec[e.id])
+            return network_fail("duplicate section %u", e.id);
+        sec[e.id] = data + e.offset;
+        sec_size[e.id] = e.size;
+    }
+
+    int n = (int)h.station_count, nl = (int)h.line_count;
+    int slots = (int)h.slot_count, nodes = (int)h.node_count;
+    int marks = (int)h.landmark_count;
+    size_t pairs = (size_t)n * n;
+    struct { int id; size_t size; } want[] = {
+        { NET_SEC_STATIONS, (size_t)n * sizeof(NetImageStation) },
+        { NET_SEC_LINES, (size_t)nl * sizeof(NetImageLine) },
+        { NET_SEC_ADJ_OFFSET, (size_t)(n + 1) * 4 },
+        { NET_SEC_ADJ_NBR, (size_t)slots * 4 },
+        { NET_SEC_ADJ_LINE, (size_t)slots * 4 },
+        { NET_SEC_ADJ_KM, (size_t)slots * 8 },
+        { NET_SEC_ADJ_SEC, (size_t)slots * 4 },
+        { NET_SEC_NODE_OFFSET, (size_t)(n + 1) * 4 },
+        { NET_SEC_NODE_STATION, (size_t)nodes * 4 },
+        { NET_SEC_NODE_LINE, (size_t)nodes * 4 },
+        { NET_SEC_ADJ_TO_NODE, (size_t)slots * 4 },
+        { NET_SEC_LANDMARKS, (size_t)n * MAX_LANDMARKS * 4 },
+        { NET_SEC_KEY_HASH, STATION_HASH_SIZE * 4 },
+    };
+    for (size_t i = 0; i < sizeof want / sizeof want[0]; i++) {
+        if (!sec[want[i].id] || sec_size[want[i].id] != want[i].size)
+            return network_fail("section %d is missing or has the wrong size", want[i].id);
+    }
+    if (sec_size[NET_SEC_STRINGS] == 0 || sec[NET_SEC_STRINGS][sec_size[NET_SEC_STRINGS] - 1] != '\0')
+        return network_fail("string pool is missing or unterminated");
+
+    // the route table is optional, but all or nothing
+    int has_table = sec[NET_SEC_RT_NEXT] != NULL;
+    struct { int id; size_t size; } want_rt[] = {
+        { NET_SEC_RT_NEXT, (size_t)n * nodes * 2 },
+        { NET_SEC_RT_START, pairs * 2 },
+        { NET_SEC_RT_TIME, pairs * 2 },
+        { NET_SEC_RT_DAM, pairs * 2 },
+        { NET_SEC_RT_HOPS, pairs * 2 },
+        { NET_SEC_RT_CHANGES, pairs },
+        { NET_SEC_RT_FARE, pairs },
+    };
+    for (size_t i = 0; i < sizeof want_rt / sizeof want_rt[0]; i++) {
+        int present = sec[want_rt[i].id] != NULL;
+        if (present != has_table || (present && sec_size[want_rt[i].id] != want_rt[i].size))
+            return network_fail("route table section %d is incomplete", want_rt[i].id);
+    }
+
+    // every index a search will follow must stay inside its array
+    const char *pool = (const char *)sec[NET_SEC_STRINGS];
+    size_t pool_size = sec_size[NET_SEC_STRINGS];
+    const NetImageStation *srec = (const NetImageStation *)sec[NET_SEC_STATIONS];
+    const NetImageLine *lrec = (const NetImageLine *)sec[NET_SEC_LINES];
+    int *i_adj_offset = (int *)sec[NET_SEC_ADJ_OFFSET];
+    int *i_node_offset = (int *)sec[NET_SEC_NODE_OFFSET];
+    int *i_hash = (int *)sec[NET_SEC_KEY_HASH];
+
+    if (pool_size > NAME_POOL_SIZE)
+        return network_fail("string pool exceeds %d bytes", NAME_POOL_SIZE);
+    for (int i = 0; i < n; i++) {
+        if (srec[i].display_off >= pool_size || srec[i].key_off >= pool_size ||
+            (srec[i].line_mask >> nl) != 0)
+            return network_fail("station record %d is invalid", i);
+    }
+    for (int l = 0; l < nl; l++) {
+        if (lrec[l].name_off >= pool_size || lrec[l].first >= (uint32_t)n ||
+            lrec[l].last >= (uint32_t)n)
+            return network_fail("line record %d is invalid", l);
+    }
+    int used_slots = 0;
+    for (int i = 0; i < STATION_HASH_SIZE; i++) {
+        if (i_hash[i] == -1) continue;
+        if (i_hash[i] < 0 || i_hash[i] >= n) return network_fail("key hash is invalid");
+        used_slots++;
+    }
+    if (!image_offsets_ok(i_adj_offset, n, slots) ||
+        !image_range_ok((int *)sec[NET_SEC_ADJ_NBR], slots, 0, n) ||
+        !image_range_ok((int *)sec[NET_SEC_ADJ_LINE], slots, 0, nl) ||
+        !image_range_ok((int *)sec[NET_SEC_ADJ_SEC], slots, 0, 1 << 30) ||
+        !image_range_ok((int *)sec[NET_SEC_ADJ_TO_NODE], slots, 0, nodes) ||
+        !image_offsets_ok(i_node_offset, n, nodes) ||
+        !image_range_ok((int *)sec[NET_SEC_NODE_STATION], nodes, 0, n) ||
+        !image_range_ok((int *)sec[NET_SEC_NODE_LINE], nodes, 0, nl) ||
+        !image_range_ok((int *)sec[NET_SEC_LANDMARKS], n * MAX_LANDMARKS, 0, 1 << 30) ||
+        used_slots > n)
+        return network_fail("graph tables are inconsistent");
+    if (has_table &&
+        (!image_u16_ok((unsigned short *)sec[NET_SEC_RT_NEXT], (size_t)n * nodes, nodes) ||
+         !image_u16_ok((unsigned short *)sec[NET_SEC_RT_START], pairs, nodes) ||
+         !image_u8_ok(sec[NET_SEC_RT_FARE], pairs, FARE_SLABS) ||
+         !image_route_table_ok((unsigned short *)sec[NET_SEC_RT_NEXT],
+                               (unsigned short *)sec[NET_SEC_RT_START], n, nodes, i_adj_offset,
+                               (int *)sec[NET_SEC_ADJ_NBR], (int *)sec[NET_SEC_ADJ_LINE],
+                               (int *)sec[NET_SEC_NODE_STATION], (int *)sec[NET_SEC_NODE_LINE])))
+        return network_fail("route table is inconsistent");
+
+    // commit: names and station records are copied, tables are used in place
+    free_route_table();
+    release_network_image();
+    closures_reset();
+
+    lineCount = nl;
+    for (int l = 0; l < nl; l++) {
+        strncpy(line_names[l], pool + lrec[l].name_off, 29);
+        line_names[l][29] = '\0';
+        line_first[l] = (int)lrec[l].first;
+        line_last[l] = (int)lrec[l].last;
+    }
+    name_pool = name_pool_store;
+    memcpy(name_pool, pool, pool_size);
+    name_pool_used = (int)pool_size;
+    stationCount = n;
+    for (int i = 0; i < n; i++) {
+        station_key_off[i] = (int)srec[i].key_off;
+        station_display_off[i] = pool[srec[i].display_off] ? (int)srec[i].display_off : 0;
+        station_planned[i] = srec[i].planned ? 1 : 0;
+        station_line_mask[i] = (unsigned short)srec[i].line_mask;
+    }
+
+    edgeCount = 0;      // segments live only in the CSR arrays
+    nodeCount = nodes;
+    landmark_count = marks;
+    adj_offset = i_adj_offset;
+    adj_nbr = (int *)sec[NET_SEC_ADJ_NBR];
+    adj_line = (int *)sec[NET_SEC_ADJ_LINE];
+    adj_km = (double *)sec[NET_SEC_ADJ_KM];
+    adj_sec = (int *)sec[NET_SEC_ADJ_SEC];
+    node_offset = i_node_offset;
+    node_station = (int *)sec[NET_SEC_NODE_STATION];
+    node_line = (int *)sec[NET_SEC_NODE_LINE];
+    adj_to_node = (int *)sec[NET_SEC_ADJ_TO_NODE];
+    lm_dist = (int *)sec[NET_SEC_LANDMARKS];
+    station_hash = i_hash;
+
+    network_image = data;
+    network_image_size = size;
+    network_image_kind = kind;
+    network_ready = 1;
+    network_planned = 1;
+    network_origin = NETWORK_LOADED;
+    network_version++;
+    network_build++;
+    build_display_index();
+
+    if (has_table) {
+        rt_next = (unsigned short *)sec[NET_SEC_RT_NEXT];
+        rt_start = (unsigned short *)sec[NET_SEC_RT_START];
+        rt_time = (unsigned short *)sec[NET_SEC_RT_TIME];
+        rt_dam = (unsigned short *)sec[NET_SEC_RT_DAM];
+        rt_hops = (unsigned short *)sec[NET_SEC_RT_HOPS];
+        rt_changes = sec[NET_SEC_RT_CHANGES];
+        rt_fare = sec[NET_SEC_RT_FARE];
+        route_table_owned = 0;
+        route_table_ready = 1;
+        route_table_version = network_version;
+    }
+    STATS_STOP(build, started);
+    return n;
+}
+
+/*
+    read_network_file(path, &size, &kind)
+
+    Maps the whole file into memory (POSIX), or reads it into a
+    malloc'ed buffer elsewhere. Returns NULL on failure.
+*/
+unsigned char *read_network_file(const char *path, size_t *size, int *kind) {
+#ifdef METRO_HAVE_MMAP
+    int fd = open(path, O_RDONLY);
+    if (fd >= 0) {
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            // private + writable: the copy-on-write pages never touch the file
+            void *m = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+            if (m != MAP_FAILED) {
+                close(fd);
+                *size = (size_t)st.st_size;
+                *kind = IMAGE_MMAP;
+                return m;
+            }
+        }
+        close(fd);
+    }
+#endif
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+
+    size_t cap = 4096, len = 0;
+    unsigned char *buf = malloc(cap);
+    while (buf) {
+        len += fread(buf + len, 1, cap - len, f);
+        if (len < cap) break;
+        unsigned char *grown = realloc(buf, cap * 2);
+        if (!grown) {
+            free(buf);
+            buf = NULL;
+            break;
+        }
+        buf = grown;
+        cap *= 2;
+    }
+    fclose(f);
+    *size = len;
+    *kind = IMAGE_MALLOC;
+    return buf;
+}
+
+/*
+    load_network_file(path)
+
+    Loads a binary image (recognized by its magic) or a source text
+    file. Returns the station count, or -1 (see network_error).
+*/
+int load_network_file(const char *path) {
+    size_t size = 0;
+    int kind = IMAGE_MALLOC;
+    unsigned char *buf = read_network_file(path, &size, &kind);
+    if (!buf) return network_fail("cannot read %s", path);
+
+    uint32_t magic = 0;
+    if (size >= sizeof magic) memcpy(&magic, buf, sizeof magic);
+
+    int result;
+    if (magic == NET_IMAGE_MAGIC) {
+        result = load_network_image_mem(buf, size, kind);
+        if (result < 0) free_network_buffer(buf, size, kind);
+    } else {
+        result = load_network_source((const char *)buf, size);
+        free_network_buffer(buf, size, kind);
+    }
+    return result;
+}
+
+// =============================================================
+// BIDIRECTIONAL SEARCH
+// =============================================================
+/*
+    Point-to-point search strategies (used when the route table is off):
+
+      ROUTE_STRATEGY_DIJKSTRA : plain forward Dijkstra
+      ROUTE_STRATEGY_ASTAR    : forward A* with the landmark bound (default)
+      ROUTE_STRATEGY_BIDIR    : Dijkstra from both ends, meeting in the middle
+
+    Every strategy leaves its result in the forward scratch's
+    dist/parent/via arrays, so route_from_search() works the same way.
+    sc->expanded counts the nodes settled (both directions for BIDIR);
+    last_search_expanded keeps the count from the last find_route().
+*/
+#define ROUTE_STRATEGY_DIJKSTRA 0
+#define ROUTE_STRATEGY_ASTAR    1
+#define ROUTE_STRATEGY_BIDIR    2
+
+int route_strategy = ROUTE_STRATEGY_ASTAR;
+int last_search_expanded = 0;
+SearchScratch route_scratch_back;
+
+// Settle one node of a bidirectional search and relax its edges
+void bidir_settle(SearchScratch *me, const SearchScratch *other, int *best, int *meet) {
+    int x = heap_pop(&me->heap);
+    int u = node_station[x];
+    me->done[x] = 1;
+    me->expanded++;
+    STATS_ADD(nodes_expanded, 1);
+
+    for (int k = adj_offset[u]; k < adj_offset[u + 1]; k++) {
+        if (adj_line[k] != node_line[x]) continue;
+        if (closed_slot_count && bit_test(closed_slot, k)) continue;
+        int y = adj_to_node[k];
+        int nd = me->dist[x] + adj_sec[k];
+        if (me->done[y] || (me->dist[y] != -1 && nd >= me->dist[y])) continue;
+        me->dist[y] = nd;
+        me->parent[y] = x;
+        me->via[y] = k;
+        heap_push(&me->heap, y, nd);
+        if (other->dist[y] != -1 && nd + other->dist[y] < *best) {
+            *best = nd + other->dist[y];
+            *meet = y;
+        }
+    }
+
+    if (station_closed(u)) return;
+    for (int y = node_offset[u]; y < node_offset[u + 1]; y++) {
+        if (y == x) continue;
+        int nd = me->dist[x] + INTERCHANGE_SEC;
+        if (me->done[y] || (me->dist[y] != -1 && nd >= me->dist[y])) continue;
+        me->dist[y] = nd;
+        me->parent[y] = x;
+        me->via[y] = -1;
+        heap_push(&me->heap, y, nd);
+        if (other->dist[y] != -1 && nd + other->dist[y] < *best) {
+            *best = nd + other->dist[y];
+            *meet = y;
+        }
+    }
+}
+
+/*
+    bidirectional_search(fwd, back, src, dest)
+
+    Grows one tree from src (fwd) and one from dest (back) - the graph
+    is undirected, so the backward tree uses the same edges - always
+    expanding the side with the cheaper frontier. It stops once the two
+    frontier minima add up to at least the best meeting cost found.
+
+    The backward half of the winning path is then spliced into fwd's
+    parent/via arrays. Returns the dest node to pass to
+    route_from_search(fwd, ...), or -1 if unreachable.
+*/
+int bidirectional_search(SearchScratch *fwd, SearchScratch *back, int src, int dest) {
+    SearchScratch *side[2] = { fwd, back };
+    int ends[2] = { src, dest };
+
+    for (int d = 0; d < 2; d++) {
+        SearchScratch *sc = side[d];
+        fill_int(sc->dist, nodeCount, -1);
+        memset(sc->done, 0, sizeof sc->done);
+        heap_reset(&sc->heap, nodeCount);
+        sc->expanded = 0;
+        for (int x = node_offset[ends[d]]; x < node_offset[ends[d] + 1]; x++) {
+            sc->dist[x] = 0;
+            sc->parent[x] = -1;
+            sc->via[x] = -1;
+            heap_push(&sc->heap, x, 0);
+        }
+    }
+
+    int best = 0x7FFFFFFF, meet = -1;
+    if (station_closed(src) || station_closed(dest)) return -1;
+
+    while (fwd->heap.size > 0 && back->heap.size > 0) {
+        if (fwd->heap.key[0] + back->heap.key[0] >= best) break;
+        if (fwd->heap.key[0] <= back->heap.key[0])
+            bidir_settle(fwd, back, &best, &meet);
+        else
+            bidir_settle(back, fwd, &best, &meet);
+    }
+
+    fwd->expanded += back->expanded;
+    if (meet < 0) return -1;
+
+    // splice: walk the backward tree from the meeting node to dest
+    int x = meet;
+    while (back->parent[x] != -1) {
+        int y = back->parent[x];
+        fwd->parent[y] = x;
+        fwd->via[y] = back->via[x] == -1 ? -1
+                      : find_edge_slot_on_line(node_station[x], node_station[y], node_line[x]);
+        fwd->dist[y] = fwd->dist[meet] + back->dist[meet] - back->dist[y];
+        x = y;
+    }
+    return x;
+}
+
+/*
+    search_between(sc, back, src, dest)
+
+    Runs route_strategy from src to dest. back is the second scratch
+    for BIDIR; if NULL one is allocated for the call. Returns the dest
+    node for route_from_search(sc, ...), or -1.
+*/
+int search_between(SearchScratch *sc, SearchScratch *back, int src, int dest) {
+    if (route_strategy == ROUTE_STRATEGY_BIDIR) {
+        SearchScratch *tmp = back ? back : malloc(sizeof *tmp);
+        if (!tmp) return weighted_search(sc, src, dest);
+        int target = bidirectional_search(sc, tmp, src, dest);
+        if (!back) free(tmp);
+        return target;
+    }
+    if (route_strategy == ROUTE_STRATEGY_DIJKSTRA) {
+        SearchMask plain = { NULL, NULL, -1, 1 };
+        return weighted_search_from(sc, src, -1, dest, &plain);
+    }
+    return weighted_search(sc, src, dest);
+}
+
+// find_route_r() with an optional second scratch for BIDIR
+int find_route_with(int src, int dest, Route *r, SearchScratch *sc, SearchScratch *back) {
+    int found = 1;
+    STATS_START(started);
+
+    if (station_closed(src) || station_closed(dest)) {
+        found = 0;
+    } else if (src == dest) {
+        route_from_search(sc, src, -1, r);
+    } else if (route_table_enabled && route_table_ready &&
+               route_table_version == network_version) {
+        found = route_table_walk(src, dest, r);
+    } else {
+        int target = search_between(sc, back, src, dest);
+        if (target >= 0) route_from_search(sc, src, target, r);
+        else found = 0;
+    }
+
+    STATS_STOP(search, started);
+    return found;
+}
+
+/*
+    find_route_r(src, dest, r, sc)
+
+    find_route() with caller-owned search scratch. Once init_network()
+    has built the network (and the route table, if enabled) this only
+    reads shared state, so any number of callers can run it at once.
+*/
+int find_route_r(int src, int dest, Route *r, SearchScratch *sc) {
+    return find_route_with(src, dest, r, sc, NULL);
+}
+
+/*
+    find_route(src, dest, r)
+
+    Fastest route between two stations (running time plus interchange
+    penalties). Answered from the all-pairs table when it is enabled,
+    otherwise by a search using route_strategy. Returns 1 if found,
+    0 otherwise.
+*/
+int find_route(int src, int dest, Route *r) {
+    route_table_usable();
+    route_scratch.expanded = 0;
+    int found = find_route_with(src, dest, r, &route_scratch, &route_scratch_back);
+    last_search_expanded = route_scratch.expanded;
+    return found;
+}
+
+// =============================================================
+// ROUTE HELPERS
+// =============================================================
+
+// Compare two paths (arrays of indices)
+int route_equals(int a[], int lena, int b[], int lenb) {
+    if (lena != lenb) return 0;
+    for (int i = 0; i < lena; i++) {
+        if (a[i] != b[i]) return 0;
+    }
+    return 1;
+}
+
+/*
+    build_edge_lines(path, len, edgeLines)
+
+    For each consecutive pair in the path, find the line that
+    connects them (the lowest line ID both stations share).
+*/
+void build_edge_lines(int path[], int len, char edgeLines[][30]) {
+    for (int i = 0; i < len - 1; i++) {
+        unsigned common = station_line_mask[path[i]] & station_line_mask[path[i + 1]];
+        int l = 0;
+
+        if (!common) {
+            strcpy(edgeLines[i], "unknown");
+            continue;
+        }
+        while (!(common & (1u << l))) l++;
+        strcpy(edgeLines[i], line_names[l]);
+    }
+}
+
+// =============================================================
+// UI HELPERS (COLORS, EMOJIS)
+// =============================================================
+
+const char* line_color(const char *line) {
+    if (strcmp(line, "purple") == 0) return CLR_PURPLE;
+    if (strcmp(line, "green")  == 0) return CLR_GREEN;
+    if (strcmp(line, "pink")   == 0) return CLR_PINK;
+    return CLR_CYAN;
+}
+
+const char* line_emoji(const char *line) {
+    if (strcmp(line, "purple") == 0) return "🟣";
+    if (strcmp(line, "green")  == 0) return "🟢";
+    if (strcmp(line, "pink")   == 0) return "🌸";
+    return "◼️";
+}
+
+int timetable_eta(int src, int dest, int clock, int *board, int *arrive);
+void print_journey_options(int src, int dest, int clock);
+
+int cli_depart = -1;            // --depart, seconds after midnight; -1 = now
+
+// Time of day as "%I:%M %p" prints it (sec may run past midnight)
+void format_clock(char *buf, size_t size, int sec) {
+    int h = sec / 3600 % 24, m = sec / 60 % 60;
+    snprintf(buf, size, "%02d:%02d %s", h % 12 ? h % 12 : 12, m, h < 12 ? "AM" : "PM");
+}
+
+// Minutes from clock a to clock b as format_clock() shows them (whole minutes, mod a day)
+int clock_minutes_between(int a, int b) {
+    return ((b / 60 - a / 60) % 1440 + 1440) % 1440;
+}
+
+/*
+    print_final_output_professional()
+
+    CLI-only: pretty colored summary. The ETA comes from the
+    timetable: the next train from the origin, then the earliest
+    arrival (which may take another path than the one shown).
+*/
+void print_final_output_professional(const Route *r) {
+    const int *path = r->path;
+    int len = r->len;
+
+    // Top header
+    printf("\n%s%s%s\n", CLR_BOLD CLR_CYAN,
+           "════════════════════════════════════════════════════════════════════",
+           CLR_RESET);
+    printf("%s%*s%s\n", CLR_BOLD, 18, "", "NAMMA METRO — ROUTE SUMMARY");
+    printf("%s%s%s\n\n", CLR_BOLD CLR_CYAN,
+           "════════════════════════════════════════════════════════════════════",
+           CLR_RESET);
+
+    // Route line
+    printf("%s%-12s%s", CLR_BOLD, "Route:", CLR_RESET);
+    for (int i = 0; i < len; i++) {
+        printf("%s", station_name(path[i]));
+        if (i < len - 1) {
+            printf(" %s→%s ", CLR_DIM, CLR_RESET);
+        }
+    }
+    printf("\n\n");
+
+    // Segment table
+    printf("%s%-6s | %-20s | %-20s | %-10s%s\n",
+           CLR_BOLD, "Line", "Start", "End", "Segment", CLR_RESET);
+    printf("%s----------------------------------------------------------------------%s\n",
+           CLR_DIM, CLR_RESET);
+
+    int i = 0;
+    while (i < len - 1) {
+        int s = i;
+        int e = i;
+
+        // group consecutive edges on same line
+        while (e + 1 < len - 1 && route_line(r, e + 1) == route_line(r, s)) {
+            e++;
+        }
+
+        const char *curr = line_names[route_line(r, s)];
+        const char *emoji = line_emoji(curr);
+        const char *color = line_color(curr);
+        int seg_stops = e - s + 1;
+
+        printf("%s%-2s %-3s%s | %-20s | %-20s | %4d stops\n",
+               color, emoji, curr, CLR_RESET,
+               station_name(path[s]), station_name(path[e + 1]), seg_stops);
+
+        i = e + 1;
+    }
+
+    // Interchanges (stations where the route changes line)
+    printf("\n%sInterchanges:%s\n", CLR_BOLD, CLR_RESET);
+    for (int k = 1; k < len - 1; k++) {
+        if (route_line(r, k) != route_line(r, k - 1)) {
+            printf(" - %s (%s -> %s)\n", station_name(path[k]),
+                   line_names[route_line(r, k - 1)], line_names[route_line(r, k)]);
+        }
+    }
+    if (r->interchanges == 0) {
+        printf(" None\n");
+    }
+
+    // Per-stop breakdown
+    printf("\n%sPer-stop breakdown:%s\n", CLR_BOLD, CLR_RESET);
+    printf("%-28s -> %-28s | %-6s | %-6s | %-6s\n",
+           "From", "To", "Dist", "Time", "Fare");
+    printf("---------------------------------------------------------------------------------\n");
+
+    int edges = len - 1;
+
+    for (int k = 0; k < edges; k++) {
+        double dist = adj_km[r->edge_slot[k]];
+        int tmin = (adj_sec[r->edge_slot[k]] + 30) / 60;
+        int fare = fare_from_distance(dist);
+
+        printf("%-28s -> %-28s | %5.2f | %4d m | Rs%3d\n",
+               station_name(path[k]), station_name(path[k + 1]), dist, tmin, fare);
+    }
+
+    int extra_interchange_time = r->interchanges * INTERCHANGE_TIME_MIN;
+    int est_time = (r->time_sec + 30) / 60;
+    int est_fare = fare_from_distance(r->km);
+
+    printf("\n%sTrip summary:%s\n", CLR_BOLD, CLR_RESET);
+    printf(" - Stops travelled : %d\n", edges);
+    printf(" - Distance        : %.2f km\n", r->km);
+    printf(" - Travel time     : %d min (incl. %d min interchange buffer)\n",
+           est_time, extra_interchange_time);
+    printf(" - Fare estimate   : Rs %d\n", est_fare);
+
+    // current time & timetable ETA
+    time_t now = time(NULL);
+    struct tm *tnow = localtime(&now);
+    int clock = cli_depart >= 0 ? cli_depart
+                                : tnow->tm_hour * 3600 + tnow->tm_min * 60 + tnow->tm_sec;
+    char nowbuf[40];
+    char boardbuf[40];
+    char arrbuf[40];
+    int board = 0, arrive = 0;
+
+    format_clock(nowbuf, sizeof nowbuf, clock);
+    printf("\n - %-16s: %s\n", cli_depart >= 0 ? "Departing" : "Current time", nowbuf);
+
+    int status = timetable_eta(path[0], path[len - 1], clock, &board, &arrive);
+    if (status > 0) {
+        format_clock(boardbuf, sizeof boardbuf, board);
+        format_clock(arrbuf, sizeof arrbuf, arrive);
+        printf(" - Next train      : %s (%d min wait)\n", boardbuf, clock_minutes_between(clock, board));
+        printf(" - ETA             : %s\n", arrbuf);
+        print_journey_options(path[0], path[len - 1], clock);
+    } else if (status == 0) {
+        printf(" - ETA             : no more trains today (last train has left)\n");
+    } else {
+        format_clock(arrbuf, sizeof arrbuf, clock + r->time_sec);
+        printf(" - ETA             : %s (estimate, no timetable)\n", arrbuf);
+    }
+
+    printf("\n%s════════════════════════════════════════════════════════════════════%s\n\n",
+           CLR_CYAN, CLR_RESET);
+}
+
+// Simple ASCII preview of the route
+void print_ascii_map_preview(int path[], int len) {
+    printf("%sASCII Preview:%s\n\n", CLR_BOLD, CLR_RESET);
+    for (int i = 0; i < len; i++) {
+        printf("[ %s ]", station_name(path[i]));
+        if (i < len - 1) printf("==");
+    }
+    printf("\n\n");
+}
+
+// =============================================================
+// ALTERNATE ROUTES (YEN'S K-SHORTEST LOOPLESS PATHS)
+// =============================================================
+#define MAX_CANDIDATES 16           // Yen candidate pool size
+
+// Recompute km, line changes and total time from a route's edge slots
+void route_recost(Route *r) {
+    r->km = 0.0;
+    r->interchanges = 0;
+    r->time_sec = 0;
+    for (int i = 0; i < r->len - 1; i++) {
+        r->km += adj_km[r->edge_slot[i]];
+        r->time_sec += adj_sec[r->edge_slot[i]];
+        if (i > 0 && route_line(r, i) != route_line(r, i - 1)) {
+            r->interchanges++;
+            r->time_sec += INTERCHANGE_SEC;
+        }
+    }
+}
+
+// Cheap fingerprint of a station sequence, checked before route_equals()
+unsigned route_hash(const Route *r) {
+    unsigned h = 2166136261u;
+    for (int i = 0; i < r->len; i++) {
+        h ^= (unsigned)r->path[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/*
+    find_alternates(primary, k, alts)
+
+    Yen's algorithm on the weighted (station, line) graph, seeded with
+    the primary route. For each accepted route and each spur station
+    on it:
+      - the root (path prefix up to the spur) is reused as-is, along
+        with its cost;
+      - segments that accepted routes sharing this root take next are
+        blocked in a CSR-slot bitset, root stations in a station
+        bitset;
+      - one search starts on the line the root arrived on, bounded by
+        the worst candidate in a full pool.
+    Root + spur becomes a candidate; the cheapest candidate is
+    accepted next. Routes are compared by real cost, not hop count.
+
+    Writes up to k routes distinct from the primary (and each other)
+    to alts[], cheapest first. Returns how many were found.
+*/
+int find_alternates(const Route *primary, int k, Route alts[]) {
+    if (k <= 0 || primary->len < 2) return 0;
+    STATS_START(started);
+
+    Route *accepted = malloc((size_t)(k + 1) * sizeof *accepted);
+    Route *pool = malloc(MAX_CANDIDATES * sizeof *pool);
+    unsigned *accepted_hash = malloc((size_t)(k + 1) * sizeof *accepted_hash);
+    unsigned pool_hash[MAX_CANDIDATES];
+    Route *spur = malloc(sizeof *spur);
+    Route *cand = malloc(sizeof *cand);
+    SearchScratch *sc = malloc(sizeof *sc);
+    unsigned char blocked_slot[SLOT_BITSET_BYTES];
+    unsigned char blocked_station[STATION_BITSET_BYTES];
+    int naccepted = 0, npool = 0;
+    int dest = primary->path[primary->len - 1];
+
+    if (!accepted || !pool || !accepted_hash || !spur || !cand || !sc) {
+        free(accepted); free(pool); free(accepted_hash); free(spur); free(cand); free(sc);
+        return 0;
+    }
+
+    accepted[0] = *primary;
+    accepted_hash[0] = route_hash(primary);
+    naccepted = 1;
+
+    while (naccepted <= k) {
+        const Route *prev = &accepted[naccepted - 1];
+        int root_cost = 0;    // cost of prev up to (and arriving at) path[i]
+
+        for (int i = 0; i < prev->len - 1; i++) {
+            int spur_station = prev->path[i];
+
+            bitset_clear(blocked_slot, SLOT_BITSET_BYTES);
+            bitset_clear(blocked_station, STATION_BITSET_BYTES);
+
+            // block the next segment of every accepted route sharing this root
+            for (int a = 0; a < naccepted; a++) {
+                const Route *p = &accepted[a];
+                if (p->len <= i + 1) continue;
+                if (memcmp(p->path, prev->path, (size_t)(i + 1) * sizeof(int)) != 0) continue;
+                bit_set(blocked_slot, p->edge_slot[i]);
+            }
+            for (int j = 0; j < i; j++) {
+                bit_set(blocked_station, prev->path[j]);
+            }
+
+            SearchMask mask = { blocked_slot, blocked_station, -1, 0 };
+            if (npool == MAX_CANDIDATES) {
+                int worst = 0;
+                for (int c = 0; c < npool; c++)
+                    if (pool[c].time_sec > worst) worst = pool[c].time_sec;
+                mask.max_cost = worst - root_cost;
+            }
+
+            int start_node = i == 0 ? -1
+                                    : node_of(spur_station, route_line(prev, i - 1));
+            int target = weighted_search_from(sc, spur_station, start_node, dest, &mask);
+
+            if (target >= 0) {
+                route_from_search(sc, spur_station, target, spur);
+
+                // candidate = root prefix + spur path
+                if (i + spur->len <= MAX) {
+                    memcpy(cand->path, prev->path, (size_t)i * sizeof(int));
+                    memcpy(cand->edge_slot, prev->edge_slot, (size_t)i * sizeof(int));
+                    memcpy(cand->path + i, spur->path, (size_t)spur->len * sizeof(int));
+                    memcpy(cand->edge_slot + i, spur->edge_slot,
+                           (size_t)(spur->len - 1) * sizeof(int));
+                    cand->len = i + spur->len;
+                    route_recost(cand);
+
+                    unsigned h = route_hash(cand);
+                    int dup = 0;
+                    for (int a = 0; a < naccepted && !dup; a++)
+                        dup = accepted_hash[a] == h &&
+                              route_equals(accepted[a].path, accepted[a].len, cand->path, cand->len);
+                    for (int c = 0; c < npool && !dup; c++)
+                        dup = pool_hash[c] == h &&
+                              route_equals(pool[c].path, pool[c].len, cand->path, cand->len);
+
+                    if (!dup && npool < MAX_CANDIDATES) {
+                        pool[npool] = *cand;
+                        pool_hash[npool++] = h;
+                    } else if (!dup) {
+                        // pool full: replace the worst candidate if this one is cheaper
+                        int worst = 0;
+                        for (int c = 1; c < npool; c++)
+                            if (pool[c].time_sec > pool[worst].time_sec) worst = c;
+                        if (cand->time_sec < pool[worst].time_sec) {
+                            pool[worst] = *cand;
+                            pool_hash[worst] = h;
+                        }
+                    }
+                }
+            }
+
+            // extend the root by edge i for the next spur station
+            root_cost += adj_sec[prev->edge_slot[i]];
+            if (i > 0 && route_line(prev, i) != route_line(prev, i - 1))
+                root_cost += INTERCHANGE_SEC;
+        }
+
+        if (npool == 0) break;
+
+        // accept the cheapest candidate
+        int best = 0;
+        for (int c = 1; c < npool; c++)
+            if (pool[c].time_sec < pool[best].time_sec) best = c;
+        accepted[naccepted] = pool[best];
+        accepted_hash[naccepted] = pool_hash[best];
+        naccepted++;
+        pool[best] = pool[npool - 1];
+        pool_hash[best] = pool_hash[npool - 1];
+        npool--;
+    }
+
+    int found = naccepted - 1;
+    for (int a = 0; a < found; a++)
+        alts[a] = accepted[a + 1];
+
+    free(accepted); free(pool); free(accepted_hash); free(spur); free(cand); free(sc);
+    STATS_STOP(alternates, started);
+    return found;
+}
+
+// =============================================================
+// AUTOCOMPLETE FOR STATION NAMES
+// =============================================================
+/*
+    Index built lazily for each network_version:
+
+      token index : the key of every station plus each word (run of
+                    two or more letters and digits, lowercased) of its
+                    display name: the station keyed "mgroad"
+                    (normalize_inplace drops the dots of "m.g. road"
+                    and joins letters either side of a space) and
+                    shown as "Mahatma Gandhi Road" gives "mgroad",
+                    "mahatma", "gandhi" and "road". Sorted by text, so
+                    a binary search finds every key or word beginning
+                    with the prefix, and "road" matches Mahatma Gandhi
+                    Road and Mysuru Road.
+      trigram index : (trigram, station) postings for the same texts,
+                    sorted by trigram. Misspelled queries count shared
+                    trigrams per station; only stations that could be
+                    within AC_MAX_EDITS edits are checked with an edit
+                    distance against their key and words.
+
+    Results are ranked: key prefix, then word prefix, then fuzzy (by
+    edit distance); ties go to the shorter name, then the lower ID.
+*/
+#define AC_MAX_ENTRIES (MAX * 8)
+#define AC_MAX_GRAMS   (MAX * 80)
+#define AC_MAX_EDITS   2
+#define AC_PRINT_LIMIT 20
+
+#define AC_TIER_KEY    0
+#define AC_TIER_WORD   1
+#define AC_TIER_FUZZY  2
+
+#define AC_POOL_SIZE   (MAX * 200)
+
+unsigned short ac_station[AC_MAX_ENTRIES];   // token index, sorted by text:
+int ac_text_off[AC_MAX_ENTRIES];             // station and its key / word in ac_pool
+unsigned char ac_is_word[AC_MAX_ENTRIES];
+int ac_count = 0;
+
+char ac_pool[AC_POOL_SIZE];                  // per station: key\0word\0word\0...
+int ac_station_off[MAX];                     // first text of each station
+int ac_station_texts[MAX];                   // key + number of words
+
+unsigned ac_gram[AC_MAX_GRAMS];              // trigram index, sorted by gram
+unsigned short ac_gram_station[AC_MAX_GRAMS];
+int ac_gram_count = 0;
+
+unsigned ac_version = 0;
+int ac_ready = 0;
+
+// Text of token-index entry i
+const char *ac_text(int i) {
+    return ac_pool + ac_text_off[i];
+}
+
+int ac_cmp_entry(const void *a, const void *b) {
+    int i = *(const int *)a, j = *(const int *)b;
+    int c = strcmp(ac_text(i), ac_text(j));
+    return c ? c : i - j;
+}
+
+int ac_cmp_gram(const void *a, const void *b) {
+    const unsigned *x = a, *y = b;
+    if (x[0] != y[0]) return x[0] < y[0] ? -1 : 1;
+    return (int)x[1] - (int)y[1];
+}
+
+// Trigram of s[0..2] packed into one integer
+unsigned ac_pack(const char *s) {
+    return ((unsigned)(unsigned char)s[0] << 16) |
+           ((unsigned)(unsigned char)s[1] << 8) | (unsigned char)s[2];
+}
+
+void build_autocomplete_index(void) {
+    static int order[AC_MAX_ENTRIES];
+    static unsigned short tmp_station[AC_MAX_ENTRIES];
+    static int tmp_off[AC_MAX_ENTRIES];
+    static unsigned char tmp_word[AC_MAX_ENTRIES];
+    static unsigned pairs[AC_MAX_GRAMS][2];
+    int used = 0, npairs = 0;
+
+    ac_count = 0;
+    ac_gram_count = 0;
+
+    for (int s = 0; s < stationCount; s++) {
+        const char *name = station_name(s);
+        ac_station_off[s] = used;
+        ac_station_texts[s] = 0;
+
+        // the key first, then each alphanumeric run of the display name
+        for (int k = -1; k < 0 || name[k]; ) {
+            char text[80];
+            int is_word = k >= 0;
+            if (!is_word) {
+                strncpy(text, station_key(s), 79);
+                text[79] = '\0';
+                k = 0;
+            } else {
+                int n = 0;
+                while (name[k] && !isalnum((unsigned char)name[k])) k++;
+                while (name[k] && isalnum((unsigned char)name[k]) && n < 79)
+                    text[n++] = (char)tolower((unsigned char)name[k++]);
+                text[n] = '\0';
+                while (name[k] && isalnum((unsigned char)name[k])) k++;
+                // single letters ("M" of "M.G.") are covered by the key
+                if (n < 2 || strcmp(text, station_key(s)) == 0) continue;
+            }
+
+            int len = (int)strlen(text);
+            if (len == 0 || used + len + 1 > AC_POOL_SIZE || ac_count >= AC_MAX_ENTRIES)
+                continue;
+            memcpy(ac_pool + used, text, (size_t)len + 1);
+            tmp_station[ac_count] = (unsigned short)s;
+            tmp_off[ac_count] = used;
+            tmp_word[ac_count] = (unsigned char)is_word;
+            order[ac_count] = ac_count;
+            ac_count++;
+            ac_station_texts[s]++;
+
+            char padded[82];
+            snprintf(padded, sizeof padded, " %s", text);
+            for (int g = 0; g + 2 <= len && npairs < AC_MAX_GRAMS; g++) {
+                pairs[npairs][0] = ac_pack(padded + g);
+                pairs[npairs][1] = (unsigned)s;
+                npairs++;
+            }
+            used += len + 1;
+        }
+    }
+
+    // sort token entries by their text
+    for (int i = 0; i < ac_count; i++) ac_text_off[i] = tmp_off[i];
+    qsort(order, (size_t)ac_count, sizeof order[0], ac_cmp_entry);
+    for (int i = 0; i < ac_count; i++) {
+        ac_station[i] = tmp_station[order[i]];
+        ac_is_word[i] = tmp_word[order[i]];
+        ac_text_off[i] = tmp_off[order[i]];
+    }
+
+    // sort + dedupe trigram postings
+    qsort(pairs, (size_t)npairs, sizeof pairs[0], ac_cmp_gram);
+    for (int i = 0; i < npairs; i++) {
+        if (i > 0 && pairs[i][0] == pairs[i - 1][0] && pairs[i][1] == pairs[i - 1][1])
+            continue;
+        ac_gram[ac_gram_count] = pairs[i][0];
+        ac_gram_station[ac_gram_count] = (unsigned short)pairs[i][1];
+        ac_gram_count++;
+    }
+
+    ac_ready = 1;
+    ac_version = network_version;
+}
+
+// First token entry whose text is >= prefix
+int ac_lower_bound(const char *prefix) {
+    int lo = 0, hi = ac_count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (strcmp(ac_text(mid), prefix) < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+/*
+    prefix_edit_distance(q, text, limit)
+
+    Fewest edits turning q into some prefix of text (so a partly typed
+    name is not penalized for its missing tail). Returns limit + 1 as
+    soon as every alignment is over the limit.
+*/
+int prefix_edit_distance(const char *q, const char *text, int limit) {
+    int m = (int)strlen(q);
+    int n = (int)strlen(text);
+    int prev[82], cur[82];
+
+    if (m > 80) return limit + 1;
+    if (n > m + limit) n = m + limit;      // longer prefixes cannot help
+
+    for (int i = 0; i <= m; i++) prev[i] = i;
+    int best = prev[m];
+    for (int j = 1; j <= n; j++) {
+        int row_min;
+        cur[0] = j;
+        row_min = cur[0];
+        for (int i = 1; i <= m; i++) {
+            int sub = prev[i - 1] + (q[i - 1] != text[j - 1]);
+            int del = prev[i] + 1;
+            int ins = cur[i - 1] + 1;
+            cur[i] = sub < del ? (sub < ins ? sub : ins) : (del < ins ? del : ins);
+            if (cur[i] < row_min) row_min = cur[i];
+        }
+        if (cur[m] < best) best = cur[m];
+        if (row_min > limit) break;
+        memcpy(prev, cur, (size_t)(m + 1) * sizeof prev[0]);
+    }
+    return best;
+}
+
+// Better-ranked of two candidates (by tier, then edits, name length, ID)
+int ac_better(int tier_a, int dist_a, int a, int tier_b, int dist_b, int b) {
+    if (tier_a != tier_b) return tier_a < tier_b;
+    if (dist_a != dist_b) return dist_a < dist_b;
+    int la = (int)strlen(station_key(a)), lb = (int)strlen(station_key(b));
+    if (la != lb) return la < lb;
+    return a < b;
+}
+
+// Ranked top-N list being filled by autocomplete_ids()
+typedef struct {
+    int *id;                    // caller's buffer
+    int tier[MAX];
+    int dist[MAX];
+    int count;
+    int max;
+} AcTop;
+
+// Insert a candidate in rank order; it falls off when the list is full of better ones
+void ac_offer(AcTop *top, int id, int tier, int dist) {
+    int pos = top->count;
+    while (pos > 0 && ac_better(tier, dist, id, top->tier[pos - 1], top->dist[pos - 1],
+                                top->id[pos - 1]))
+        pos--;
+    if (pos >= top->max) return;
+    if (top->count < top->max) top->count++;
+    for (int k = top->count - 1; k > pos; k--) {
+        top->id[k] = top->id[k - 1];
+        top->tier[k] = top->tier[k - 1];
+        top->dist[k] = top->dist[k - 1];
+    }
+    top->id[pos] = id;
+    top->tier[pos] = tier;
+    top->dist[pos] = dist;
+}
+
+// Remove a station from the list (when it re-enters with a better tier)
+void ac_drop(AcTop *top, int id) {
+    for (int k = 0; k < top->count; k++) {
+        if (top->id[k] != id) continue;
+        for (; k + 1 < top->count; k++) {
+            top->id[k] = top->id[k + 1];
+            top->tier[k] = top->tier[k + 1];
+            top->dist[k] = top->dist[k + 1];
+        }
+        top->count--;
+        return;
+    }
+}
+
+/*
+    autocomplete_ids(prefix, include_planned, out, max)
+
+    Ranked station IDs for a (normalized) prefix, best first. Fuzzy
+    matches are only looked up when the exact ones do not fill out.
+    Returns the number of IDs written.
+*/
+int autocomplete_ids(const char *prefix, int include_planned, int *out, int max) {
+    static unsigned seen[MAX];          // stamp of the query that ranked a station
+    static unsigned char seen_tier[MAX];
+    static unsigned short hits[MAX];
+    static unsigned stamp = 0;
+    static AcTop top;
+
+    if (max <= 0) return 0;
+    if (max > MAX) max = MAX;
+    top.id = out;
+    top.count = 0;
+    top.max = max;
+    if (!ac_ready || ac_version != network_version)
+        build_autocomplete_index();
+    if (++stamp == 0) {
+        memset(seen, 0, sizeof seen);
+        stamp = 1;
+    }
+
+    // exact: every key or word starting with the prefix
+    size_t plen = strlen(prefix);
+    for (int i = ac_lower_bound(prefix); i < ac_count; i++) {
+        if (strncmp(ac_text(i), prefix, plen) != 0) break;
+        int s = ac_station[i];
+        int t = ac_is_word[i] ? AC_TIER_WORD : AC_TIER_KEY;
+        if (!include_planned && station_planned[s]) continue;
+        if (seen[s] == stamp) {
+            if (seen_tier[s] <= t) continue;
+            ac_drop(&top, s);       // seen as a word match, now a key match
+        }
+        seen[s] = stamp;
+        seen_tier[s] = (unsigned char)t;
+        ac_offer(&top, s, t, 0);
+    }
+
+    // fuzzy: candidates sharing enough trigrams, verified by edit distance
+    if (top.count < max && plen >= 3) {
+        char padded[82];
+        int touched[MAX], ntouched = 0;
+        int limit = plen <= 4 ? 1 : AC_MAX_EDITS;
+
+        snprintf(padded, sizeof padded, " %s", prefix);
+        int grams = (int)strlen(padded) - 2;
+        for (int k = 0; k < grams; k++) {
+            unsigned g = ac_pack(padded + k);
+            int lo = 0, hi = ac_gram_count;
+            while (lo < hi) {
+                int mid = (lo + hi) / 2;
+                if (ac_gram[mid] < g) lo = mid + 1;
+                else hi = mid;
+            }
+            for (; lo < ac_gram_count && ac_gram[lo] == g; lo++) {
+                int s = ac_gram_station[lo];
+                if (seen[s] == stamp) continue;
+                if (hits[s] == 0) touched[ntouched++] = s;
+                hits[s]++;
+            }
+        }
+
+        // one edit breaks at most three trigrams
+        int need = grams - 3 * limit;
+        if (need < 1) need = 1;
+        for (int c = 0; c < ntouched; c++) {
+            int s = touched[c];
+            int h = hits[s];
+            hits[s] = 0;
+            if (h < need || (!include_planned && station_planned[s])) continue;
+
+            const char *text = ac_pool + ac_station_off[s];
+            int best = limit + 1;
+            for (int k = 0; k < ac_station_texts[s]; k++) {
+                int d = prefix_edit_distance(prefix, text, limit);
+                if (d < best) best = d;
+                text += strlen(text) + 1;
+            }
+            if (best <= limit) ac_offer(&top, s, AC_TIER_FUZZY, best);
+        }
+    }
+
+    return top.count;
+}
+
+void autocomplete_print(const char *prefix) {
+    int ids[AC_PRINT_LIMIT];
+    int n = autocomplete_ids(prefix, 1, ids, AC_PRINT_LIMIT);
+
+    printf("\nMatches for \"%s\":\n", prefix);
+
+    for (int i = 0; i < n; i++) {
+        printf("  - %s\n", station_name(ids[i]));
+    }
+
+    if (n == 0) {
+        printf("  (no prefix matches)\n");
+    }
+}
+
+// =============================================================
+// OUTPUT BUILDER (TEXT / JSON / HTML)
+// =============================================================
+/*
+    TextOut appends formatted output to one buffer, in one of two modes:
+
+      fixed : the caller's buffer (text_fixed). Output past the end is
+              dropped but still counted, so len tells the caller how
+              big the buffer needs to be; buf stays NUL-terminated.
+      arena : a heap buffer owned by the builder (text_arena). It
+              doubles when full, and text_reset() keeps the memory so
+              the next request formats without allocating.
+
+    text_lit / text_str / text_char / text_int / text_km copy bytes
+    directly; text_printf is the general (slower) fallback.
+*/
+typedef struct {
+    char *buf;
+    size_t cap;
+    size_t len;
+    int grows;          // 1 = arena mode
+} TextOut;
+
+#define TEXT_ARENA_MIN 1024
+
+TextOut text_fixed(char *buf, size_t cap) {
+    TextOut t = { buf, cap, 0, 0 };
+    if (cap > 0) buf[0] = '\0';
+    return t;
+}
+
+TextOut text_arena(void) {
+    TextOut t = { NULL, 0, 0, 1 };
+    return t;
+}
+
+// Start a new request in the same buffer
+void text_reset(TextOut *t) {
+    t->len = 0;
+    if (t->cap > 0) t->buf[0] = '\0';
+}
+
+void text_free(TextOut *t) {
+    if (t->grows) free(t->buf);
+    t->buf = NULL;
+    t->cap = t->len = 0;
+}
+
+// Builder contents as a C string ("" when nothing fit)
+const char *text_cstr(const TextOut *t) {
+    return t->cap > 0 ? t->buf : "";
+}
+
+// 1 when n more bytes (plus the NUL) fit, growing an arena if needed
+int text_reserve(TextOut *t, size_t n) {
+    if (t->len + n < t->cap) return 1;
+    if (!t->grows) return 0;
+
+    size_t cap = t->cap ? t->cap : TEXT_ARENA_MIN;
+    while (cap <= t->len + n) cap *= 2;
+    char *grown = realloc(t->buf, cap);
+    if (!grown) return 0;
+    t->buf = grown;
+    t->cap = cap;
+    return 1;
+}
+
+void text_put(TextOut *t, const char *s, size_t n) {
+    if (text_reserve(t, n)) {
+        memcpy(t->buf + t->len, s, n);
+        t->buf[t->len + n] = '\0';
+    } else if (t->len + 1 < t->cap) {
+        // keep what fits, like snprintf
+        memcpy(t->buf + t->len, s, t->cap - t->len - 1);
+        t->buf[t->cap - 1] = '\0';
+    }
+    t->len += n;
+}
+
+#define text_lit(t, lit) text_put((t), "" lit, sizeof(lit) - 1)
+
+void text_str(TextOut *t, const char *s) {
+    text_put(t, s, strlen(s));
+}
+
+void text_char(TextOut *t, char c) {
+    text_put(t, &c, 1);
+}
+
+void text_int(TextOut *t, int v) {
+    char tmp[12];
+    int i = (int)sizeof tmp;
+    unsigned u = v < 0 ? 0u - (unsigned)v : (unsigned)v;
+
+    do {
+        tmp[--i] = (char)('0' + u % 10);
+        u /= 10;
+    } while (u);
+    if (v < 0) tmp[--i] = '-';
+    text_put(t, tmp + i, sizeof tmp - (size_t)i);
+}
+
+void text_printf(TextOut *t, const char *fmt, ...) {
+    va_list ap, again;
+    size_t room = t->len < t->cap ? t->cap - t->len : 0;
+
+    va_start(ap, fmt);
+    va_copy(again, ap);
+    int n = vsnprintf(room ? t->buf + t->len : NULL, room, fmt, ap);
+    if (n > 0 && (size_t)n >= room && text_reserve(t, (size_t)n))
+        vsnprintf(t->buf + t->len, t->cap - t->len, fmt, again);
+    va_end(again);
+    va_end(ap);
+
+    if (n > 0) t->len += (size_t)n;
+}
+
+// Distance with two decimals, as "%.2f" would print it
+void text_km(TextOut *t, double km) {
+    double cents = km * 100.0;
+    long whole = (long)(cents + 0.5);
+
+    // exact halves round like printf; leave those (and odd values) to it
+    if (km < 0 || cents > 1e9 || cents + 0.5 - (double)whole < 1e-6) {
+        text_printf(t, "%.2f", km);
+        return;
+    }
+    text_int(t, (int)(whole / 100));
+    text_char(t, '.');
+    text_char(t, (char)('0' + whole / 10 % 10));
+    text_char(t, (char)('0' + whole % 10));
+}
+
+// String with HTML special characters escaped
+void text_html(TextOut *t, const char *s) {
+    const char *run = s;
+    for (; *s; s++) {
+        const char *esc = NULL;
+        switch (*s) {
+        case '&': esc = "&amp;"; break;
+        case '<': esc = "&lt;"; break;
+        case '>': esc = "&gt;"; break;
+        case '"': esc = "&quot;"; break;
+        case '\'': esc = "&#39;"; break;
+        default: continue;
+        }
+        text_put(t, run, (size_t)(s - run));
+        text_str(t, esc);
+        run = s + 1;
+    }
+    text_put(t, run, (size_t)(s - run));
+}
+
+// Quoted JSON string
+void text_json(TextOut *t, const char *s) {
+    const char *run = s;
+    text_char(t, '"');
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c != '"' && c != '\\' && c >= 0x20) continue;
+        text_put(t, run, (size_t)(s - run));
+        if (c == '"' || c == '\\') {
+            text_char(t, '\\');
+            text_char(t, (char)c);
+        } else if (c == '\n') {
+            text_lit(t, "\\n");
+        } else {
+            text_printf(t, "\\u%04x", c);
+        }
+        run = s + 1;
+    }
+    text_put(t, run, (size_t)(s - run));
+    text_char(t, '"');
+}
+
+// =============================================================
+// FILE EXPORT (TXT + HTML REPORTS)
+// =============================================================
+
+/*
+    Reports render into one TextOut arena and go to disk with a single
+    fwrite per file, or per REPORT_FLUSH_BYTES of a multi-report file.
+    The arena keeps its memory between files, so a bulk job formats
+    thousands of reports without allocating.
+
+    HTML reports either inline REPORT_CSS (a self-contained page, as
+    the interactive export writes) or link a shared stylesheet written
+    once with write_report_stylesheet().
+
+        ReportWriter w;
+        report_open(&w, &buf, "daily.html", REPORT_HTML, "report.css");
+        for (...) report_add(&w, &route);
+        report_close(&w);
+*/
+#define REPORT_TXT  0
+#define REPORT_HTML 1
+
+#define REPORT_FLUSH_BYTES (1u << 20)
+
+static const char REPORT_CSS[] =
+    "body{font-family:Segoe UI,Roboto,Arial,sans-serif;margin:24px;color:#222}\n"
+    ".header{background:#f4f6fb;padding:14px;border-radius:8px;margin-bottom:18px}\n"
+    ".h1{font-size:20px;margin:0}\n"
+    ".badge{display:inline-block;padding:6px 10px;border-radius:12px;margin-right:6px;font-weight:700}\n"
+    ".badge.purple{background:#f3e8ff;color:#5b2b8a}\n"
+    ".badge.green{background:#e6f8f0;color:#0b7a42}\n"
+    ".badge.pink{background:#fff0f6;color:#9b3b76}\n"
+    ".section{margin-top:14px}\n"
+    ".table{width:100%;border-collapse:collapse;margin-top:8px}\n"
+    ".table th,.table td{border:1px solid #e6e9ef;padding:8px;text-align:left}\n"
+    ".small{color:#666;font-size:13px}\n"
+    "hr.report-break{border:0;border-top:2px solid #e6e9ef;margin:32px 0;page-break-after:always}\n";
+
+typedef struct {
+    FILE *f;
+    TextOut *buf;               // render buffer, reused across files
+    int format;                 // REPORT_TXT / REPORT_HTML
+    const char *stylesheet;     // HTML: linked href, NULL = inline CSS
+    char generated[80];         // timestamp shown in every report
+    int count;                  // reports added so far
+    int failed;
+} ReportWriter;
+
+// Local time as asctime() prints it, without the newline
+void report_timestamp(char *out, size_t size) {
+    time_t now = time(NULL);
+    strftime(out, size, "%c", localtime(&now));
+}
+
+/*
+    format_route_txt(t, r, generated)
+
+    Plain-text report for a route.
+*/
+void format_route_txt(TextOut *t, const Route *r, const char *generated) {
+    STATS_START(started);
+    const int *path = r->path;
+    int len = r->len;
+
+    text_lit(t, "NAMMA METRO — ROUTE REPORT\nGenerated: ");
+    text_str(t, generated);
+    text_lit(t, "\n\n\nRoute:\n");
+    for (int i = 0; i < len; i++) {
+        if (i > 0) text_lit(t, " -> ");
+        text_str(t, station_name(path[i]));
+    }
+
+    text_lit(t, "\n\nLine segments:\n");
+    int i = 0;
+    while (i < len - 1) {
+        int s = i;
+        int e = i;
+        while (e + 1 < len - 1 && route_line(r, e + 1) == route_line(r, s)) {
+            e++;
+        }
+
+        text_str(t, line_names[route_line(r, s)]);
+        text_lit(t, " : ");
+        text_str(t, station_name(path[s]));
+        text_lit(t, " -> ");
+        text_str(t, station_name(path[e + 1]));
+        text_char(t, '\n');
+
+        for (int k = s; k <= e; k++) {
+            double km = adj_km[r->edge_slot[k]];
+            text_lit(t, "    - ");
+            text_str(t, station_name(path[k]));
+            text_lit(t, " -> ");
+            text_str(t, station_name(path[k + 1]));
+            text_lit(t, " : ");
+            text_km(t, km);
+            text_lit(t, " km, ");
+            text_int(t, (adj_sec[r->edge_slot[k]] + 30) / 60);
+            text_lit(t, " min, slab Rs ");
+            text_int(t, fare_from_distance(km));
+            text_char(t, '\n');
+        }
+
+        i = e + 1;
+    }
+
+    text_lit(t, "\nTrip summary:\n - Stops traveled: ");
+    text_int(t, len - 1);
+    text_lit(t, "\n - Distance: ");
+    text_km(t, r->km);
+    text_lit(t, " km\n - ETA (mins): ");
+    text_int(t, (r->time_sec + 30) / 60);
+    text_lit(t, "\n - Fare est: Rs ");
+    text_int(t, fare_from_distance(r->km));
+    text_char(t, '\n');
+    STATS_STOP(render, started);
+}
+
+/*
+    report_html_begin(t, stylesheet) / report_html_end(t)
+
+    Page head and footer around one or more report bodies. stylesheet
+    is the href of a shared CSS file, or NULL to inline REPORT_CSS.
+*/
+void report_html_begin(TextOut *t, const char *stylesheet) {
+    text_lit(t,
+        "<!doctype html>\n<html><head><meta charset='utf-8'>\n"
+        "<title>Namma Metro Route Report</title>\n");
+    if (stylesheet) {
+        text_lit(t, "<link rel='stylesheet' href='");
+        text_html(t, stylesheet);
+        text_lit(t, "'>\n");
+    } else {
+        text_lit(t, "<style>\n");
+        text_put(t, REPORT_CSS, sizeof REPORT_CSS - 1);
+        text_lit(t, "</style>\n");
+    }
+    text_lit(t, "</head><body>\n");
+}
+
+void report_html_end(TextOut *t) {
+    text_lit(t,
+        "<div style='margin-top:18px' class='small'>"
+        "Generated by Namma Metro Route Finder"
+        "</div></body></html>");
+}
+
+/*
+    format_route_html_body(t, r, generated)
+
+    The report itself: header, route, segment and per-stop tables and
+    the trip summary.
+*/
+void format_route_html_body(TextOut *t, const Route *r, const char *generated) {
+    STATS_START(started);
+    const int *path = r->path;
+    int len = r->len;
+
+    // Header
+    text_lit(t,
+        "<div class='header'><div class='h1'>NAMMA METRO — ROUTE REPORT</div>"
+        "<div class='small'>Generated: ");
+    text_html(t, generated);
+    text_lit(t, "</div></div>\n");
+
+    // Route
+    text_lit(t, "<div><strong>Route:</strong> ");
+    for (int i = 0; i < len; i++) {
+        if (i > 0) text_lit(t, " &rarr; ");
+        text_html(t, station_name(path[i]));
+    }
+    text_lit(t, "</div>\n");
+
+    // Segments
+    text_lit(t,
+        "<div class='section'><h3>Line segments</h3>"
+        "<table class='table'><tr>"
+        "<th>Line</th><th>Start</th><th>End</th><th>Stops</th>"
+        "</tr>\n");
+
+    int i2 = 0;
+    while (i2 < len - 1) {
+        int s = i2;
+        int e = i2;
+        while (e + 1 < len - 1 && route_line(r, e + 1) == route_line(r, s)) {
+            e++;
+        }
+
+        const char *curr = line_names[route_line(r, s)];
+        const char *cls =
+            strcmp(curr, "purple") == 0 ? "purple" :
+            strcmp(curr, "green")  == 0 ? "green"  :
+            strcmp(curr, "pink")   == 0 ? "pink"   : "";
+
+        text_lit(t, "<tr><td><span class='badge ");
+        text_str(t, cls);
+        text_lit(t, "'>");
+        text_html(t, curr);
+        text_lit(t, "</span></td><td>");
+        text_html(t, station_name(path[s]));
+        text_lit(t, "</td><td>");
+        text_html(t, station_name(path[e + 1]));
+        text_lit(t, "</td><td>");
+        text_int(t, e - s + 1);
+        text_lit(t, "</td></tr>\n");
+
+        i2 = e + 1;
+    }
+    text_lit(t, "</table></div>\n");
+
+    // Per-edge breakdown
+    text_lit(t,
+        "<div class='section'><h3>Per-stop breakdown</h3>"
+        "<table class='table'>"
+        "<tr><th>From</th><th>To</th><th>Distance (km)</th>"
+        "<th>Time (min)</th><th>Fare (slab)</th></tr>\n");
+
+    int edges = len - 1;
+
+    for (int k = 0; k < edges; k++) {
+        double dist = adj_km[r->edge_slot[k]];
+
+        text_lit(t, "<tr><td>");
+        text_html(t, station_name(path[k]));
+        text_lit(t, "</td><td>");
+        text_html(t, station_name(path[k + 1]));
+        text_lit(t, "</td><td>");
+        text_km(t, dist);
+        text_lit(t, "</td><td>");
+        text_int(t, (adj_sec[r->edge_slot[k]] + 30) / 60);
+        text_lit(t, "</td><td>Rs ");
+        text_int(t, fare_from_distance(dist));
+        text_lit(t, "</td></tr>\n");
+    }
+    text_lit(t, "</table></div>\n");
+
+    // Summary
+    text_lit(t, "<div class='section'><h3>Trip Summary</h3>\n<ul>\n<li>Stops traveled: ");
+    text_int(t, edges);
+    text_lit(t, "</li>\n<li>Distance: ");
+    text_km(t, r->km);
+    text_lit(t, " km</li>\n<li>Estimated travel time: ");
+    text_int(t, (r->time_sec + 30) / 60);
+    text_lit(t, " minutes (incl. ");
+    text_int(t, r->interchanges * INTERCHANGE_TIME_MIN);
+    text_lit(t, " mins interchange)</li>\n<li>Estimated fare: Rs ");
+    text_int(t, fare_from_distance(r->km));
+    text_lit(t, "</li>\n</ul>\n</div>\n");
+    STATS_STOP(render, started);
+}
+
+/*
+    format_route_html(t, r, generated)
+
+    Full self-contained HTML report page for a route; generated is the
+    timestamp shown in the header.
+*/
+void format_route_html(TextOut *t, const Route *r, const char *generated) {
+    report_html_begin(t, NULL);
+    format_route_html_body(t, r, generated);
+    report_html_end(t);
+}
+
+// Write the shared stylesheet that linked HTML reports refer to
+int write_report_stylesheet(const char *fname) {
+    FILE *f = fopen(fname, "w");
+    if (!f) return -1;
+    size_t n = fwrite(REPORT_CSS, 1, sizeof REPORT_CSS - 1, f);
+    if (fclose(f) != 0 || n != sizeof REPORT_CSS - 1) return -1;
+    return 0;
+}
+
+// Hand the buffered bytes to the file in one write
+void report_flush(ReportWriter *w) {
+    TextOut *t = w->buf;
+    if (t->len >= t->cap) {
+        w->failed = 1;              // the arena could not grow: output incomplete
+    } else if (t->len > 0 && fwrite(t->buf, 1, t->len, w->f) != t->len) {
+        w->failed = 1;
+    }
+    text_reset(t);
+}
+
+/*
+    report_open(w, buf, fname, format, stylesheet)
+
+    Starts a report file rendered through buf (an arena; its memory is
+    kept for the next file). Returns 0, or -1 if fname can't be created.
+*/
+int report_open(ReportWriter *w, TextOut *buf, const char *fname, int format,
+                const char *stylesheet) {
+    w->f = fopen(fname, "w");
+    w->buf = buf;
+    w->format = format;
+    w->stylesheet = stylesheet;
+    w->count = 0;
+    w->failed = 0;
+    report_timestamp(w->generated, sizeof w->generated);
+    if (!w->f) return -1;
+
+    text_reset(buf);
+    if (format == REPORT_HTML) report_html_begin(buf, stylesheet);
+    return 0;
+}
+
+// Append one route's report
+void report_add(ReportWriter *w, const Route *r) {
+    TextOut *t = w->buf;
+
+    if (w->format == REPORT_HTML) {
+        if (w->count > 0) text_lit(t, "<hr class='report-break'>\n");
+        format_route_html_body(t, r, w->generated);
+    } else {
+        if (w->count > 0)
+            text_lit(t, "\n================================================================\n\n");
+        format_route_txt(t, r, w->generated);
+    }
+    w->count++;
+
+    if (t->len >= REPORT_FLUSH_BYTES) report_flush(w);
+}
+
+// Finish the file; returns 0, or -1 if anything failed to write
+int report_close(ReportWriter *w) {
+    if (!w->f) return -1;
+    if (w->format == REPORT_HTML) report_html_end(w->buf);
+    report_flush(w);
+    if (fclose(w->f) != 0) w->failed = 1;
+    w->f = NULL;
+    return w->failed ? -1 : 0;
+}
+
+// shared by the single-route exports below
+static TextOut report_arena = { NULL, 0, 0, 1 };
+
+/*
+    export_route_report(fname, r, format, stylesheet)
+
+    One route, one file, one write. Returns 0 or -1.
+*/
+int export_route_report(const char *fname, const Route *r, int format,
+                        const char *stylesheet) {
+    ReportWriter w;
+    if (report_open(&w, &report_arena, fname, format, stylesheet) < 0) return -1;
+    report_add(&w, r);
+    return report_close(&w);
+}
+
+void export_route_to_txt(const char *fname, const Route *r) {
+    if (export_route_report(fname, r, REPORT_TXT, NULL) < 0) {
+        printf("Failed to create %s\n", fname);
+        return;
+    }
+    printf("Saved TXT report: %s\n", fname);
+}
+
+void export_route_to_html(const char *fname, const Route *r) {
+    if (export_route_report(fname, r, REPORT_HTML, NULL) < 0) {
+        printf("Failed to create %s\n", fname);
+        return;
+    }
+    printf("Saved HTML report: %s\n", fname);
+}
+
+// =============================================================
+// CROSS-PLATFORM FILE OPEN (DEFAULT APP)
+// =============================================================
+void open_file_crossplatform(const char *filename) {
+#ifdef _WIN32
+    char cmd[1024];
+    snprintf(cmd, sizeof cmd, "start \"\" \"%s\"", filename);
+    system(cmd);
+#elif __APPLE__
+    char cmd[1024];
+    snprintf(cmd, sizeof cmd, "open \"%s\"", filename);
+    system(cmd);
+#else
+    char cmd[1024];
+    snprintf(cmd, sizeof cmd, "xdg-open \"%s\" >/dev/null 2>&1 &", filename);
+    system(cmd);
+#endif
+}
+
+// =============================================================
+// SHOW ALL STATIONS
+// =============================================================
+void show_all_stations(int include_planned) {
+    printf("\n%sStation list (total: %d)%s\n",
+           CLR_BOLD, stationCount, CLR_RESET);
+
+    for (int i = 0; i < stationCount; i++) {
+        if (!include_planned && station_planned[i])
+            continue;
+
+        printf(" - %s", station_name(i));
+
+        if (station_line_mask[i]) {
+            const char *sep = " (";
+            for (int l = 0; l < lineCount; l++) {
+                if (!(station_line_mask[i] & (1u << l))) continue;
+                printf("%s%s", sep, line_names[l]);
+                sep = ", ";
+            }
+            printf(")");
+        }
+        if (station_planned[i])
+            printf(" [planned]");
+
+        printf("\n");
+    }
+}
+
+// =============================================================
+// WEBASSEMBLY ENTRY: init_network(include_planned)
+// =============================================================
+/*
+    Lets the frontend build the graph once at startup (or after the
+    planned toggle changes) instead of paying for it on the first query.
+    Returns the number of stations loaded.
+*/
+EMSCRIPTEN_KEEPALIVE
+int init_network(int include_planned) {
+    ensure_network(include_planned);
+    route_table_usable();   // precompute the all-pairs table up front
+    return stationCount;
+}
+
+/*
+    set_route_table_mode(on)
+
+    1 = answer queries from the precomputed all-pairs table (default),
+    0 = run an A* search per query and release the table memory.
+*/
+EMSCRIPTEN_KEEPALIVE
+void set_route_table_mode(int on) {
+    route_table_enabled = on ? 1 : 0;
+    if (!route_table_enabled)
+        free_route_table();
+}
+
+/*
+    load_network_image(data, size)
+
+    Switches to a network compiled with "metro --compile". The image
+    is used in place, so the caller must keep the buffer alive (and
+    unmodified) until another network is loaded; an unaligned buffer
+    is copied instead. Returns the station count, or -1.
+*/
+EMSCRIPTEN_KEEPALIVE
+int load_network_image(const unsigned char *data, int size) {
+    unsigned char *img = (unsigned char *)data;
+    int kind = IMAGE_BORROWED;
+
+    if (!data || size <= 0) return network_fail("empty image");
+    if (((uintptr_t)data & (NET_IMAGE_ALIGN - 1)) != 0) {
+        img = malloc((size_t)size);
+        if (!img) return network_fail("out of memory");
+        memcpy(img, data, (size_t)size);
+        kind = IMAGE_MALLOC;
+    }
+    int result = load_network_image_mem(img, (size_t)size, kind);
+    if (result < 0) free_network_buffer(img, (size_t)size, kind);
+    return result;
+}
+
+// Switch to a network given as source text (NUL-terminated); returns the station count or -1
+EMSCRIPTEN_KEEPALIVE
+int load_network_text(const char *text) {
+    if (!text) return network_fail("empty source");
+    return load_network_source(text, strlen(text));
+}
+
+// Reason the last load failed (read-only)
+EMSCRIPTEN_KEEPALIVE
+const char *get_network_error(void) {
+    return network_error;
+}
+
+// =============================================================
+// SINGLE-SOURCE TREE CACHE (ONE-TO-MANY QUERIES)
+// =============================================================
+/*
+    A full search from one source answers every destination by path
+    reconstruction alone. The last SOURCE_TREE_SLOTS trees are kept
+    (least recently used is replaced) and are dropped automatically
+    when network_version changes.
+
+    best[s] caches the cheapest settled node of each station, so a
+    destination lookup costs only its path length.
+*/
+#define SOURCE_TREE_SLOTS 4
+
+typedef struct {
+    int src;                    // -1 = empty slot
+    unsigned version;           // network_version the tree was built for
+    unsigned stamp;             // last use, for LRU replacement
+    int best[MAX];              // cheapest node per station, -1 unreachable
+    SearchScratch *sc;          // dist/parent/via of the full search
+} SourceTree;
+
+SourceTree source_trees[SOURCE_TREE_SLOTS];
+unsigned source_tree_clock = 0;
+int source_trees_init = 0;
+
+/*
+    build_source_tree(t, src)
+
+    Runs the full search from src in t->sc and records the best node
+    of every station. Touches nothing but t, so batch workers use it
+    on trees of their own.
+*/
+void build_source_tree(SourceTree *t, int src) {
+    weighted_search(t->sc, src, -1);
+    for (int s = 0; s < stationCount; s++)
+        t->best[s] = best_node(t->sc, s);
+    t->src = src;
+    t->version = network_version;
+}
+
+/*
+    source_tree(src)
+
+    Returns the cached tree for src, computing it if needed.
+    NULL if src is out of range or memory runs out.
+*/
+const SourceTree *source_tree(int src) {
+    if (src < 0 || src >= stationCount) return NULL;
+
+    if (!source_trees_init) {
+        for (int i = 0; i < SOURCE_TREE_SLOTS; i++) {
+            source_trees[i].src = -1;
+            source_trees[i].sc = NULL;
+        }
+        source_trees_init = 1;
+    }
+
+    SourceTree *slot = NULL;
+    for (int i = 0; i < SOURCE_TREE_SLOTS; i++) {
+        SourceTree *t = &source_trees[i];
+        if (t->src == src && t->version == network_version) {
+            t->stamp = ++source_tree_clock;
+            return t;
+        }
+        if (!slot || t->src == -1 || (slot->src != -1 && t->stamp < slot->stamp))
+            slot = t;
+    }
+
+    if (!slot->sc) {
+        slot->sc = malloc(sizeof *slot->sc);
+        if (!slot->sc) return NULL;
+    }
+
+    build_source_tree(slot, src);
+    slot->stamp = ++source_tree_clock;
+    return slot;
+}
+
+/*
+    route_from_source_tree(t, dest, r)
+
+    Rebuilds the fastest route from the tree's source to dest.
+    Returns 1 if found, 0 if dest is unreachable.
+*/
+int route_from_source_tree(const SourceTree *t, int dest, Route *r) {
+    if (dest < 0 || dest >= stationCount || station_closed(dest)) return 0;
+    if (dest == t->src) {
+        route_from_search(t->sc, t->src, -1, r);
+        return 1;
+    }
+    if (t->best[dest] < 0) return 0;
+    route_from_search(t->sc, t->src, t->best[dest], r);
+    return 1;
+}
+
+// Travel time in seconds from the tree's source to dest, -1 if unreachable
+int source_tree_time(const SourceTree *t, int dest) {
+    if (station_closed(dest)) return -1;
+    if (dest == t->src) return 0;
+    return t->best[dest] < 0 ? -1 : t->sc->dist[t->best[dest]];
+}
+
+// =============================================================
+// WEBASSEMBLY ENTRY: get_etas_from(src, out_minutes)
+// =============================================================
+/*
+    "From my current station" screen: writes the travel time in
+    minutes to every station (-1 = unreachable) into out_minutes,
+    which must hold station_count() ints. Returns the station count,
+    or -1 if src is invalid.
+*/
+EMSCRIPTEN_KEEPALIVE
+int get_etas_from(int src, int *out_minutes) {
+    ensure_network(1);
+    const SourceTree *t = source_tree(src);
+    if (!t) return -1;
+
+    for (int s = 0; s < stationCount; s++) {
+        int sec = source_tree_time(t, s);
+        out_minutes[s] = sec < 0 ? -1 : (sec + 30) / 60;
+    }
+    return stationCount;
+}
+
+EMSCRIPTEN_KEEPALIVE
+int station_count(void) {
+    ensure_network(1);
+    return stationCount;
+}
+
+// =============================================================
+// ISOCHRONES (BOUNDED SINGLE-SOURCE SEARCH)
+// =============================================================
+/*
+    "Which stations are within 30 minutes of X?" in one search:
+    Dijkstra from every line at src (no landmark guide), stopped by
+    SearchMask.max_cost as soon as nothing inside the time budget is
+    left in the queue. A station belongs to the isochrone when its
+    fastest route fits both budgets; time, fare and km are those of
+    that route, as get_route() quotes them, so a fare budget never
+    swaps in a slower, cheaper path.
+
+    IsoStation: one reachable station.
+
+      line_mask : bit l set = line l is ridden on the way
+*/
+typedef struct {
+    int station;
+    int time_sec;
+    int fare;                   // Rs, as get_route() quotes it
+    int interchanges;
+    double km;
+    unsigned line_mask;
+} IsoStation;
+
+/*
+    isochrone_with(src, max_sec, max_fare, out, sc, r)
+
+    Fills out (room for stationCount entries) with every open station
+    reachable from src within max_sec seconds and max_fare Rs (-1 =
+    no limit on that budget): src first, then by time, ties by ID.
+    src is listed whatever the budgets, at the fare get_route() gives
+    a trip to itself.
+    sc and r are the caller's scratch, so batch workers run it side
+    by side. Returns the count (0 if src is closed), -1 if src is
+    invalid.
+*/
+int isochrone_with(int src, int max_sec, int max_fare, IsoStation *out,
+                   SearchScratch *sc, Route *r) {
+    if (src < 0 || src >= stationCount) return -1;
+    if (station_closed(src)) return 0;
+
+    SearchMask mask = { NULL, NULL, max_sec, 1 };
+    weighted_search_from(sc, src, -1, -1, &mask);
+
+    out[0].station = src;
+    out[0].time_sec = 0;
+    out[0].fare = fare_from_distance(0.0);
+    out[0].interchanges = 0;
+    out[0].km = 0.0;
+    out[0].line_mask = 0;
+    int n = 1;
+
+    for (int s = 0; s < stationCount; s++) {
+        int x = s == src ? -1 : best_node(sc, s);
+        if (x < 0 || (max_sec >= 0 && sc->dist[x] > max_sec)) continue;
+
+        route_from_search(sc, src, x, r);
+        int fare = fare_from_distance(r->km);
+        if (max_fare >= 0 && fare > max_fare) continue;
+
+        IsoStation e;
+        e.station = s;
+        e.time_sec = r->time_sec;
+        e.fare = fare;
+        e.interchanges = r->interchanges;
+        e.km = r->km;
+        e.line_mask = 0;
+        for (int i = 0; i < r->len - 1; i++)
+            e.line_mask |= 1u << route_line(r, i);
+
+        // insertion by time; stations arrive in ID order, so ties stay by ID
+        int k = n++;
+        while (k > 1 && out[k - 1].time_sec > e.time_sec) {
+            out[k] = out[k - 1];
+            k--;
+        }
+        out[k] = e;
+    }
+    return n;
+}
+
+// Seconds budget for a budget in displayed (rounded) minutes; -1 stays -1
+int iso_max_sec(int max_minutes) {
+    return max_minutes < 0 ? -1 : max_minutes * 60 + 29;
+}
+
+/*
+    format_isochrone_json(t, src, max_minutes, max_fare, iso, n)
+
+      {"status":0,"from":{"id":..,"name":..},"max_min":..,"max_fare":..,
+       "count":N,"stations":[{"id":..,"name":..,"time_min":..,"fare":..,
+       "interchanges":..,"distance_km":..,"lines":["purple",..]},..]}
+
+    A lifted budget is null. lines are in line ID order.
+*/
+void format_isochrone_json(TextOut *t, int src, int max_minutes, int max_fare,
+                           const IsoStation *iso, int n) {
+    text_lit(t, "{\"status\":0,\"from\":{\"id\":");
+    text_int(t, src);
+    text_lit(t, ",\"name\":");
+    text_json(t, station_name(src));
+    text_lit(t, "},\"max_min\":");
+    if (max_minutes < 0) text_lit(t, "null");
+    else text_int(t, max_minutes);
+    text_lit(t, ",\"max_fare\":");
+    if (max_fare < 0) text_lit(t, "null");
+    else text_int(t, max_fare);
+    text_lit(t, ",\"count\":");
+    text_int(t, n);
+    text_lit(t, ",\"stations\":[");
+    for (int i = 0; i < n; i++) {
+        if (i > 0) text_char(t, ',');
+        text_lit(t, "{\"id\":");
+        text_int(t, iso[i].station);
+        text_lit(t, ",\"name\":");
+        text_json(t, station_name(iso[i].station));
+        text_lit(t, ",\"time_min\":");
+        text_int(t, (iso[i].time_sec + 30) / 60);
+        text_lit(t, ",\"fare\":");
+        text_int(t, iso[i].fare);
+        text_lit(t, ",\"interchanges\":");
+        text_int(t, iso[i].interchanges);
+        text_lit(t, ",\"distance_km\":");
+        text_km(t, iso[i].km);
+        text_lit(t, ",\"lines\":[");
+        int first = 1;
+        for (int l = 0; l < lineCount; l++) {
+            if (!(iso[i].line_mask & (1u << l))) continue;
+            if (!first) text_char(t, ',');
+            text_json(t, line_names[l]);
+            first = 0;
+        }
+        text_lit(t, "]}");
+    }
+    text_lit(t, "]}");
+}
+
+// =============================================================
+// WEBASSEMBLY ENTRY: get_isochrone(src, max_minutes, max_fare, out)
+// =============================================================
+/*
+    Reachability shading for the map. For the i-th reachable station,
+    out[i * ISO_FIELDS + ...] (room for station_count() records)
+    receives:
+
+      [0] station ID       [1] minutes        [2] fare (Rs)
+      [3] interchanges     [4] distance (m)   [5] line mask
+                                                  (bit = line ID)
+
+    max_minutes compares against minutes as routes display them
+    (rounded), so no listed station shows more than the budget;
+    -1 lifts a budget. Returns the record count, -1 if src is invalid.
+*/
+#define ISO_FIELDS 6
+
+EMSCRIPTEN_KEEPALIVE
+int get_isochrone(int src, int max_minutes, int max_fare, int *out) {
+    static IsoStation iso[MAX];
+    static Route r;
+
+    ensure_network(1);
+    int n = isochrone_with(src, iso_max_sec(max_minutes), max_fare, iso, &route_scratch, &r);
+
+    for (int i = 0; i < n; i++) {
+        int *rec = out + i * ISO_FIELDS;
+        rec[0] = iso[i].station;
+        rec[1] = (iso[i].time_sec + 30) / 60;
+        rec[2] = iso[i].fare;
+        rec[3] = iso[i].interchanges;
+        rec[4] = (int)(iso[i].km * 100.0 + 0.5) * 10;
+        rec[5] = (int)iso[i].line_mask;
+    }
+    return n;
+}
+
+// =============================================================
+// NETWORK EDITS (CLOSURES, PLANNED STATIONS)
+// =============================================================
+/*
+    Live service changes - a segment closed for maintenance, a station
+    shut during an incident, a planned station opening - applied
+    without a rebuild. The CSR index itself is never rewritten (it may
+    live in a read-only image): closures are the closed_slot /
+    closed_station overlay that every search checks.
+
+    An edit bumps network_version, then carries each cache it can
+    patch over to the new version:
+
+      route table  : a destination column is searched again only if
+                     its tree used what was closed, or what reopened
+                     can shorten one of its routes; the other columns
+                     are kept (a station edit refreshes just that
+                     station's entry in them). A table living inside a
+                     network image is copied to the heap first.
+      source trees : the same test per cached tree; hit trees are dropped
+      autocomplete : names do not change, so it is kept as is
+
+    Anything else keyed on network_version (the batch workers' trees)
+    is rebuilt on next use.
+*/
+typedef struct {
+    int station;                // station edit: its ID; -1 = segment edit
+    int node[2];                // segment edit: its two (station, line) nodes
+    int sec;                    // segment edit: running time
+    int closing;                // 1 = closed now, 0 = reopened
+} NetworkEdit;
+
+// Nodes an edit touches (the segment's two, or every node of the station)
+int edit_nodes(const NetworkEdit *e, int *nodes) {
+    if (e->station < 0) {
+        nodes[0] = e->node[0];
+        nodes[1] = e->node[1];
+        return 2;
+    }
+    int count = 0;
+    for (int x = node_offset[e->station]; x < node_offset[e->station + 1]; x++)
+        nodes[count++] = x;
+    return count;
+}
+
+// 1 if a reopened link of cost sec from a node at cost a beats cost b
+int edit_improves(int a, int b, int sec) {
+    return a >= 0 && (b < 0 || a + sec < b);
+}
+
+/*
+    edit_hits_tree(e, root, par, dist)
+
+    The test behind both caches, for one shortest-path tree grown from
+    station root. par[i] and dist[i] are the tree parent (-1 = none)
+    and cost (-1 = unreached) of edit_nodes()[i]. Returns 1 if the
+    tree has to be searched again.
+*/
+int edit_hits_tree(const NetworkEdit *e, int root, const int *par, const int *dist) {
+    if (e->station < 0) {
+        if (e->closing) return par[1] == e->node[0] || par[0] == e->node[1];
+        return edit_improves(dist[0], dist[1], e->sec) ||
+               edit_improves(dist[1], dist[0], e->sec);
+    }
+
+    // a station edit matters where the tree starts or changes lines there
+    if (root == e->station) return 1;
+    int first = node_offset[e->station];
+    int count = node_offset[e->station + 1] - first;
+    for (int i = 0; i < count; i++) {
+        for (int j = 0; j < count; j++) {
+            if (i == j) continue;
+            if (e->closing ? par[j] == first + i
+                           : edit_improves(dist[i], dist[j], INTERCHANGE_SEC))
+                return 1;
+        }
+    }
+    return 0;
+}
+
+// Seconds from node x to station t along rt_next, -1 if unreached
+int route_table_node_time(int t, int x) {
+    const unsigned short *next = rt_next + (size_t)t * nodeCount;
+    int sec = 0;
+
+    while (next[x] != RT_NONE) {
+        int y = next[x];
+        if (node_station[y] == node_station[x])
+            sec += INTERCHANGE_SEC;
+        else
+            sec += adj_sec[find_edge_slot_on_line(node_station[x], node_station[y], node_line[x])];
+        x = y;
+    }
+    return node_station[x] == t && !station_closed(t) ? sec : -1;
+}
+
+/*
+    route_table_column_update(sc, t, station)
+
+    Re-searches column t after an edit but rewrites only the entries
+    that changed: a node is changed if its old path to t is no longer
+    allowed or its cost differs, and only stations with a changed node
+    (plus station, the edited one, if >= 0) get a new start, time and
+    summary. Everything else keeps its old path, which is still one of
+    the fastest. Returns the number of stations rewritten.
+*/
+int route_table_column_update(SearchScratch *sc, int t, int station) {
+    static int old_dist[MAX_NODES];
+    static unsigned char state[MAX_NODES];     // 0 = unknown, 1 = valid, 2 = invalid
+    static int chain[MAX_NODES];
+    unsigned short *next = rt_next + (size_t)t * nodeCount;
+    int n = stationCount;
+    int rewritten = 0;
+
+    // old cost and validity of every node, walking each path once
+    memset(state, 0, (size_t)nodeCount);
+    for (int x0 = 0; x0 < nodeCount; x0++) {
+        int len = 0, x = x0;
+        while (!state[x] && next[x] != RT_NONE) {
+            chain[len++] = x;
+            x = next[x];
+        }
+        if (!state[x]) {
+            state[x] = 1;
+            old_dist[x] = node_station[x] == t ? 0 : -1;
+        }
+        while (len > 0) {
+            int y = x;
+            x = chain[--len];
+            int u = node_station[x], v = node_station[y];
+            int ok = state[y] == 1;
+            if (u == v) {
+                ok = ok && !station_closed(u);
+                old_dist[x] = old_dist[y] + INTERCHANGE_SEC;
+            } else {
+                int k = find_edge_slot_on_line(u, v, node_line[x]);
+                ok = ok && !(closed_slot_count && bit_test(closed_slot, k));
+                old_dist[x] = old_dist[y] + adj_sec[k];
+            }
+            state[x] = ok ? 1 : 2;
+        }
+    }
+    if (station_closed(t)) memset(state, 2, (size_t)nodeCount);
+
+    weighted_search(sc, t, -1);
+    for (int x = 0; x < nodeCount; x++) {
+        state[x] = state[x] == 2 || sc->dist[x] != old_dist[x];
+        if (state[x])
+            next[x] = (sc->dist[x] < 0 || sc->parent[x] == -1)
+                      ? RT_NONE : (unsigned short)sc->parent[x];
+    }
+
+    for (int s = 0; s < n; s++) {
+        int changed = s == station;
+        for (int x = node_offset[s]; x < node_offset[s + 1]; x++) changed |= state[x];
+        if (!changed) continue;
+
+        int best = best_node(sc, s);
+        rt_start[s * n + t] = best == -1 ? RT_NONE : (unsigned short)best;
+        rt_time[s * n + t] = s == t ? 0 : best == -1 ? RT_NONE : (unsigned short)sc->dist[best];
+        route_table_summarize(s, t);
+        rewritten++;
+    }
+    return rewritten;
+}
+
+// Give a route table that lives in a network image heap copies of its own
+int route_table_own(void) {
+    if (route_table_owned) return 1;
+
+    size_t pairs = (size_t)stationCount * stationCount;
+    size_t next_len = (size_t)stationCount * nodeCount;
+    unsigned short *next = malloc(next_len * sizeof *next);
+    unsigned short *start = malloc(pairs * sizeof *start);
+    unsigned short *time_s = malloc(pairs * sizeof *time_s);
+    unsigned short *dam = malloc(pairs * sizeof *dam);
+    unsigned short *hops = malloc(pairs * sizeof *hops);
+    unsigned char *changes = malloc(pairs);
+    unsigned char *fare = malloc(pairs);
+    if (!next || !start || !time_s || !dam || !hops || !changes || !fare) {
+        free(next);
+        free(start);
+        free(time_s);
+        free(dam);
+        free(hops);
+        free(changes);
+        free(fare);
+        return 0;
+    }
+
+    memcpy(next, rt_next, next_len * sizeof *next);
+    memcpy(start, rt_start, pairs * sizeof *start);
+    memcpy(time_s, rt_time, pairs * sizeof *time_s);
+    memcpy(dam, rt_dam, pairs * sizeof *dam);
+    memcpy(hops, rt_hops, pairs * sizeof *hops);
+    memcpy(changes, rt_changes, pairs);
+    memcpy(fare, rt_fare, pairs);
+    rt_next = next;
+    rt_start = start;
+    rt_time = time_s;
+    rt_dam = dam;
+    rt_hops = hops;
+    rt_changes = changes;
+    rt_fare = fare;
+    route_table_owned = 1;
+    return 1;
+}
+
+/*
+    route_table_patch(e)
+
+    Carries the route table across edit e. Returns the number of
+    columns searched again, or -1 if there was no memory to copy an
+    image-backed table (it is then dropped and rebuilt on demand).
+*/
+int route_table_patch(const NetworkEdit *e) {
+    int n = stationCount;
+    int s = e->station;
+    int nodes[MAX_LINES], par[MAX_LINES], dist[MAX_LINES];
+    int count = edit_nodes(e, nodes);
+    int refreshed = 0;
+
+    // a station edit rewrites that station's entry in every column
+    if (s >= 0 && !route_table_own()) {
+        free_route_table();
+        return -1;
+    }
+
+    for (int t = 0; t < n; t++) {
+        const unsigned short *next = rt_next + (size_t)t * nodeCount;
+        for (int i = 0; i < count; i++) {
+            par[i] = next[nodes[i]] == RT_NONE ? -1 : next[nodes[i]];
+            dist[i] = e->closing ? -1 : route_table_node_time(t, nodes[i]);
+        }
+
+        if (edit_hits_tree(e, t, par, dist)) {
+            if (!route_table_own()) {
+                free_route_table();
+                return -1;
+            }
+            route_table_column_update(&route_scratch, t, s);
+            refreshed++;
+        } else if (s >= 0) {
+            int best = -1;
+            for (int i = 0; i < count && !e->closing; i++) {
+                if (dist[i] >= 0 && (best == -1 || dist[i] < dist[best])) best = i;
+            }
+            rt_start[s * n + t] = best == -1 ? RT_NONE : (unsigned short)nodes[best];
+            rt_time[s * n + t] = best == -1 ? RT_NONE : (unsigned short)dist[best];
+            route_table_summarize(s, t);
+        }
+    }
+    return refreshed;
+}
+
+// Carry the cached source trees built for version old across edit e
+void source_trees_patch(const NetworkEdit *e, unsigned old) {
+    int nodes[MAX_LINES], par[MAX_LINES], dist[MAX_LINES];
+    int count = edit_nodes(e, nodes);
+
+    for (int k = 0; k < SOURCE_TREE_SLOTS && source_trees_init; k++) {
+        SourceTree *t = &source_trees[k];
+        if (t->src == -1 || t->version != old) continue;
+
+        // parent[] is only meaningful where the search reached
+        for (int i = 0; i < count; i++) {
+            dist[i] = t->sc->dist[nodes[i]];
+            par[i] = dist[i] < 0 ? -1 : t->sc->parent[nodes[i]];
+        }
+        if (edit_hits_tree(e, t->src, par, dist)) {
+            t->src = -1;
+            continue;
+        }
+        if (e->station >= 0)
+            t->best[e->station] = best_node(t->sc, e->station);
+        t->version = network_version;
+    }
+}
+
+/*
+    network_edit_commit(e)
+
+    Bumps network_version and patches what edit e leaves valid. The
+    closure bits must already say what e did.
+*/
+void network_edit_commit(const NetworkEdit *e) {
+    unsigned old = network_version;
+    network_version++;
+
+    if (route_table_ready && route_table_version == old && route_table_patch(e) >= 0)
+        route_table_version = network_version;
+    source_trees_patch(e, old);
+    if (ac_ready && ac_version == old)
+        ac_version = network_version;
+}
+
+/*
+    set_segment_closed(a, b, closed)
+
+    Takes the track segment between adjacent stations a and b out of
+    service (closed = 1) or puts it back (closed = 0), in both
+    directions and for every line that rides it (one edit per line).
+    Returns 1 if that changed anything, 0 if the segment already was
+    in that state, -1 if a and b are not adjacent.
+*/
+EMSCRIPTEN_KEEPALIVE
+int set_segment_closed(int a, int b, int closed) {
+    ensure_network(1);
+    if (a < 0 || b < 0 || a >= stationCount || b >= stationCount) return -1;
+    if (find_edge_slot(a, b) < 0) return -1;
+
+    closed = closed ? 1 : 0;
+    int changed = 0;
+    for (int ab = adj_offset[a]; ab < adj_offset[a + 1]; ab++) {
+        if (adj_nbr[ab] != b) continue;
+        int ba = find_edge_slot_on_line(b, a, adj_line[ab]);
+        if (ba < 0 || bit_test(closed_slot, ab) == closed) continue;
+        if (closed) {
+            bit_set(closed_slot, ab);
+            bit_set(closed_slot, ba);
+            closed_slot_count += 2;
+        } else {
+            bit_clear(closed_slot, ab);
+            bit_clear(closed_slot, ba);
+            closed_slot_count -= 2;
+        }
+
+        NetworkEdit e = { -1, { adj_to_node[ba], adj_to_node[ab] }, adj_sec[ab], closed };
+        network_edit_commit(&e);
+        changed = 1;
+    }
+    return changed;
+}
+
+/*
+    set_station_closed(s, closed)
+
+    Closes station s (closed = 1): no trip may start or end there and
+    nobody changes lines there, but trains still run through. closed
+    = 0 reopens it. Returns 1 if that changed anything, 0 if not, -1
+    for an invalid ID.
+*/
+EMSCRIPTEN_KEEPALIVE
+int set_station_closed(int s, int closed) {
+    ensure_network(1);
+    if (s < 0 || s >= stationCount) return -1;
+
+    closed = closed ? 1 : 0;
+    if (bit_test(closed_station, s) == closed) return 0;
+    if (closed) {
+        bit_set(closed_station, s);
+        closed_station_count++;
+    } else {
+        bit_clear(closed_station, s);
+        closed_station_count--;
+    }
+
+    NetworkEdit e = { s, { -1, -1 }, 0, closed };
+    network_edit_commit(&e);
+    return 1;
+}
+
+// 1 if station s is closed, 0 if open, -1 for an invalid ID
+EMSCRIPTEN_KEEPALIVE
+int is_station_closed(int s) {
+    if (s < 0 || s >= stationCount) return -1;
+    return station_closed(s);
+}
+
+/*
+    set_station_planned(s, planned)
+
+    Marks station s as planned (1) or in service (0), e.g. when it is
+    commissioned. Only name lookups with include_planned = 0 read the
+    flag, so no cache changes. Returns 1 if the flag changed, 0 if
+    not, -1 for an invalid ID.
+*/
+EMSCRIPTEN_KEEPALIVE
+int set_station_planned(int s, int planned) {
+    ensure_network(1);
+    if (s < 0 || s >= stationCount) return -1;
+
+    planned = planned ? 1 : 0;
+    if (station_planned[s] == planned) return 0;
+    station_planned[s] = (unsigned char)planned;
+    return 1;
+}
+
+// =============================================================
+// ROUTE RESULTS (REENTRANT API)
+// =============================================================
+/*
+    Status codes shared by the structured and text APIs.
+*/
+#define ROUTE_OK             0
+#define ROUTE_ERR_NOT_LOADED 1   // network has no stations
+#define ROUTE_ERR_NO_INPUT   2   // missing source or destination
+#define ROUTE_ERR_NOT_FOUND  3   // neither station found
+#define ROUTE_ERR_SRC        4   // source station not found
+#define ROUTE_ERR_DEST       5   // destination station not found
+#define ROUTE_ERR_NO_PATH    6   // stations are not connected
+#define ROUTE_ERR_CLOSED     7   // source or destination is closed
+#define ROUTE_ERR_NO_SERVICE 8   // no train gets there after this time today
+
+/*
+    RouteResult: flat, pointer-free result the JS side can read
+    straight out of WASM memory (all fields are 32-bit ints).
+
+    stations[0..station_count-1] : station IDs, source first
+    lines[0..station_count-2]    : line ID of each edge
+*/
+typedef struct {
+    int status;
+    int station_count;
+    int time_min;
+    int fare;
+    int interchanges;
+    int distance_m;
+    int stations[MAX];
+    int lines[MAX];
+} RouteResult;
+
+// Route between station IDs, allocating scratch only if a search is needed
+int route_between_ids(int src, int dest, Route *r) {
+    if (src == dest || (route_table_enabled && route_table_ready &&
+                        route_table_version == network_version)) {
+        return find_route_r(src, dest, r, NULL);
+    }
+
+    SearchScratch *sc = malloc(sizeof *sc);
+    if (!sc) return 0;
+    int found = find_route_r(src, dest, r, sc);
+    free(sc);
+    return found;
+}
+
+// Name lookup behind resolve_stations (untimed)
+static int lookup_stations(const char *from, const char *to, int *src, int *dest) {
+    int include_planned = 1;
+
+    *src = *dest = -1;
+    if (stationCount == 0) return ROUTE_ERR_NOT_LOADED;
+    if (!from || !to || !from[0] || !to[0]) return ROUTE_ERR_NO_INPUT;
+
+    char srckey[80], dstkey[80];
+    strncpy(srckey, from, 79);
+    srckey[79] = '\0';
+    normalize_inplace(srckey);
+
+    strncpy(dstkey, to, 79);
+    dstkey[79] = '\0';
+    normalize_inplace(dstkey);
+
+    *src = find_station_id(srckey, include_planned);
+    *dest = find_station_id(dstkey, include_planned);
+
+    if (*src == -1 && *dest == -1) return ROUTE_ERR_NOT_FOUND;
+    if (*src == -1) return ROUTE_ERR_SRC;
+    if (*dest == -1) return ROUTE_ERR_DEST;
+    return ROUTE_OK;
+}
+
+/*
+    resolve_stations(from, to, src, dest)
+
+    Normalizes both names and looks them up in the built network
+    (read-only). Returns ROUTE_OK or the ROUTE_ERR_* for the names;
+    ROUTE_ERR_CLOSED still fills in both IDs.
+*/
+int resolve_stations(const char *from, const char *to, int *src, int *dest) {
+    STATS_START(started);
+    int status = lookup_stations(from, to, src, dest);
+    if (status == ROUTE_OK && (station_closed(*src) || station_closed(*dest)))
+        status = ROUTE_ERR_CLOSED;
+    STATS_STOP(resolve, started);
+    return status;
+}
+
+/*
+    resolve_route(from, to, r, src, dest)
+
+    Normalizes both names, resolves them against the cached network
+    and fills r. Returns a ROUTE_* status.
+*/
+int resolve_route(const char *from, const char *to, Route *r, int *src, int *dest) {
+    ensure_network(1);
+
+    int status = resolve_stations(from, to, src, dest);
+    if (status != ROUTE_OK) return status;
+
+    if (!route_between_ids(*src, *dest, r)) return ROUTE_ERR_NO_PATH;
+    return ROUTE_OK;
+}
+
+// Copy a Route into the flat RouteResult layout
+void fill_route_result(const Route *r, RouteResult *out) {
+    out->status = ROUTE_OK;
+    out->station_count = r->len;
+    out->time_min = (r->time_sec + 30) / 60;
+    out->fare = fare_from_distance(r->km);
+    out->interchanges = r->interchanges;
+    out->distance_m = (int)(r->km * 1000.0 + 0.5);
+    for (int i = 0; i < r->len; i++) {
+        out->stations[i] = r->path[i];
+    }
+    for (int i = 0; i < r->len - 1; i++) {
+        out->lines[i] = route_line(r, i);
+    }
+}
+
+// Plain-text route summary (the format get_route() has always returned)
+void format_route_text(TextOut *t, const Route *r) {
+    STATS_START(started);
+    const int *path = r->path;
+    int len = r->len;
+    int edges = len - 1;
+
+    text_lit(t, "Namma Metro — Route Summary\n\nFrom: ");
+    text_str(t, station_name(path[0]));
+    text_lit(t, "\nTo:   ");
+    text_str(t, station_name(path[len - 1]));
+    text_lit(t, "\n\nRoute:\n");
+
+    for (int i = 0; i < len; i++) {
+        if (i > 0) text_lit(t, " -> ");
+        text_str(t, station_name(path[i]));
+    }
+    text_lit(t, "\n\n");
+
+    // segments by line
+    text_lit(t, "Segments by line:\n");
+    int i = 0;
+    while (i < len - 1) {
+        int s = i;
+        int e = i;
+        while (e + 1 < len - 1 && route_line(r, e + 1) == route_line(r, s)) {
+            e++;
+        }
+
+        text_lit(t, " - Line ");
+        text_str(t, line_names[route_line(r, s)]);
+        text_lit(t, ": ");
+        text_str(t, station_name(path[s]));
+        text_lit(t, " -> ");
+        text_str(t, station_name(path[e + 1]));
+        text_lit(t, " (");
+        text_int(t, e - s + 1);
+        text_lit(t, " stops)\n");
+
+        i = e + 1;
+    }
+
+    text_lit(t, "\nInterchanges:\n");
+    if (r->interchanges == 0) {
+        text_lit(t, " - None\n");
+    } else {
+        for (int k = 1; k < len - 1; k++) {
+            if (route_line(r, k) != route_line(r, k - 1)) {
+                text_lit(t, " - ");
+                text_str(t, station_name(path[k]));
+                text_lit(t, " (");
+                text_str(t, line_names[route_line(r, k - 1)]);
+                text_lit(t, " -> ");
+                text_str(t, line_names[route_line(r, k)]);
+                text_lit(t, ")\n");
+            }
+        }
+    }
+
+    text_lit(t, "\nSummary:\n - Total stops: ");
+    text_int(t, edges);
+    text_lit(t, "\n - Distance   : ");
+    text_km(t, r->km);
+    text_lit(t, " km\n - Time       : ");
+    text_int(t, (r->time_sec + 30) / 60);
+    text_lit(t, " min (incl. interchange buffer)\n - Fare est.  : Rs ");
+    text_int(t, fare_from_distance(r->km));
+    text_char(t, '\n');
+    STATS_STOP(render, started);
+}
+
+/*
+    JSON route summary:
+
+      {"status":0,"stops":..,"distance_km":..,"time_min":..,"fare":..,
+       "interchanges":..,"stations":[{"id":..,"name":".."},...],
+       "segments":[{"line":"..","from":..,"to":..,"stops":..},...]}
+
+    Segment from/to are station IDs.
+*/
+void format_route_json(TextOut *t, const Route *r) {
+    STATS_START(started);
+    const int *path = r->path;
+    int len = r->len;
+
+    text_lit(t, "{\"status\":0,\"stops\":");
+    text_int(t, len - 1);
+    text_lit(t, ",\"distance_km\":");
+    text_km(t, r->km);
+    text_lit(t, ",\"time_min\":");
+    text_int(t, (r->time_sec + 30) / 60);
+    text_lit(t, ",\"fare\":");
+    text_int(t, fare_from_distance(r->km));
+    text_lit(t, ",\"interchanges\":");
+    text_int(t, r->interchanges);
+
+    text_lit(t, ",\"stations\":[");
+    for (int i = 0; i < len; i++) {
+        if (i > 0) text_char(t, ',');
+        text_lit(t, "{\"id\":");
+        text_int(t, path[i]);
+        text_lit(t, ",\"name\":");
+        text_json(t, station_name(path[i]));
+        text_char(t, '}');
+    }
+
+    text_lit(t, "],\"segments\":[");
+    int i = 0;
+    while (i < len - 1) {
+        int s = i;
+        int e = i;
+        while (e + 1 < len - 1 && route_line(r, e + 1) == route_line(r, s)) {
+            e++;
+        }
+        if (s > 0) text_char(t, ',');
+        text_lit(t, "{\"line\":");
+        text_json(t, line_names[route_line(r, s)]);
+        text_lit(t, ",\"from\":");
+        text_int(t, path[s]);
+        text_lit(t, ",\"to\":");
+        text_int(t, path[e + 1]);
+        text_lit(t, ",\"stops\":");
+        text_int(t, e - s + 1);
+        text_char(t, '}');
+        i = e + 1;
+    }
+    text_lit(t, "]}");
+    STATS_STOP(render, started);
+}
+
+// Text for a failed lookup
+void format_route_error(TextOut *t, int status, const char *from, const char *to) {
+    switch (status) {
+    case ROUTE_ERR_NOT_LOADED:
+        text_printf(t, "Error: station data not loaded.");
+        break;
+    case ROUTE_ERR_NO_INPUT:
+        text_printf(t, "Please provide both source and destination.");
+        break;
+    case ROUTE_ERR_NOT_FOUND:
+        text_printf(t, "Stations not found:\n - From: %s\n - To: %s\n"
+                       "Check spellings or station availability.", from, to);
+        break;
+    case ROUTE_ERR_SRC:
+        text_printf(t, "Start station not found: %s\n"
+                       "Check spelling or choose another station.", from);
+        break;
+    case ROUTE_ERR_DEST:
+        text_printf(t, "Destination station not found: %s\n"
+                       "Check spelling or choose another station.", to);
+        break;
+    case ROUTE_ERR_CLOSED:
+        text_printf(t, "Station closed: no service from '%s' to '%s' right now.\n"
+                       "Choose a nearby open station.", from, to);
+        break;
+    case ROUTE_ERR_NO_SERVICE:
+        text_printf(t, "No more trains from '%s' to '%s' today.\n"
+                       "Service resumes with the first train.", from, to);
+        break;
+    default:
+        text_printf(t, "No route found between '%s' and '%s'.", from, to);
+        break;
+    }
+}
+
+// JSON for a failed lookup: {"status":N,"error":"<same text as above>"}
+void format_route_error_json(TextOut *t, int status, const char *from, const char *to) {
+    char msg[512];
+    TextOut m = text_fixed(msg, sizeof msg);
+
+    format_route_error(&m, status, from, to);
+    text_lit(t, "{\"status\":");
+    text_int(t, status);
+    text_lit(t, ",\"error\":");
+    text_json(t, text_cstr(&m));
+    text_char(t, '}');
+}
+
+/*
+    set_route_strategy(strategy)
+
+    Chooses the point-to-point search used when the route table is off:
+    0 = Dijkstra, 1 = A* (default), 2 = bidirectional Dijkstra.
+    Returns the strategy now in effect.
+*/
+EMSCRIPTEN_KEEPALIVE
+int set_route_strategy(int strategy) {
+    if (strategy >= ROUTE_STRATEGY_DIJKSTRA && strategy <= ROUTE_STRATEGY_BIDIR)
+        route_strategy = strategy;
+    return route_strategy;
+}
+
+// Nodes settled by the last find_route() search (0 for table lookups)
+EMSCRIPTEN_KEEPALIVE
+int last_nodes_expanded(void) {
+    return last_search_expanded;
+}
+
+// =============================================================
+// ROUTE RESULT CACHE (REPEATED OD QUERIES)
+// =============================================================
+/*
+    Commuter queries repeat a handful of pairs, so the single-route
+    entry points keep the last result_cache_cap answers:
+
+      key     : (src, dest, include_planned flag, route options:
+                strategy and table mode)
+      value   : status, the Route, and its text / JSON summaries,
+                each rendered the first time it is asked for
+      epoch   : network_version; an entry from an older network (a
+                rebuild, load or edit) is recomputed on its next use
+
+    Entries sit on a most-recent-first list (LRU victim at the tail)
+    and in hash chains keyed on the pair. Name lookup still runs per
+    call (it is cheap); failed lookups are never cached. Single-
+    threaded like the rest of the query API; batch workers bypass it.
+*/
+#define RESULT_CACHE_DEFAULT 64
+#define RESULT_CACHE_MAX     4096
+
+typedef struct {
+    int src, dest;              // -1 = free entry
+    int planned, options;
+    unsigned version;           // network_version the result is for
+    int status;                 // ROUTE_OK or ROUTE_ERR_NO_PATH
+    Route route;
+    TextOut text, json;         // rendered summaries (arenas)
+    int has_text, has_json;
+    int prev, next;             // LRU list, -1 ends
+    int chain;                  // next entry in the same bucket
+} CachedRoute;
+
+CachedRoute *result_cache = NULL;
+int *result_cache_bucket = NULL;
+int result_cache_cap = RESULT_CACHE_DEFAULT;
+int result_cache_mask = 0;      // buckets - 1
+int result_cache_used = 0;
+int result_cache_head = -1;     // most recently used
+int result_cache_tail = -1;     // next victim
+long result_cache_hits = 0, result_cache_misses = 0;
+long result_cache_evictions = 0, result_cache_stale = 0;
+
+// Route options that can change the answer for a pair
+int result_cache_options(void) {
+    return route_strategy | (route_table_enabled << 4);
+}
+
+unsigned result_cache_hash(int src, int dest) {
+    return ((unsigned)src * 2654435761u) ^ ((unsigned)dest * 40503u);
+}
+
+void result_cache_free(void) {
+    if (result_cache) {
+        for (int i = 0; i < result_cache_cap; i++) {
+            text_free(&result_cache[i].text);
+            text_free(&result_cache[i].json);
+        }
+    }
+    free(result_cache);
+    free(result_cache_bucket);
+    result_cache = NULL;
+    result_cache_bucket = NULL;
+    result_cache_used = 0;
+    result_cache_head = result_cache_tail = -1;
+}
+
+// Allocate the entries and buckets on first use; 0 if disabled or out of memory
+int result_cache_init(void) {
+    if (result_cache) return 1;
+    if (result_cache_cap <= 0) return 0;
+
+    int buckets = 1;
+    while (buckets < 2 * result_cache_cap) buckets *= 2;
+    result_cache = calloc((size_t)result_cache_cap, sizeof *result_cache);
+    result_cache_bucket = malloc((size_t)buckets * sizeof *result_cache_bucket);
+    if (!result_cache || !result_cache_bucket) {
+        result_cache_free();
+        return 0;
+    }
+    result_cache_mask = buckets - 1;
+    fill_int(result_cache_bucket, buckets, -1);
+    for (int i = 0; i < result_cache_cap; i++) {
+        result_cache[i].src = -1;
+        result_cache[i].text = text_arena();
+        result_cache[i].json = text_arena();
+    }
+    return 1;
+}
+
+void result_cache_unlink(int i) {
+    CachedRoute *e = &result_cache[i];
+    if (e->prev >= 0) result_cache[e->prev].next = e->next;
+    else result_cache_head = e->next;
+    if (e->next >= 0) result_cache[e->next].prev = e->prev;
+    else result_cache_tail = e->prev;
+}
+
+void result_cache_push_front(int i) {
+    CachedRoute *e = &result_cache[i];
+    e->prev = -1;
+    e->next = result_cache_head;
+    if (result_cache_head >= 0) result_cache[result_cache_head].prev = i;
+    result_cache_head = i;
+    if (result_cache_tail < 0) result_cache_tail = i;
+}
+
+// Take entry i out of its hash chain
+void result_cache_unchain(int i) {
+    CachedRoute *e = &result_cache[i];
+    int *link = &result_cache_bucket[result_cache_hash(e->src, e->dest) & result_cache_mask];
+    while (*link != i) link = &result_cache[*link].chain;
+    *link = e->chain;
+}
+
+// Compute the route for e's key into e
+void result_cache_fill(CachedRoute *e) {
+    e->version = network_version;
+    e->status = route_between_ids(e->src, e->dest, &e->route) ? ROUTE_OK : ROUTE_ERR_NO_PATH;
+    text_reset(&e->text);
+    text_reset(&e->json);
+    e->has_text = e->has_json = 0;
+}
+
+/*
+    cached_route(src, dest)
+
+    Result for a pair of valid station IDs, from the cache when an
+    entry for the current key and network_version exists. The entry
+    stays valid until the next cached_route() call. With the cache
+    disabled a private entry is recomputed every time.
+*/
+CachedRoute *cached_route(int src, int dest) {
+    static CachedRoute uncached;
+    int planned = network_planned;
+    int options = result_cache_options();
+
+    if (!result_cache_init()) {
+        result_cache_misses++;
+        uncached.src = src;
+        uncached.dest = dest;
+        uncached.text.grows = uncached.json.grows = 1;
+        result_cache_fill(&uncached);
+        return &uncached;
+    }
+
+    int *bucket = &result_cache_bucket[result_cache_hash(src, dest) & result_cache_mask];
+    for (int i = *bucket; i >= 0; i = result_cache[i].chain) {
+        CachedRoute *e = &result_cache[i];
+        if (e->src != src || e->dest != dest || e->planned != planned || e->options != options)
+            continue;
+        result_cache_unlink(i);
+        result_cache_push_front(i);
+        if (e->version == network_version) {
+            result_cache_hits++;
+        } else {
+            result_cache_misses++;
+            result_cache_stale++;
+            result_cache_fill(e);
+        }
+        return e;
+    }
+
+    // miss: take a free entry, or evict the least recently used one
+    int i;
+    result_cache_misses++;
+    if (result_cache_used < result_cache_cap) {
+        i = result_cache_used++;
+    } else {
+        i = result_cache_tail;
+        result_cache_unlink(i);
+        result_cache_unchain(i);
+        result_cache_evictions++;
+    }
+
+    CachedRoute *e = &result_cache[i];
+    e->src = src;
+    e->dest = dest;
+    e->planned = planned;
+    e->options = options;
+    e->chain = *bucket;
+    *bucket = i;
+    result_cache_push_front(i);
+    result_cache_fill(e);
+    return e;
+}
+
+// Text summary of a cached ROUTE_OK result (see format_route_text)
+const TextOut *cached_route_text(CachedRoute *e) {
+    if (!e->has_text) {
+        format_route_text(&e->text, &e->route);
+        e->has_text = 1;
+    }
+    return &e->text;
+}
+
+// JSON summary of a cached ROUTE_OK result (see format_route_json)
+const TextOut *cached_route_json(CachedRoute *e) {
+    if (!e->has_json) {
+        format_route_json(&e->json, &e->route);
+        e->has_json = 1;
+    }
+    return &e->json;
+}
+
+/*
+    resolve_cached(from, to, status)
+
+    Names -> IDs, then cached_route(). Returns the entry, or NULL with
+    *status set when the names do not resolve (or a station is closed).
+*/
+CachedRoute *resolve_cached(const char *from, const char *to, int *status) {
+    int src, dest;
+
+    ensure_network(1);
+    *status = resolve_stations(from, to, &src, &dest);
+    if (*status != ROUTE_OK) return NULL;
+
+    CachedRoute *e = cached_route(src, dest);
+    *status = e->status;
+    return e;
+}
+
+/*
+    set_result_cache_size(entries)
+
+    Resizes (and empties) the result cache; 0 turns it off. Clamped to
+    RESULT_CACHE_MAX. Returns the new capacity.
+*/
+EMSCRIPTEN_KEEPALIVE
+int set_result_cache_size(int entries) {
+    result_cache_free();
+    result_cache_cap = entries < 0 ? 0 : entries > RESULT_CACHE_MAX ? RESULT_CACHE_MAX : entries;
+    return result_cache_cap;
+}
+
+/*
+    get_result_cache_stats(out)
+
+    out[0..5] = hits, misses, evictions, stale (misses on an entry from
+    an older network_version), entries in use, capacity. Counters are
+    cumulative; reset_result_cache_stats() zeroes them.
+*/
+EMSCRIPTEN_KEEPALIVE
+void get_result_cache_stats(int *out) {
+    out[0] = (int)result_cache_hits;
+    out[1] = (int)result_cache_misses;
+    out[2] = (int)result_cache_evictions;
+    out[3] = (int)result_cache_stale;
+    out[4] = result_cache_used;
+    out[5] = result_cache_cap;
+}
+
+EMSCRIPTEN_KEEPALIVE
+void reset_result_cache_stats(void) {
+    result_cache_hits = result_cache_misses = 0;
+    result_cache_evictions = result_cache_stale = 0;
+}
+
+// =============================================================
+// WEBASSEMBLY ENTRY: get_route_text(from, to, out, out_size)
+// =============================================================
+/*
+    Reentrant text API: writes the summary into the caller's buffer
+    (always NUL-terminated when out_size > 0) and returns the full
+    length it needed, excluding the NUL. A result >= out_size means
+    the text was cut short; retry with a buffer of result + 1 bytes.
+*/
+EMSCRIPTEN_KEEPALIVE
+int get_route_text(const char *from, const char *to, char *out, int out_size) {
+    int status;
+    TextOut t = text_fixed(out, out_size > 0 ? (size_t)out_size : 0);
+
+    CachedRoute *e = resolve_cached(from, to, &status);
+    if (status == ROUTE_OK) {
+        const TextOut *summary = cached_route_text(e);
+        text_put(&t, text_cstr(summary), summary->len);
+    } else {
+        format_route_error(&t, status, from, to);
+    }
+
+    return (int)t.len;
+}
+
+// =============================================================
+// WEBASSEMBLY ENTRY: get_route_json(from, to, out, out_size)
+// =============================================================
+/*
+    Same contract as get_route_text(), but the summary is a JSON
+    object (see format_route_json); failures give {"status","error"}.
+*/
+EMSCRIPTEN_KEEPALIVE
+int get_route_json(const char *from, const char *to, char *out, int out_size) {
+    int status;
+    TextOut t = text_fixed(out, out_size > 0 ? (size_t)out_size : 0);
+
+    CachedRoute *e = resolve_cached(from, to, &status);
+    if (status == ROUTE_OK) {
+        const TextOut *summary = cached_route_json(e);
+        text_put(&t, text_cstr(summary), summary->len);
+    } else {
+        format_route_error_json(&t, status, from, to);
+    }
+
+    return (int)t.len;
+}
+
+// =============================================================
+// WEBASSEMBLY ENTRY: get_route_result(from, to, out)
+// =============================================================
+/*
+    Structured API: fills *out (see RouteResult) and returns its status.
+    route_result_size() lets JS allocate the struct with _malloc.
+*/
+EMSCRIPTEN_KEEPALIVE
+int get_route_result(const char *from, const char *to, RouteResult *out) {
+    int status;
+
+    CachedRoute *e = resolve_cached(from, to, &status);
+    if (status == ROUTE_OK) {
+        fill_route_result(&e->route, out);
+    } else {
+        out->status = status;
+        out->station_count = 0;
+    }
+    return status;
+}
+
+// Same as get_route_result(), addressed by station ID
+EMSCRIPTEN_KEEPALIVE
+int get_route_result_ids(int src, int dest, RouteResult *out) {
+    ensure_network(1);
+    out->status = ROUTE_ERR_NO_INPUT;
+    out->station_count = 0;
+    if (src < 0 || dest < 0 || src >= stationCount || dest >= stationCount)
+        return out->status;
+
+    out->status = ROUTE_ERR_CLOSED;
+    if (station_closed(src) || station_closed(dest))
+        return out->status;
+
+    CachedRoute *e = cached_route(src, dest);
+    out->status = e->status;
+    if (e->status != ROUTE_OK)
+        return out->status;
+
+    fill_route_result(&e->route, out);
+    return ROUTE_OK;
+}
+
+/*
+    get_alternates_ids(src, dest, k, out)
+
+    Fastest route plus up to k - 1 genuinely different alternatives
+    (Yen's k-shortest paths), written to out[0..] cheapest first.
+    out must hold k RouteResult structs. Returns how many were filled.
+*/
+EMSCRIPTEN_KEEPALIVE
+int get_alternates_ids(int src, int dest, int k, RouteResult *out) {
+    Route primary;
+
+    ensure_network(1);
+    if (k <= 0 || src < 0 || dest < 0 || src >= stationCount || dest >= stationCount)
+        return 0;
+    if (!route_between_ids(src, dest, &primary))
+        return 0;
+
+    fill_route_result(&primary, &out[0]);
+    if (k == 1) return 1;
+
+    Route *alts = malloc((size_t)(k - 1) * sizeof *alts);
+    if (!alts) return 1;
+
+    int n = find_alternates(&primary, k - 1, alts);
+    for (int a = 0; a < n; a++)
+        fill_route_result(&alts[a], &out[a + 1]);
+    free(alts);
+    return n + 1;
+}
+
+EMSCRIPTEN_KEEPALIVE
+int route_result_size(void) {
+    return (int)sizeof(RouteResult);
+}
+
+// Display name of station ID (read-only; NULL when out of range)
+EMSCRIPTEN_KEEPALIVE
+const char *get_station_name(int id) {
+    if (id < 0 || id >= stationCount) return NULL;
+    return station_name(id);
+}
+
+// Name of line ID (read-only; NULL when out of range)
+EMSCRIPTEN_KEEPALIVE
+const char *get_line_name(int id) {
+    if (id < 0 || id >= lineCount) return NULL;
+    return line_names[id];
+}
+
+/*
+    get_autocomplete(text, include_planned, out, max)
+
+    Ranked suggestions for what the user has typed so far (any case or
+    punctuation): writes up to max station IDs to out, best first, and
+    returns how many were written.
+*/
+EMSCRIPTEN_KEEPALIVE
+int get_autocomplete(const char *text, int include_planned, int *out, int max) {
+    char key[80];
+
+    ensure_network(include_planned);
+    if (!text || !out) return 0;
+    strncpy(key, text, 79);
+    key[79] = '\0';
+    normalize_inplace(key);
+    return autocomplete_ids(key, include_planned, out, max);
+}
+
+// =============================================================
+// TIMETABLE ROUTING (CONNECTION SCAN)
+// =============================================================
+/*
+    The searches above price a trip by running time alone. This engine
+    answers "leaving at 08:30, when am I there?" against the trains
+    that actually run.
+
+    Service is given per line the way GTFS frequencies.txt gives a
+    frequency-based trip: from start_time until end_time a train
+    leaves each terminal every headway_secs. route_id is the line
+    name; times count from midnight of the service day and may pass
+    24:00:00 for trains after midnight.
+
+        route_id,start_time,end_time,headway_secs
+        purple,05:00:00,08:00:00,600
+        purple,08:00:00,11:00:00,240
+
+    A line's first band starts its first train; its last train is the
+    last departure before the final end_time. Lines with no bands
+    (every line until a timetable is loaded) run default_service[].
+
+    Trains call at every station of their line and take adj_sec over
+    each segment, so a ride costs what the static router says and the
+    difference is waiting. The day's trains become one array of
+    connections (one train over one segment) sorted by departure; a
+    query is a single forward scan from the first departure at or
+    after the requested time (Connection Scan Algorithm), which stops
+    once departures are later than the best arrival at the target.
+
+    Changing trains takes INTERCHANGE_SEC. Closures apply as in the
+    other searches: nobody boards or alights at a closed station
+    (trains run through it) and no train runs a closed segment.
+*/
+#define SERVICE_MAX_BANDS 256
+#define SERVICE_DAY_SEC   (24 * 3600)
+#define TIME_NEVER        0x7fffffff    // station not reached
+
+typedef struct {
+    char line[30];              // line name, matched when connections are built
+    int start;                  // first departure, seconds after midnight
+    int end;                    // no departures at or after this
+    int headway;                // seconds between trains
+} ServiceBand;
+
+// Roughly the published weekday pattern: 10 minutes off-peak, 4 at the peaks
+const ServiceBand default_service[] = {
+    { "",  5 * 3600,  8 * 3600, 600 },
+    { "",  8 * 3600, 11 * 3600, 240 },
+    { "", 11 * 3600, 17 * 3600, 480 },
+    { "", 17 * 3600, 21 * 3600, 240 },
+    { "", 21 * 3600, 23 * 3600, 600 },
+};
+#define DEFAULT_SERVICE_BANDS ((int)(sizeof default_service / sizeof default_service[0]))
+
+ServiceBand service_bands[SERVICE_MAX_BANDS];
+int service_band_count = 0;     // bands from load_timetable_text()
+unsigned timetable_version = 0; // bumped by every timetable load
+
+typedef struct {
+    int dep_time;               // seconds after midnight of the service day
+    int arr_time;
+    int trip;                   // train, 0 .. trip_count - 1
+    int slot;                   // CSR slot ridden, from -> to
+    unsigned short from;        // station IDs
+    unsigned short to;
+} Connection;
+
+Connection *connections = NULL;
+int connection_count = 0;
+int trip_count = 0;
+int connections_ready = 0;
+unsigned connections_build = 0; // network_build the array was made for
+unsigned connections_timetable = 0;     // timetable_version it was made for
+
+/*
+    Scan state (one query at a time):
+
+      arrive[s]   : earliest arrival at s, TIME_NEVER if not reached
+      ready[s]    : earliest departure that can be caught at s
+                    (arrival + INTERCHANGE_SEC; the request time at src)
+      in_conn[s]  : connection that set arrive[s], -1 at the source
+      in_board[s] : connection where that train was boarded
+      trip_board  : per trip, the connection boarded, -1 = not aboard
+*/
+typedef struct {
+    int arrive[MAX];
+    int ready[MAX];
+    int in_conn[MAX];
+    int in_board[MAX];
+    int *trip_board;
+} ScanState;
+
+ScanState scan_state;
+
+/*
+    Journey: a timetable answer.
+
+    route    : stations and segments ridden, as from the router, except
+               that route.time_sec = arrive_sec - depart_sec (waits
+               included)
+    times[i] : when the train leaves route.path[i]; the arrival time
+               at the last station
+*/
+typedef struct {
+    int depart_sec;             // requested departure
+    int arrive_sec;
+    Route route;
+    int times[MAX];
+} Journey;
+
+// Seconds a train takes over CSR slot k (never 0, so arrivals follow departures)
+int connection_sec(int k) {
+    return adj_sec[k] > 0 ? adj_sec[k] : 1;
+}
+
+// CSR slot leaving s on line l other than back to prev, -1 at a terminal
+int line_next_slot(int s, int l, int prev) {
+    for (int k = adj_offset[s]; k < adj_offset[s + 1]; k++) {
+        if (adj_line[k] == l && adj_nbr[k] != prev) return k;
+    }
+    return -1;
+}
+
+// Slots of line l from terminal s to the other end; returns how many
+int line_walk(int l, int s, int *slots) {
+    int n = 0, prev = -1;
+    while (n < MAX - 1) {
+        int k = line_next_slot(s, l, prev);
+        if (k < 0) break;
+        slots[n++] = k;
+        prev = s;
+        s = adj_nbr[k];
+    }
+    return n;
+}
+
+/*
+    line_departures(l, out)
+
+    Departure times of line l's trains from each terminal, band by
+    band, into out (when not NULL). Returns how many there are.
+*/
+int line_departures(int l, int *out) {
+    int own = 0, n = 0;
+    for (int i = 0; i < service_band_count; i++)
+        if (strcmp(service_bands[i].line, line_names[l]) == 0) own = 1;
+    const ServiceBand *bands = own ? service_bands : default_service;
+    int nb = own ? service_band_count : DEFAULT_SERVICE_BANDS;
+
+    for (int b = 0; b < nb; b++) {
+        if (own && strcmp(bands[b].line, line_names[l]) != 0) continue;
+        for (int dep = bands[b].start; dep < bands[b].end; dep += bands[b].headway) {
+            if (out) out[n] = dep;
+            n++;
+        }
+    }
+    return n;
+}
+
+int connection_cmp(const void *a, const void *b) {
+    const Connection *x = a, *y = b;
+    if (x->dep_time != y->dep_time) return x->dep_time < y->dep_time ? -1 : 1;
+    return (x->arr_time > y->arr_time) - (x->arr_time < y->arr_time);
+}
+
+/*
+    build_connections()
+
+    Runs every train of every line in both directions and sorts the
+    resulting connections by departure. Sizes the array first so it
+    is allocated once. Returns 1, or 0 if memory ran out.
+*/
+int build_connections(void) {
+    static int slots[MAX];
+    int nc = 0, nt = 0, most = 1;
+
+    free(connections);
+    free(scan_state.trip_board);
+    connections = NULL;
+    scan_state.trip_board = NULL;
+    connection_count = trip_count = 0;
+    connections_ready = 0;
+
+    for (int l = 0; l < lineCount; l++) {
+        int d = line_departures(l, NULL);
+        if (d > most) most = d;
+        for (int dir = 0; dir < 2; dir++) {
+            int n = line_walk(l, dir ? line_last[l] : line_first[l], slots);
+            nc += n * d;
+            nt += n > 0 ? d : 0;
+        }
+    }
+
+    int *deps = malloc((size_t)most * sizeof *deps);
+    connections = malloc((size_t)(nc > 0 ? nc : 1) * sizeof *connections);
+    scan_state.trip_board = malloc((size_t)(nt > 0 ? nt : 1) * sizeof(int));
+    if (!deps || !connections || !scan_state.trip_board) {
+        free(deps);
+        free(connections);
+        free(scan_state.trip_board);
+        connections = NULL;
+        scan_state.trip_board = NULL;
+        return 0;
+    }
+
+    for (int l = 0; l < lineCount; l++) {
+        int d = line_departures(l, deps);
+        for (int dir = 0; dir < 2; dir++) {
+            int origin = dir ? line_last[l] : line_first[l];
+            int n = line_walk(l, origin, slots);
+            if (n == 0) continue;
+
+            for (int i = 0; i < d; i++) {
+                int t = deps[i], s = origin;
+                for (int k = 0; k < n; k++) {
+                    Connection *c = &connections[connection_count++];
+                    c->dep_time = t;
+                    t += connection_sec(slots[k]);
+                    c->arr_time = t;
+                    c->trip = trip_count;
+                    c->slot = slots[k];
+                    c->from = (unsigned short)s;
+                    s = adj_nbr[slots[k]];
+                    c->to = (unsigned short)s;
+                }
+                trip_count++;
+            }
+        }
+    }
+    free(deps);
+
+    qsort(connections, (size_t)connection_count, sizeof *connections, connection_cmp);
+    connections_build = network_build;
+    connections_timetable = timetable_version;
+    connections_ready = 1;
+    return 1;
+}
+
+// Connections for the current network, built on first use; 0 if out of memory
+int connections_usable(void) {
+    if (connections_ready && connections_build == network_build &&
+        connections_timetable == timetable_version)
+        return 1;
+    return build_connections();
+}
+
+/*
+    service_clock(sec)
+
+    Maps a time of day onto the service day: a time before the first
+    train that the previous day's service still covers (its trains
+    past 24:00) is read as that, e.g. 00:20 as 24:20.
+*/
+int service_clock(int sec) {
+    if (connection_count > 0 && sec < connections[0].dep_time &&
+        sec + SERVICE_DAY_SEC <= connections[connection_count - 1].dep_time)
+        return sec + SERVICE_DAY_SEC;
+    return sec;
+}
+
+/*
+    connection_scan(src, depart, dest)
+
+    Earliest arrival at every station when leaving src at depart, or
+    with dest >= 0 only until no later departure can improve dest.
+    Leaves the answer in scan_state. The connections must be usable.
+*/
+void connection_scan(int src, int depart, int dest) {
+    ScanState *st = &scan_state;
+
+    for (int s = 0; s < stationCount; s++) {
+        st->arrive[s] = st->ready[s] = TIME_NEVER;
+        st->in_conn[s] = st->in_board[s] = -1;
+    }
+    for (int t = 0; t < trip_count; t++)
+        st->trip_board[t] = -1;
+    if (station_closed(src)) return;
+    st->arrive[src] = st->ready[src] = depart;
+
+    // first departure at or after depart
+    int lo = 0, hi = connection_count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (connections[mid].dep_time < depart) lo = mid + 1;
+        else hi = mid;
+    }
+
+    for (int i = lo; i < connection_count; i++) {
+        const Connection *c = &connections[i];
+        if (dest >= 0 && c->dep_time >= st->arrive[dest]) break;
+
+        // aboard already, or can catch it (closed stations are never ready)
+        int *board = &st->trip_board[c->trip];
+        if (*board < 0) {
+            if (st->ready[c->from] > c->dep_time) continue;
+            *board = i;
+        }
+        if (closed_slot_count > 0 && bit_test(closed_slot, c->slot)) {
+            *board = -1;        // the train turns back here; nobody rides on
+            continue;
+        }
+        if (c->arr_time < st->arrive[c->to] && !station_closed(c->to)) {
+            st->arrive[c->to] = c->arr_time;
+            st->ready[c->to] = c->arr_time + INTERCHANGE_SEC;
+            st->in_conn[c->to] = i;
+            st->in_board[c->to] = *board;
+        }
+    }
+}
+
+/*
+    journey_from_scan(src, dest, j)
+
+    Rebuilds the journey to dest from scan_state: follows each train
+    back to where it was boarded, then replays the legs forward along
+    their lines. Returns 1, or 0 if dest was not reached.
+*/
+int journey_from_scan(int src, int dest, Journey *j) {
+    static int board[MAX], alight[MAX];
+    const ScanState *st = &scan_state;
+    Route *r = &j->route;
+    int legs = 0;
+
+    if (st->arrive[dest] == TIME_NEVER) return 0;
+    for (int s = dest; s != src && legs < MAX; legs++) {
+        board[legs] = st->in_board[s];
+        alight[legs] = st->in_conn[s];
+        s = connections[board[legs]].from;
+    }
+
+    r->len = 0;
+    r->km = 0.0;
+    r->interchanges = legs > 0 ? legs - 1 : 0;
+    for (int g = legs - 1; g >= 0; g--) {
+        const Connection *first = &connections[board[g]];
+        int end = connections[alight[g]].to;
+        int s = first->from, k = first->slot, t = first->dep_time;
+
+        while (1) {
+            if (r->len >= MAX - 1) return 0;
+            r->path[r->len] = s;
+            r->edge_slot[r->len] = k;
+            j->times[r->len] = t;
+            r->len++;
+            r->km += adj_km[k];
+            t += connection_sec(k);
+            int prev = s;
+            s = adj_nbr[k];
+            if (s == end) break;
+            k = line_next_slot(s, adj_line[k], prev);
+            if (k < 0) return 0;
+        }
+    }
+    r->path[r->len] = dest;
+    j->times[r->len] = st->arrive[dest];
+    r->len++;
+
+    j->arrive_sec = st->arrive[dest];
+    r->time_sec = j->arrive_sec - j->depart_sec;
+    return 1;
+}
+
+/*
+    find_journey(src, dest, depart, j)
+
+    Earliest arrival at dest leaving src no earlier than depart
+    (seconds after midnight of the service day), into *j. Returns
+    ROUTE_OK, ROUTE_ERR_CLOSED, ROUTE_ERR_NO_SERVICE when trains
+    earlier in the day would have made it, or ROUTE_ERR_NO_PATH.
+*/
+int find_journey(int src, int dest, int depart, Journey *j) {
+    if (station_closed(src) || station_closed(dest)) return ROUTE_ERR_CLOSED;
+
+    j->depart_sec = depart;
+    if (src == dest) {
+        j->arrive_sec = depart;
+        j->times[0] = depart;
+        j->route.len = 1;
+        j->route.path[0] = src;
+        j->route.interchanges = 0;
+        j->route.time_sec = 0;
+        j->route.km = 0.0;
+        return ROUTE_OK;
+    }
+    if (!connections_usable()) return ROUTE_ERR_NO_PATH;
+
+    connection_scan(src, depart, dest);
+    if (journey_from_scan(src, dest, j)) return ROUTE_OK;
+
+    connection_scan(src, 0, dest);
+    return scan_state.arrive[dest] != TIME_NEVER ? ROUTE_ERR_NO_SERVICE : ROUTE_ERR_NO_PATH;
+}
+
+/*
+    timetable_eta(src, dest, clock, &board, &arrive)
+
+    For the CLI summary: when the first train leaves and when it gets
+    there, leaving at time of day clock. Both are seconds after
+    midnight (past 24:00 after midnight). Returns 1, 0 once the last
+    train that would have made it has left, or -1 if no train can.
+*/
+int timetable_eta(int src, int dest, int clock, int *board, int *arrive) {
+    static Journey j;
+    if (!connections_usable()) return -1;
+
+    int status = find_journey(src, dest, service_clock(clock), &j);
+    if (status != ROUTE_OK) return status == ROUTE_ERR_NO_SERVICE ? 0 : -1;
+    *board = j.times[0];
+    *arrive = j.arrive_sec;
+    return 1;
+}
+
+// "H:MM[:SS]" as seconds after midnight (hours up to 47); 0 if malformed
+int parse_service_time(const char *s, int *sec) {
+    int h, m, x = 0, n = 0;
+    if (sscanf(s, "%d:%d%n", &h, &m, &n) != 2) return 0;
+    if (s[n] == ':') {
+        int more = 0;
+        if (sscanf(s + n + 1, "%d%n", &x, &more) != 1) return 0;
+        n += 1 + more;
+    }
+    if (s[n] != '\0' || h < 0 || h > 47 || m < 0 || m > 59 || x < 0 || x > 59) return 0;
+    *sec = h * 3600 + m * 60 + x;
+    return 1;
+}
+
+/*
+    parse_timetable(text, len, bands)
+
+    Reads the GTFS frequencies-style CSV above: a header row naming
+    the columns (in any order, others ignored), then one band per
+    row. Returns the number of bands, or -1 (see network_error).
+*/
+int parse_timetable(const char *text, size_t len, ServiceBand *bands) {
+    enum { COL_ROUTE, COL_START, COL_END, COL_HEADWAY, COLS };
+    static const char *names[COLS] = { "route_id", "start_time", "end_time", "headway_secs" };
+    int col[COLS] = { -1, -1, -1, -1 };
+    int count = 0, lineno = 0, header = 1;
+    size_t pos = 0;
+
+    while (pos < len) {
+        char buf[256];
+        char *field[32];
+        int nf = 0;
+
+        size_t end = pos;
+        while (end < len && text[end] != '\n') end++;
+        lineno++;
+        if (end - pos >= sizeof buf)
+            return network_fail("timetable line %d: too long", lineno);
+        memcpy(buf, text + pos, end - pos);
+        buf[end - pos] = '\0';
+        pos = end + 1;
+
+        // split on commas, trimming blanks and quotes from each field
+        for (char *p = buf; nf < 32; p++) {
+            char *f = p;
+            while (*p && *p != ',') p++;
+            int last = *p == '\0';
+            *p = '\0';
+            while (*f && (isspace((unsigned char)*f) || *f == '"')) f++;
+            int e = (int)strlen(f) - 1;
+            while (e >= 0 && (isspace((unsigned char)f[e]) || f[e] == '"')) f[e--] = '\0';
+            field[nf++] = f;
+            if (last) break;
+        }
+        if (nf == 1 && field[0][0] == '\0') continue;
+
+        if (header) {
+            for (int i = 0; i < nf; i++)
+                for (int c = 0; c < COLS; c++)
+                    if (strcmp(field[i], names[c]) == 0) col[c] = i;
+            for (int c = 0; c < COLS; c++)
+                if (col[c] < 0) return network_fail("timetable has no %s column", names[c]);
+            header = 0;
+            continue;
+        }
+
+        ServiceBand b;
+        for (int c = 0; c < COLS; c++)
+            if (col[c] >= nf) return network_fail("timetable line %d: too few fields", lineno);
+        const char *line = field[col[COL_ROUTE]];
+        char *rest;
+        long headway = strtol(field[col[COL_HEADWAY]], &rest, 10);
+        if (!line[0] || strlen(line) >= sizeof b.line)
+            return network_fail("timetable line %d: bad route_id", lineno);
+        if (!parse_service_time(field[col[COL_START]], &b.start) ||
+            !parse_service_time(field[col[COL_END]], &b.end) || b.end <= b.start)
+            return network_fail("timetable line %d: bad start_time or end_time", lineno);
+        if (*rest || headway <= 0 || headway > SERVICE_DAY_SEC)
+            return network_fail("timetable line %d: bad headway_secs", lineno);
+        if (count >= SERVICE_MAX_BANDS)
+            return network_fail("timetable has more than %d bands", SERVICE_MAX_BANDS);
+        strcpy(b.line, line);
+        b.headway = (int)headway;
+        bands[count++] = b;
+    }
+
+    if (header) return network_fail("timetable is empty");
+    return count;
+}
+
+/*
+    load_timetable_source(text, len)
+
+    Replaces the service bands with those of a frequencies CSV; with
+    no bands at all every line goes back to default_service[]. The
+    current timetable is kept when the text does not parse. Returns
+    the number of bands, or -1.
+*/
+int load_timetable_source(const char *text, size_t len) {
+    static ServiceBand parsed[SERVICE_MAX_BANDS];
+
+    int count = parse_timetable(text, len, parsed);
+    if (count < 0) return -1;
+    memcpy(service_bands, parsed, (size_t)count * sizeof parsed[0]);
+    service_band_count = count;
+    timetable_version++;
+    return count;
+}
+
+// =============================================================
+// WEBASSEMBLY ENTRY: load_timetable_text(text)
+// =============================================================
+/*
+    load_timetable_source() for a NUL-terminated CSV; NULL or "" goes
+    back to default_service[]. Returns the number of bands, or -1
+    (see get_network_error).
+*/
+EMSCRIPTEN_KEEPALIVE
+int load_timetable_text(const char *text) {
+    if (text && text[0]) return load_timetable_source(text, strlen(text));
+    service_band_count = 0;
+    timetable_version++;
+    return 0;
+}
+
+// =============================================================
+// WEBASSEMBLY ENTRY: get_journey_ids(src, dest, depart_sec, out, times)
+// =============================================================
+/*
+    Timetable version of get_route_result_ids(): the earliest arrival
+    leaving src at depart_sec (seconds after midnight). out->time_min
+    is door to door, waiting included. When times is not NULL it gets
+    station_count ints: the departure from each station, then the
+    arrival at the last (seconds after midnight; past 86400 for
+    trains after midnight). Returns the status, ROUTE_ERR_NO_SERVICE
+    once the last train that would have made it has left.
+*/
+EMSCRIPTEN_KEEPALIVE
+int get_journey_ids(int src, int dest, int depart_sec, RouteResult *out, int *times) {
+    static Journey j;
+
+    ensure_network(1);
+    out->status = ROUTE_ERR_NO_INPUT;
+    out->station_count = 0;
+    if (src < 0 || dest < 0 || src >= stationCount || dest >= stationCount)
+        return out->status;
+
+    if (connections_usable()) depart_sec = service_clock(depart_sec);
+    out->status = find_journey(src, dest, depart_sec, &j);
+    if (out->status != ROUTE_OK)
+        return out->status;
+
+    fill_route_result(&j.route, out);
+    if (times) memcpy(times, j.times, (size_t)j.route.len * sizeof(int));
+    return ROUTE_OK;
+}
+
+/*
+    load_timetable_file(path)
+
+    --timetable: load_timetable_text() for a file. Returns the number
+    of bands, or -1 (see network_error).
+*/
+int load_timetable_file(const char *path) {
+    size_t size = 0;
+    int kind = IMAGE_MALLOC;
+    unsigned char *buf = read_network_file(path, &size, &kind);
+    if (!buf) return network_fail("cannot read %s", path);
+
+    int count = load_timetable_source((const char *)buf, size);
+    free_network_buffer(buf, size, kind);
+    return count;
+}
+
+/*
+    get_arrivals_from(src, depart_sec, out_sec)
+
+    One scan for every destination: writes the earliest arrival at
+    each station (seconds after midnight, -1 = not reachable today)
+    into out_sec, which must hold station_count() ints. Returns the
+    station count, or -1 if src is invalid or memory ran out.
+*/
+EMSCRIPTEN_KEEPALIVE
+int get_arrivals_from(int src, int depart_sec, int *out_sec) {
+    ensure_network(1);
+    if (src < 0 || src >= stationCount || !connections_usable()) return -1;
+
+    connection_scan(src, service_clock(depart_sec), -1);
+    for (int s = 0; s < stationCount; s++)
+        out_sec[s] = scan_state.arrive[s] == TIME_NEVER ? -1 : scan_state.arrive[s];
+    return stationCount;
+}
+
+// =============================================================
+// PARETO ROUTING (RAPTOR ROUNDS OVER LINE ROUTES)
+// =============================================================
+/*
+    One query, every sensible trade-off: the journeys leaving at a
+    given time that no other journey beats on arrival, interchanges
+    and fare at once (e.g. "09:30, one change, Rs 60" next to "09:36,
+    direct, Rs 70").
+
+    RAPTOR works on routes instead of connections: each line in each
+    direction is a route whose stops are the line's stations in order
+    and whose trips are the timetable's departures from the first
+    stop. All trains of a line run the same times between stops, so
+    the train at stop i is at trip_start + offset[i] and the first
+    catchable one is a binary search. Round k finds journeys of
+    exactly k trains: each route through a station improved in round
+    k - 1 is scanned once, from that stop on, carrying its riders.
+
+    A label is (arrival, distance ridden); fares rise with distance,
+    so a shorter ride never costs more. Every station keeps a small
+    Pareto bag per round, and a new label is dropped when one from
+    the same or an earlier round there (or at the target) is no later
+    and no longer. The answers are the target's labels of all rounds,
+    filtered once more on (arrival, changes, fare).
+
+    Service, interchange and closure rules are the connection scan's,
+    so the fastest answer is find_journey()'s.
+*/
+#define RAPTOR_MAX_ROUNDS 6             // trains per journey (5 changes)
+#define RAPTOR_BAG        8             // labels per station and round
+#define RAPTOR_MAX_ROUTES (2 * MAX_LINES)
+#define RAPTOR_MAX_STOPS  (2 * (MAX_EDGES + MAX_LINES))
+#define MAX_PARETO        8             // journeys one query returns at most
+
+typedef struct {
+    int stops;                  // stations on the route
+    int first_stop;             // into the raptor_stop[] arrays
+    int first_trip;             // into raptor_trip[]
+    int trips;
+} RaptorRoute;
+
+RaptorRoute raptor_routes[RAPTOR_MAX_ROUTES];
+int raptor_route_count = 0;
+int raptor_stop[RAPTOR_MAX_STOPS];      // station at each stop
+int raptor_slot[RAPTOR_MAX_STOPS];      // CSR slot on to the next stop, -1 at the end
+int raptor_offset[RAPTOR_MAX_STOPS];    // seconds after the first stop
+int raptor_dist[RAPTOR_MAX_STOPS];      // metres from the first stop
+int *raptor_trip = NULL;                // departures from the first stop, ascending per route
+int raptor_ready = 0;
+unsigned raptor_build = 0;              // network_build the routes were made for
+unsigned raptor_timetable = 0;          // timetable_version they were made for
+
+// routes calling at each station, station-major: (route, stop index) pairs
+int raptor_at_offset[MAX + 1];
+int raptor_at_route[RAPTOR_MAX_STOPS];
+int raptor_at_stop[RAPTOR_MAX_STOPS];
+
+typedef struct {
+    int arr;                    // seconds after midnight
+    int dist;                   // metres ridden
+    int trip;                   // into raptor_trip[], -1 at the source
+    short route;                // ridden to get here
+    short board;                // stop indices on that route
+    short alight;
+    short parent;               // label boarded from: previous round, boarding station
+} RaptorLabel;
+
+typedef struct {
+    RaptorLabel bag[RAPTOR_MAX_ROUNDS + 1][MAX][RAPTOR_BAG];
+    unsigned char bag_len[RAPTOR_MAX_ROUNDS + 1][MAX];
+    int rounds;                 // rounds the last scan ran
+} RaptorState;
+
+RaptorState *raptor_state = NULL;
+
+int int_cmp(const void *a, const void *b) {
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+/*
+    build_raptor_routes()
+
+    One route per line and direction, with its stop times and sorted
+    departures, plus the station -> (route, stop) index. Returns 1, or
+    0 if memory ran out.
+*/
+int build_raptor_routes(void) {
+    static int slots[MAX];
+    int total = 0, stops = 0, trips = 0;
+
+    free(raptor_trip);
+    raptor_trip = NULL;
+    raptor_ready = 0;
+    raptor_route_count = 0;
+    if (!raptor_state && !(raptor_state = malloc(sizeof *raptor_state))) return 0;
+
+    for (int l = 0; l < lineCount; l++)
+        total += 2 * line_departures(l, NULL);
+    raptor_trip = malloc((size_t)(total > 0 ? total : 1) * sizeof *raptor_trip);
+    if (!raptor_trip) return 0;
+
+    for (int l = 0; l < lineCount; l++) {
+        for (int dir = 0; dir < 2; dir++) {
+            int s = dir ? line_last[l] : line_first[l];
+            int n = line_walk(l, s, slots);
+            if (n == 0 || raptor_route_count >= RAPTOR_MAX_ROUTES ||
+                stops + n + 1 > RAPTOR_MAX_STOPS)
+                continue;
+
+            RaptorRoute *r = &raptor_routes[raptor_route_count++];
+            r->stops = n + 1;
+            r->first_stop = stops;
+            r->first_trip = trips;
+            int t = 0, m = 0;
+            for (int i = 0; i <= n; i++) {
+                raptor_stop[stops + i] = s;
+                raptor_offset[stops + i] = t;
+                raptor_dist[stops + i] = m;
+                raptor_slot[stops + i] = i < n ? slots[i] : -1;
+                if (i == n) break;
+                t += connection_sec(slots[i]);
+                m += (int)(adj_km[slots[i]] * 1000.0 + 0.5);
+                s = adj_nbr[slots[i]];
+            }
+            stops += n + 1;
+
+            // departures sorted, a train listed by two bands kept once
+            int *dep = raptor_trip + trips;
+            int d = line_departures(l, dep), u = 0;
+            qsort(dep, (size_t)d, sizeof *dep, int_cmp);
+            for (int i = 0; i < d; i++)
+                if (u == 0 || dep[i] != dep[u - 1]) dep[u++] = dep[i];
+            r->trips = u;
+            trips += u;
+        }
+    }
+
+    for (int s = 0; s <= stationCount; s++)
+        raptor_at_offset[s] = 0;
+    for (int i = 0; i < stops; i++)
+        raptor_at_offset[raptor_stop[i] + 1]++;
+    for (int s = 0; s < stationCount; s++)
+        raptor_at_offset[s + 1] += raptor_at_offset[s];
+    int fill[MAX];
+    for (int s = 0; s < stationCount; s++)
+        fill[s] = raptor_at_offset[s];
+    for (int r = 0; r < raptor_route_count; r++) {
+        for (int i = 0; i < raptor_routes[r].stops; i++) {
+            int s = raptor_stop[raptor_routes[r].first_stop + i];
+            raptor_at_route[fill[s]] = r;
+            raptor_at_stop[fill[s]] = i;
+            fill[s]++;
+        }
+    }
+
+    raptor_build = network_build;
+    raptor_timetable = timetable_version;
+    raptor_ready = 1;
+    return 1;
+}
+
+// Routes for the current network and timetable; 0 if out of memory
+int raptor_usable(void) {
+    if (raptor_ready && raptor_build == network_build && raptor_timetable == timetable_version)
+        return 1;
+    return build_raptor_routes();
+}
+
+// 1 if a label of round 0..k at s is no later than arr and no longer than dist
+int raptor_dominated(const RaptorState *st, int k, int s, int arr, int dist) {
+    for (int j = 0; j <= k; j++) {
+        const RaptorLabel *bag = st->bag[j][s];
+        for (int i = 0; i < st->bag_len[j][s]; i++)
+            if (bag[i].arr <= arr && bag[i].dist <= dist) return 1;
+    }
+    return 0;
+}
+
+// Add l to round k's bag at s unless beaten there or at dest; drops what l beats
+void raptor_insert(RaptorState *st, int k, int s, const RaptorLabel *l, int dest) {
+    if (raptor_dominated(st, k, s, l->arr, l->dist)) return;
+    if (dest >= 0 && dest != s && raptor_dominated(st, k, dest, l->arr, l->dist)) return;
+
+    RaptorLabel *bag = st->bag[k][s];
+    int n = 0;
+    for (int i = 0; i < st->bag_len[k][s]; i++)
+        if (!(l->arr <= bag[i].arr && l->dist <= bag[i].dist)) bag[n++] = bag[i];
+    if (n < RAPTOR_BAG) bag[n++] = *l;
+    st->bag_len[k][s] = (unsigned char)n;
+}
+
+/*
+    raptor_scan_route(st, k, r, start, dest)
+
+    Round k over route r from stop start: at each stop the riders
+    alight into the station's bag first, then every round k - 1 label
+    there boards the first train it can catch. A rider is dropped if
+    another is on the same or an earlier train with no more distance
+    (distances are kept relative to the first stop so they compare).
+*/
+void raptor_scan_route(RaptorState *st, int k, int r, int start, int dest) {
+    const RaptorRoute *rt = &raptor_routes[r];
+    const int *stop = raptor_stop + rt->first_stop;
+    const int *off = raptor_offset + rt->first_stop;
+    const int *dist = raptor_dist + rt->first_stop;
+    const int *slot = raptor_slot + rt->first_stop;
+    const int *trip = raptor_trip + rt->first_trip;
+    struct { int trip, board, dist, parent; } ride[RAPTOR_BAG];
+    int riders = 0;
+
+    for (int i = start; i < rt->stops; i++) {
+        int s = stop[i];
+        if (!station_closed(s)) {
+            for (int b = 0; b < riders; b++) {
+                RaptorLabel l;
+                l.arr = trip[ride[b].trip] + off[i];
+                l.dist = ride[b].dist + dist[i];
+                l.trip = rt->first_trip + ride[b].trip;
+                l.route = (short)r;
+                l.board = (short)ride[b].board;
+                l.alight = (short)i;
+                l.parent = (short)ride[b].parent;
+                raptor_insert(st, k, s, &l, dest);
+            }
+        }
+        if (i == rt->stops - 1) break;
+        if (closed_slot_count > 0 && bit_test(closed_slot, slot[i])) {
+            riders = 0;         // trains turn back here
+            continue;
+        }
+        if (station_closed(s)) continue;
+
+        for (int p = 0; p < st->bag_len[k - 1][s]; p++) {
+            const RaptorLabel *from = &st->bag[k - 1][s][p];
+            int ready = from->arr + (k > 1 ? INTERCHANGE_SEC : 0) - off[i];
+            int lo = 0, hi = rt->trips;
+            while (lo < hi) {
+                int mid = lo + (hi - lo) / 2;
+                if (trip[mid] < ready) lo = mid + 1;
+                else hi = mid;
+            }
+            if (lo == rt->trips) continue;
+
+            int d = from->dist - dist[i], beaten = 0, n = 0;
+            for (int b = 0; b < riders && !beaten; b++)
+                beaten = ride[b].trip <= lo && ride[b].dist <= d;
+            if (beaten) continue;
+            for (int b = 0; b < riders; b++)
+                if (!(lo <= ride[b].trip && d <= ride[b].dist)) ride[n++] = ride[b];
+            riders = n;
+            if (riders == RAPTOR_BAG) continue;
+            ride[riders].trip = lo;
+            ride[riders].board = i;
+            ride[riders].dist = d;
+            ride[riders].parent = p;
+            riders++;
+        }
+    }
+}
+
+/*
+    raptor_scan(src, dest, depart)
+
+    Runs rounds 1.. until no station improves (or RAPTOR_MAX_ROUNDS),
+    leaving the bags in raptor_state. dest >= 0 prunes labels the
+    target already beats. The routes must be usable.
+*/
+void raptor_scan(int src, int dest, int depart) {
+    RaptorState *st = raptor_state;
+    int from[RAPTOR_MAX_ROUTES];
+
+    memset(st->bag_len, 0, sizeof st->bag_len);
+    st->rounds = 0;
+    if (station_closed(src)) return;
+    RaptorLabel origin = { depart, 0, -1, -1, -1, -1, -1 };
+    st->bag[0][src][0] = origin;
+    st->bag_len[0][src] = 1;
+
+    for (int k = 1; k <= RAPTOR_MAX_ROUNDS; k++) {
+        int any = 0;
+        for (int r = 0; r < raptor_route_count; r++)
+            from[r] = -1;
+        for (int s = 0; s < stationCount; s++) {
+            if (st->bag_len[k - 1][s] == 0) continue;
+            for (int a = raptor_at_offset[s]; a < raptor_at_offset[s + 1]; a++) {
+                int r = raptor_at_route[a], i = raptor_at_stop[a];
+                if (from[r] < 0 || i < from[r]) from[r] = i;
+                any = 1;
+            }
+        }
+        if (!any) break;
+
+        for (int r = 0; r < raptor_route_count; r++)
+            if (from[r] >= 0) raptor_scan_route(st, k, r, from[r], dest);
+        st->rounds = k;
+    }
+}
+
+/*
+    raptor_journey(k, s, i, depart, j)
+
+    Rebuilds the journey of label i in round k's bag at s (one leg per
+    round, followed back through the parents), into *j.
+*/
+void raptor_journey(int k, int s, int i, int depart, Journey *j) {
+    const RaptorState *st = raptor_state;
+    RaptorLabel legs[RAPTOR_MAX_ROUNDS];
+    Route *r = &j->route;
+    int dest = s, n = 0;
+
+    j->depart_sec = depart;
+    j->arrive_sec = st->bag[k][s][i].arr;
+    for (; k > 0; k--) {
+        const RaptorLabel *l = &st->bag[k][s][i];
+        legs[n++] = *l;
+        s = raptor_stop[raptor_routes[l->route].first_stop + l->board];
+        i = l->parent;
+    }
+
+    r->len = 0;
+    r->km = 0.0;
+    r->interchanges = n > 0 ? n - 1 : 0;
+    while (n-- > 0) {
+        const RaptorRoute *rt = &raptor_routes[legs[n].route];
+        for (int p = legs[n].board; p < legs[n].alight; p++) {
+            int k2 = raptor_slot[rt->first_stop + p];
+            r->path[r->len] = raptor_stop[rt->first_stop + p];
+            r->edge_slot[r->len] = k2;
+            j->times[r->len] = raptor_trip[legs[n].trip] + raptor_offset[rt->first_stop + p];
+            r->km += adj_km[k2];
+            r->len++;
+        }
+    }
+    r->path[r->len] = dest;
+    j->times[r->len] = j->arrive_sec;
+    r->len++;
+    r->time_sec = j->arrive_sec - depart;
+}
+
+// Kilometres ridden by label i of round k at s (summed as Route.km is)
+double raptor_label_km(int k, int s, int i) {
+    const RaptorState *st = raptor_state;
+    double km = 0.0;
+    for (; k > 0; k--) {
+        const RaptorLabel *l = &st->bag[k][s][i];
+        const RaptorRoute *rt = &raptor_routes[l->route];
+        for (int p = l->board; p < l->alight; p++)
+            km += adj_km[raptor_slot[rt->first_stop + p]];
+        s = raptor_stop[rt->first_stop + l->board];
+        i = l->parent;
+    }
+    return km;
+}
+
+/*
+    find_pareto_journeys(src, dest, depart, out, max)
+
+    The journeys from src to dest leaving at depart (seconds after
+    midnight of the service day) that no other beats on arrival,
+    changes and fare together, earliest arrival first, into
+    out[0 .. max). Returns how many; 0 if there are none (see
+    find_journey() for why) or memory ran out.
+*/
+int find_pareto_journeys(int src, int dest, int depart, Journey *out, int max) {
+    struct { int k, i, arr, changes, fare; } cand[RAPTOR_MAX_ROUNDS * RAPTOR_BAG];
+    int nc = 0, count = 0;
+
+    if (max <= 0 || station_closed(src) || station_closed(dest)) return 0;
+    if (src == dest) return find_journey(src, dest, depart, &out[0]) == ROUTE_OK;
+    if (!raptor_usable()) return 0;
+
+    raptor_scan(src, dest, depart);
+    const RaptorState *st = raptor_state;
+    for (int k = 1; k <= st->rounds; k++) {
+        for (int i = 0; i < st->bag_len[k][dest]; i++) {
+            cand[nc].k = k;
+            cand[nc].i = i;
+            cand[nc].arr = st->bag[k][dest][i].arr;
+            cand[nc].changes = k - 1;
+            cand[nc].fare = fare_from_distance(raptor_label_km(k, dest, i));
+            nc++;
+        }
+    }
+
+    // keep the non-dominated ones (the first of equals), in arrival order
+    while (count < max) {
+        int best = -1;
+        for (int a = 0; a < nc; a++) {
+            if (cand[a].k < 0) continue;
+            int beaten = 0;
+            for (int b = 0; b < nc && !beaten; b++) {
+                if (b == a || cand[b].k == -2) continue;
+                int le = cand[b].arr <= cand[a].arr && cand[b].changes <= cand[a].changes &&
+                         cand[b].fare <= cand[a].fare;
+                int same = cand[b].arr == cand[a].arr && cand[b].changes == cand[a].changes &&
+                           cand[b].fare == cand[a].fare;
+                beaten = le && (!same || b < a);
+            }
+            if (beaten) {
+                cand[a].k = -2;         // out for good
+                continue;
+            }
+            if (best < 0 || cand[a].arr < cand[best].arr ||
+                (cand[a].arr == cand[best].arr && cand[a].changes < cand[best].changes))
+                best = a;
+        }
+        if (best < 0) break;
+        raptor_journey(cand[best].k, dest, cand[best].i, depart, &out[count++]);
+        cand[best].k = -1;              // taken; still beats the others
+    }
+    return count;
+}
+
+// =============================================================
+// WEBASSEMBLY ENTRY: get_pareto_journeys(src, dest, depart_sec, max, out, times)
+// =============================================================
+/*
+    Every worthwhile option in one call: the journeys leaving src at
+    depart_sec that no other beats on arrival, changes and fare, in
+    arrival order (so the last has the fewest changes or the lowest
+    fare). out must hold max RouteResult structs; out[i].time_min is
+    door to door. When times is not NULL journey i's station times
+    (as get_journey_ids() gives them) start at times[i * MAX], MAX
+    being the length of RouteResult.stations. Returns how many
+    journeys were written; with none, out[0].status says why.
+*/
+EMSCRIPTEN_KEEPALIVE
+int get_pareto_journeys(int src, int dest, int depart_sec, int max, RouteResult *out, int *times) {
+    static Journey found[MAX_PARETO];
+
+    ensure_network(1);
+    if (max <= 0) return 0;
+    out[0].status = ROUTE_ERR_NO_INPUT;
+    out[0].station_count = 0;
+    if (src < 0 || dest < 0 || src >= stationCount || dest >= stationCount)
+        return 0;
+
+    if (connections_usable()) depart_sec = service_clock(depart_sec);
+    if (max > MAX_PARETO) max = MAX_PARETO;
+    int n = find_pareto_journeys(src, dest, depart_sec, found, max);
+    if (n == 0) {
+        out[0].status = find_journey(src, dest, depart_sec, &found[0]);
+        if (out[0].status == ROUTE_OK) out[0].status = ROUTE_ERR_NO_PATH;
+        return 0;
+    }
+
+    for (int i = 0; i < n; i++) {
+        fill_route_result(&found[i].route, &out[i]);
+        if (times)
+            memcpy(times + (size_t)i * MAX, found[i].times, (size_t)found[i].route.len * sizeof(int));
+    }
+    return n;
+}
+
+/*
+    print_journey_options(src, dest, clock)
+
+    For the CLI summary: the Pareto options leaving at time of day
+    clock, one line each, when there is more than one.
+*/
+void print_journey_options(int src, int dest, int clock) {
+    static Journey found[MAX_PARETO];
+
+    if (!connections_usable()) return;
+    int n = find_pareto_journeys(src, dest, service_clock(clock), found, MAX_PARETO);
+    if (n < 2) return;
+
+    printf("\n%sOptions (time, changes, fare):%s\n", CLR_BOLD, CLR_RESET);
+    for (int i = 0; i < n; i++) {
+        const Journey *j = &found[i];
+        char board[40], arrive[40];
+        format_clock(board, sizeof board, j->times[0]);
+        format_clock(arrive, sizeof arrive, j->arrive_sec);
+        printf(" - %s -> %s  %3d min  %d change%s  Rs %d\n", board, arrive,
+               (j->route.time_sec + 30) / 60, j->route.interchanges,
+               j->route.interchanges == 1 ? " " : "s", fare_from_distance(j->route.km));
+    }
+}
+
+// =============================================================
+// PACKED ROUTE RECORDS + NAMES TABLE (TYPED-ARRAY UI PATH)
+// =============================================================
+/*
+    What a page needs to draw a route without parsing any text: a
+    packed int record per query, and every name once at startup.
+
+    get_route_packed() record (ints, only as long as the route):
+
+      [0] status  [1] station_count n  [2] minutes  [3] fare (Rs)
+      [4] interchanges c  [5] distance_m
+      [6 .. 6+n)            station IDs
+      [6+n .. 6+2n-1)       line ID of each segment
+      [6+2n-1 .. +c)        route index of each interchange station
+
+    It matches the worker's route buffer with the interchange indices
+    appended. The names table is every station's display name in ID
+    order, then every line name, each NUL-terminated, so one decode
+    and a split give both lists.
+*/
+#define PACKED_HEADER 6
+#define PACKED_ROUTE_INTS (PACKED_HEADER + 3 * MAX)
+
+char names_table[MAX * 80 + MAX_LINES * 30];
+int names_table_len = 0;
+int names_table_ready = 0;
+unsigned names_table_build = 0;         // network_build the table was made for
+
+/*
+    get_names_table(size_out)
+
+    Returns the names table for the current network (read-only, valid
+    until the next network load) and its length in bytes through
+    size_out.
+*/
+EMSCRIPTEN_KEEPALIVE
+const char *get_names_table(int *size_out) {
+    ensure_network(1);
+    if (!names_table_ready || names_table_build != network_build) {
+        size_t len = 0;
+        for (int s = 0; s < stationCount; s++) {
+            size_t l = strlen(station_name(s)) + 1;
+            memcpy(names_table + len, station_name(s), l);
+            len += l;
+        }
+        for (int l = 0; l < lineCount; l++) {
+            size_t ln = strlen(line_names[l]) + 1;
+            memcpy(names_table + len, line_names[l], ln);
+            len += ln;
+        }
+        names_table_len = (int)len;
+        names_table_build = network_build;
+        names_table_ready = 1;
+    }
+    if (size_out) *size_out = names_table_len;
+    return names_table;
+}
+
+/*
+    get_line_stations(line, out)
+
+    Station IDs of a line in travel order, from its first terminal,
+    into out (which must hold station_count() ints). Returns how many,
+    or -1 for an unknown line.
+*/
+EMSCRIPTEN_KEEPALIVE
+int get_line_stations(int line, int *out) {
+    static int slots[MAX];
+
+    ensure_network(1);
+    if (line < 0 || line >= lineCount) return -1;
+    int s = line_first[line];
+    int n = line_walk(line, s, slots);
+    out[0] = s;
+    for (int i = 0; i < n; i++)
+        out[i + 1] = adj_nbr[slots[i]];
+    return n + 1;
+}
+
+/*
+    get_route_packed(src, dest, out)
+
+    Fastest route src -> dest as a packed record (layout above) in out,
+    which must hold route_packed_size() bytes. Returns the number of
+    ints written; a failed lookup writes just the header, with the
+    reason in out[0].
+*/
+EMSCRIPTEN_KEEPALIVE
+int get_route_packed(int src, int dest, int *out) {
+    static RouteResult r;
+
+    get_route_result_ids(src, dest, &r);
+    int n = r.status == ROUTE_OK ? r.station_count : 0;
+    int edges = n > 0 ? n - 1 : 0;
+    int *stations_out = out + PACKED_HEADER;
+    int *lines_out = stations_out + n;
+    int *changes_out = lines_out + edges;
+    int c = 0;
+
+    memcpy(stations_out, r.stations, (size_t)n * sizeof(int));
+    memcpy(lines_out, r.lines, (size_t)edges * sizeof(int));
+    for (int i = 1; i < edges; i++)
+        if (r.lines[i] != r.lines[i - 1]) changes_out[c++] = i;
+
+    out[0] = r.status;
+    out[1] = n;
+    out[2] = n ? r.time_min : 0;
+    out[3] = n ? r.fare : 0;
+    out[4] = c;
+    out[5] = n ? r.distance_m : 0;
+    return PACKED_HEADER + n + edges + c;
+}
+
+EMSCRIPTEN_KEEPALIVE
+int route_packed_size(void) {
+    return (int)(PACKED_ROUTE_INTS * sizeof(int));
+}
+
+// =============================================================
+// PARALLEL BATCH (TASK POOL)
+// =============================================================
+/*
+    A batch job is cut into independent tasks (one source station, or
+    one block of input lines). batch_threads workers pull task numbers
+    from a shared counter until none are left, so a slow source does
+    not hold up the rest.
+
+    The network is a frozen snapshot while a job runs: the caller
+    builds it (and the route table) first, and the workers only read
+    it. Each worker searches in its own BatchWorker, never in
+    route_scratch or the source-tree cache, so a result does not
+    depend on the thread count or on which worker computed it.
+
+    Threads need -DMETRO_THREADS -pthread natively, or emcc -pthread
+    ("build_wasm.sh threads"); otherwise every task runs on the
+    calling thread.
+*/
+#define MAX_BATCH_THREADS 64
+
+typedef struct {
+    SearchScratch sc;
+    SearchScratch back;         // second scratch for BIDIR
+    SourceTree tree;            // tree.sc == &sc
+    Route route;
+    IsoStation iso[MAX];        // --isochrone result of the current source
+    TextOut scratch;            // per-row formatting space
+    int answered;               // pairs answered in the current job
+} BatchWorker;
+
+typedef void (*BatchTask)(void *job, int task, BatchWorker *w);
+
+typedef struct {
+    BatchTask run;
+    void *job;
+    int count;
+    int next;                   // next task to hand out
+#ifdef METRO_THREADS
+    pthread_mutex_t lock;
+#endif
+} BatchPool;
+
+typedef struct {
+    BatchPool *pool;
+    BatchWorker *worker;
+} BatchThread;
+
+int batch_threads = 1;
+BatchWorker *batch_workers[MAX_BATCH_THREADS];
+
+// Worker i's scratch, allocated on first use and kept for later jobs
+BatchWorker *batch_worker(int i) {
+    if (!batch_workers[i]) {
+        BatchWorker *w = malloc(sizeof *w);
+        if (!w) return NULL;
+        w->tree.src = -1;
+        w->tree.sc = &w->sc;
+        w->scratch = text_arena();
+        batch_workers[i] = w;
+    }
+    batch_workers[i]->answered = 0;
+    return batch_workers[i];
+}
+
+int batch_next_task(BatchPool *pool) {
+    int task;
+#ifdef METRO_THREADS
+    pthread_mutex_lock(&pool->lock);
+#endif
+    task = pool->next < pool->count ? pool->next++ : -1;
+#ifdef METRO_THREADS
+    pthread_mutex_unlock(&pool->lock);
+#endif
+    return task;
+}
+
+void batch_drain(BatchPool *pool, BatchWorker *w) {
+    for (int task; (task = batch_next_task(pool)) >= 0; )
+        pool->run(pool->job, task, w);
+}
+
+#ifdef METRO_THREADS
+void *batch_thread_main(void *arg) {
+    BatchThread *t = arg;
+    batch_drain(t->pool, t->worker);
+    return NULL;
+}
+#endif
+
+/*
+    run_batch_tasks(count, run, job)
+
+    Calls run(job, task, worker) for task = 0 .. count-1 across the
+    pool; the calling thread works too. Returns how many workers took
+    part (their BatchWorker.answered can be summed), 0 if none could
+    be allocated.
+*/
+int run_batch_tasks(int count, BatchTask run, void *job) {
+    int want = batch_threads < count ? batch_threads : count;
+    int workers = 0;
+
+    while (workers < want && batch_worker(workers)) workers++;
+    if (workers == 0) return 0;
+
+    BatchPool pool;
+    pool.run = run;
+    pool.job = job;
+    pool.count = count;
+    pool.next = 0;
+
+#ifdef METRO_THREADS
+    pthread_t tid[MAX_BATCH_THREADS];
+    BatchThread args[MAX_BATCH_THREADS];
+    int started = 0;
+
+    pthread_mutex_init(&pool.lock, NULL);
+    for (int i = 1; i < workers; i++) {
+        args[i].pool = &pool;
+        args[i].worker = batch_workers[i];
+        if (pthread_create(&tid[i], NULL, batch_thread_main, &args[i]) != 0) break;
+        started = i;
+    }
+    batch_drain(&pool, batch_workers[0]);
+    for (int i = 1; i <= started; i++) pthread_join(tid[i], NULL);
+    pthread_mutex_destroy(&pool.lock);
+    workers = started + 1;
+#else
+    batch_drain(&pool, batch_workers[0]);
+    workers = 1;
+#endif
+    return workers;
+}
+
+/*
+    set_batch_threads(n)
+
+    Workers for batch jobs: n > 0 uses n, 0 uses every core. Builds
+    without thread support always use 1. Returns the count in effect.
+*/
+EMSCRIPTEN_KEEPALIVE
+int set_batch_threads(int n) {
+#ifdef METRO_THREADS
+    if (n <= 0) n = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (n < 1) n = 1;
+    batch_threads = n < MAX_BATCH_THREADS ? n : MAX_BATCH_THREADS;
+#else
+    (void)n;
+    batch_threads = 1;
+#endif
+    return batch_threads;
+}
+
+// Workers batch jobs currently use (what set_batch_threads() last put in effect)
+EMSCRIPTEN_KEEPALIVE
+int get_batch_threads(void) {
+    return batch_threads;
+}
+
+// =============================================================
+// WEBASSEMBLY ENTRY: get_routes_batch(src, dst, count, out)
+// =============================================================
+/*
+    Scores many origin-destination pairs in one call, with no text
+    formatting. For pair i, out[i * BATCH_FIELDS + ...] receives:
+
+      [0] stops travelled   [1] minutes   [2] fare (Rs)   [3] interchanges
+
+    Unknown IDs or unreachable pairs get -1 in every field.
+
+    With the route table ready every pair is a lookup. Otherwise the
+    pairs are bucketed by source (counting sort) and each distinct
+    source is one pool task: a single tree answers all of its pairs.
+
+    Returns the number of pairs that were answered.
+*/
+#define BATCH_FIELDS 4
+
+// Fill one batch record; r == NULL marks the pair unreachable
+void batch_record(int *rec, const Route *r) {
+    if (!r) {
+        rec[0] = rec[1] = rec[2] = rec[3] = -1;
+        return;
+    }
+    rec[0] = r->len - 1;
+    rec[1] = (r->time_sec + 30) / 60;
+    rec[2] = fare_from_distance(r->km);
+    rec[3] = r->interchanges;
+}
+
+typedef struct {
+    const int *dst;
+    int *out;
+    const int *order;           // pair indices grouped by source
+    const int *run_src;         // source station of run k
+    const int *run_start;       // run k is order[run_start[k] .. run_start[k + 1])
+} PairBatchJob;
+
+void pair_batch_task(void *job, int task, BatchWorker *w) {
+    const PairBatchJob *j = job;
+    int s = j->run_src[task];
+
+    if (w->tree.src != s || w->tree.version != network_version)
+        build_source_tree(&w->tree, s);
+
+    for (int pos = j->run_start[task]; pos < j->run_start[task + 1]; pos++) {
+        int i = j->order[pos];
+        int *rec = j->out + (size_t)i * BATCH_FIELDS;
+
+        if (!route_from_source_tree(&w->tree, j->dst[i], &w->route)) {
+            batch_record(rec, NULL);
+            continue;
+        }
+        batch_record(rec, &w->route);
+        w->answered++;
+    }
+}
+
+EMSCRIPTEN_KEEPALIVE
+int get_routes_batch(const int *src, const int *dst, int count, int *out) {
+    int n;
+    int answered = 0;
+
+    ensure_network(1);
+    n = stationCount;
+    if (count <= 0) return 0;
+
+    // fast path: everything is already in the route table
+    if (route_table_usable()) {
+        for (int i = 0; i < count; i++) {
+            int *rec = out + (size_t)i * BATCH_FIELDS;
+            int s = src[i], t = dst[i];
+            if (s < 0 || t < 0 || s >= n || t >= n || rt_start[s * n + t] == RT_NONE) {
+                batch_record(rec, NULL);
+                continue;
+            }
+            rec[0] = rt_hops[s * n + t];
+            rec[1] = (rt_time[s * n + t] + 30) / 60;
+            rec[2] = fare_slab_rs[rt_fare[s * n + t]];
+            rec[3] = rt_changes[s * n + t];
+            answered++;
+        }
+        return answered;
+    }
+
+    // bucket pair indices by source station
+    int *bucket = calloc((size_t)n + 1, sizeof *bucket);
+    int *order = malloc((size_t)count * sizeof *order);
+    int *runs = malloc((2 * (size_t)n + 1) * sizeof *runs);
+    if (!bucket || !order || !runs) {
+        free(bucket); free(order); free(runs);
+        for (int i = 0; i < count; i++)
+            batch_record(out + (size_t)i * BATCH_FIELDS, NULL);
+        return 0;
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (src[i] >= 0 && src[i] < n) bucket[src[i] + 1]++;
+    }
+    for (int s = 0; s < n; s++) bucket[s + 1] += bucket[s];
+    for (int i = 0; i < count; i++) {
+        if (src[i] >= 0 && src[i] < n) {
+            order[bucket[src[i]]++] = i;
+        } else {
+            batch_record(out + (size_t)i * BATCH_FIELDS, NULL);
+        }
+    }
+    // bucket[s] now marks the end of source s's run in order[]
+
+    int *run_src = runs;
+    int *run_start = runs + n;
+    int nruns = 0;
+    int pos = 0;
+    for (int s = 0; s < n; s++) {
+        if (pos == bucket[s]) continue;
+        run_src[nruns] = s;
+        run_start[nruns++] = pos;
+        pos = bucket[s];
+    }
+    run_start[nruns] = pos;
+
+    PairBatchJob job = { dst, out, order, run_src, run_start };
+    int workers = run_batch_tasks(nruns, pair_batch_task, &job);
+    if (workers == 0) {
+        for (int k = 0; k < pos; k++)
+            batch_record(out + (size_t)order[k] * BATCH_FIELDS, NULL);
+    }
+    for (int w = 0; w < workers; w++) answered += batch_workers[w]->answered;
+
+    free(bucket);
+    free(order);
+    free(runs);
+    return answered;
+}
+
+// =============================================================
+// WEBASSEMBLY ENTRY: get_fares_batch(src, dst, count, fare, distance_m)
+// =============================================================
+/*
+    Bulk fare scoring for OD-matrix jobs: for pair i, fare[i] gets
+    the fare (Rs) of the fastest route and distance_m[i] (when not
+    NULL) its length in metres, to the 10 m the route table keeps.
+    Unknown IDs or unreachable pairs get -1 in both.
+
+    With the route table ready each pair is two byte-sized lookups,
+    after od_index() has turned the IDs into table offsets. Without
+    it pairs are answered from cached source trees, so keep them
+    grouped by source. Returns the number of pairs answered.
+*/
+#define FARE_BATCH_CHUNK 256
+
+EMSCRIPTEN_KEEPALIVE
+int get_fares_batch(const int *src, const int *dst, int count, int *fare, int *distance_m) {
+    int idx[FARE_BATCH_CHUNK];
+    int answered = 0;
+
+    ensure_network(1);
+    int n = stationCount;
+
+    if (route_table_usable()) {
+        for (int base = 0; base < count; base += FARE_BATCH_CHUNK) {
+            int m = count - base < FARE_BATCH_CHUNK ? count - base : FARE_BATCH_CHUNK;
+            od_index(src + base, dst + base, m, n, idx);
+            for (int i = 0; i < m; i++) {
+                int x = idx[i];
+                int ok = x >= 0 && rt_start[x] != RT_NONE;
+                fare[base + i] = ok ? fare_slab_rs[rt_fare[x]] : -1;
+                if (distance_m) distance_m[base + i] = ok ? rt_dam[x] * 10 : -1;
+                answered += ok;
+            }
+        }
+        return answered;
+    }
+
+    static Route r;
+    for (int i = 0; i < count; i++) {
+        const SourceTree *t = source_tree(src[i]);
+        if (!t || !route_from_source_tree(t, dst[i], &r)) {
+            fare[i] = -1;
+            if (distance_m) distance_m[i] = -1;
+            continue;
+        }
+        fare[i] = fare_from_distance(r.km);
+        if (distance_m) distance_m[i] = (int)(r.km * 100.0 + 0.5) * 10;
+        answered++;
+    }
+    return answered;
+}
+
+// =============================================================
+// WEBASSEMBLY ENTRY: get_route(from, to)
+// =============================================================
+/*
+    Legacy text API. The returned text belongs to the result cache
+    (or, for a failed lookup, an arena owned here) and is only valid
+    until the next query.
+*/
+EMSCRIPTEN_KEEPALIVE
+const char* get_route(const char* from, const char* to) {
+    static TextOut arena = { NULL, 0, 0, 1 };
+    int status;
+
+    CachedRoute *e = resolve_cached(from, to, &status);
+    if (status == ROUTE_OK)
+        return text_cstr(cached_route_text(e));
+
+    text_reset(&arena);
+    format_route_error(&arena, status, from, to);
+    return text_cstr(&arena);
+}
+
+#ifndef __EMSCRIPTEN__
+// =============================================================
+// BATCH MODE (CLI ONLY)
+// =============================================================
+/*
+    metro --batch FILE|- [--format csv|json] [--threads N]
+
+    Reads one origin-destination pair per line ("from,to"; fields may
+    be CSV-quoted, a tab also separates) and writes one result per
+    line to stdout, in input order. Blank lines, "#" comments and a
+    "from,to" header are skipped. stdout is fully buffered; no colors,
+    no map preview. A throughput line goes to stderr at the end.
+
+    Input is read in blocks of BATCH_BLOCK_PAIRS. Each block is split
+    into BATCH_CHUNK_PAIRS-pair pool tasks that route and format into
+    their own buffer, and the buffers are written in order, so the
+    output is the same for any thread count.
+
+    csv : from,to,status,time_min,fare,interchanges,distance_km,stops,route
+          (route = station names joined by " > "; empty on failure)
+    json: {"from":..,"to":..,"result":<get_route_json() object>}
+
+    status is ROUTE_OK (0) or the ROUTE_ERR_* code.
+*/
+#define BATCH_FORMAT_CSV  0
+#define BATCH_FORMAT_JSON 1
+
+#define BATCH_LINE_MAX    1024
+#define BATCH_BLOCK_PAIRS 4096
+#define BATCH_CHUNK_PAIRS 64
+#define BATCH_CHUNKS      (BATCH_BLOCK_PAIRS / BATCH_CHUNK_PAIRS)
+
+typedef struct {
+    char from[160];
+    char to[160];
+} BatchPair;
+
+// A CSV field, quoted only when it has to be
+void text_csv(TextOut *t, const char *s) {
+    if (!s[strcspn(s, ",\"\r\n")]) {
+        text_str(t, s);
+        return;
+    }
+    text_char(t, '"');
+    for (; *s; s++) {
+        if (*s == '"') text_char(t, '"');
+        text_char(t, *s);
+    }
+    text_char(t, '"');
+}
+
+/*
+    batch_field(p, out, size)
+
+    Copies the next CSV field starting at *p into out (trimmed,
+    unquoted) and moves *p past its separator. Returns 0 if it ended
+    the line.
+*/
+int batch_field(const char **p, char *out, size_t size) {
+    const char *s = *p;
+    size_t n = 0;
+
+    while (*s == ' ') s++;
+    if (*s == '"') {
+        for (s++; *s && !(*s == '"' && s[1] != '"'); s++) {
+            if (*s == '"') s++;                 // "" inside quotes
+            if (n + 1 < size) out[n++] = *s;
+        }
+        if (*s == '"') s++;
+        while (*s && *s != ',' && *s != '\t') s++;
+    } else {
+        for (; *s && *s != ',' && *s != '\t'; s++)
+            if (n + 1 < size) out[n++] = *s;
+        while (n > 0 && (out[n - 1] == ' ' || out[n - 1] == '\r' || out[n - 1] == '\n')) n--;
+    }
+    out[n] = '\0';
+
+    if (*s == ',' || *s == '\t') {
+        *p = s + 1;
+        return 1;
+    }
+    *p = s;
+    return 0;
+}
+
+// "from,to" in any case counts as a header row
+int batch_is_header(const char *from, const char *to) {
+    char a[80], b[80];          // normalize_inplace works in 80-byte keys
+    snprintf(a, sizeof a, "%s", from);
+    snprintf(b, sizeof b, "%s", to);
+    normalize_inplace(a);
+    normalize_inplace(b);
+    return strcmp(a, "from") == 0 && strcmp(b, "to") == 0;
+}
+
+// {"from":..,"to":..,"result":..} for one pair (also a /batch element)
+void batch_json_row(TextOut *t, const char *from, const char *to, int status, const Route *r) {
+    text_lit(t, "{\"from\":");
+    text_json(t, from);
+    text_lit(t, ",\"to\":");
+    text_json(t, to);
+    text_lit(t, ",\"result\":");
+    if (status == ROUTE_OK) format_route_json(t, r);
+    else format_route_error_json(t, status, from, to);
+    text_char(t, '}');
+}
+
+/*
+    batch_format_row(t, format, from, to, status, r, names)
+
+    One output row for a resolved (or failed) pair; names is scratch
+    for the CSV route column.
+*/
+void batch_format_row(TextOut *t, int format, const char *from, const char *to,
+                      int status, const Route *r, TextOut *names) {
+    if (format == BATCH_FORMAT_JSON) {
+        batch_json_row(t, from, to, status, r);
+        text_char(t, '\n');
+        return;
+    }
+
+    text_csv(t, from);
+    text_char(t, ',');
+    text_csv(t, to);
+    text_char(t, ',');
+    text_int(t, status);
+    if (status != ROUTE_OK) {
+        text_lit(t, ",,,,,,\n");
+        return;
+    }
+    STATS_START(started);
+    text_char(t, ',');
+    text_int(t, (r->time_sec + 30) / 60);
+    text_char(t, ',');
+    text_int(t, fare_from_distance(r->km));
+    text_char(t, ',');
+    text_int(t, r->interchanges);
+    text_char(t, ',');
+    text_km(t, r->km);
+    text_char(t, ',');
+    text_int(t, r->len - 1);
+    text_char(t, ',');
+
+    // join into the scratch first so it is quoted as one value
+    text_reset(names);
+    for (int i = 0; i < r->len; i++) {
+        if (i > 0) text_lit(names, " > ");
+        text_str(names, station_name(r->path[i]));
+    }
+    text_csv(t, text_cstr(names));
+    text_char(t, '\n');
+    STATS_STOP(render, started);
+}
+
+typedef struct {
+    const BatchPair *pairs;
+    int count;
+    int format;
+    TextOut *chunks;            // rows of task k
+} LineBatchJob;
+
+// Route and format one chunk of a block (runs on any pool worker)
+void line_batch_task(void *job, int task, BatchWorker *w) {
+    const LineBatchJob *j = job;
+    TextOut *t = &j->chunks[task];
+    int end = (task + 1) * BATCH_CHUNK_PAIRS;
+    if (end > j->count) end = j->count;
+
+    text_reset(t);
+    for (int i = task * BATCH_CHUNK_PAIRS; i < end; i++) {
+        const BatchPair *p = &j->pairs[i];
+        int src, dest;
+        int status = resolve_stations(p->from, p->to, &src, &dest);
+        if (status == ROUTE_OK && !find_route_with(src, dest, &w->route, &w->sc, &w->back))
+            status = ROUTE_ERR_NO_PATH;
+        batch_format_row(t, j->format, p->from, p->to, status, &w->route, &w->scratch);
+    }
+}
+
+// Route a block of pairs on the pool and write the rows in input order
+int batch_block(const BatchPair *pairs, int count, int format, FILE *out) {
+    static TextOut chunks[BATCH_CHUNKS];
+    LineBatchJob job = { pairs, count, format, chunks };
+    int tasks = (count + BATCH_CHUNK_PAIRS - 1) / BATCH_CHUNK_PAIRS;
+
+    for (int k = 0; k < tasks; k++) chunks[k].grows = 1;
+    if (run_batch_tasks(tasks, line_batch_task, &job) == 0) return -1;
+
+    for (int k = 0; k < tasks; k++) {
+        if (chunks[k].len >= chunks[k].cap) return -1;     // ran out of memory
+        fwrite(chunks[k].buf, 1, chunks[k].len, out);
+    }
+    return 0;
+}
+
+// Elapsed seconds, not CPU time (threads make CPU time the wrong measure)
+double wall_seconds(void) {
+    return monotonic_ns() / 1e9;
+}
+
+/*
+    run_batch(path, format)
+
+    --batch: routes every pair in path ("-" = stdin). Returns the
+    process exit status (0 even if some pairs failed; they are rows).
+*/
+int run_batch(const char *path, int format) {
+    static BatchPair pairs[BATCH_BLOCK_PAIRS];
+    static char outbuf[1 << 16];
+    char line[BATCH_LINE_MAX];
+
+    FILE *in = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    if (!in) {
+        fprintf(stderr, "%s: cannot open\n", path);
+        return 1;
+    }
+    setvbuf(stdout, outbuf, _IOFBF, sizeof outbuf);
+
+    ensure_network(1);
+    route_table_usable();
+
+    if (format == BATCH_FORMAT_CSV)
+        fputs("from,to,status,time_min,fare,interchanges,distance_km,stops,route\n", stdout);
+
+    long rows = 0;
+    int n = 0;
+    int first = 1;
+    int failed = 0;
+    double started = wall_seconds();
+
+    while (fgets(line, sizeof line, in)) {
+        if (!strchr(line, '\n') && !feof(in)) {
+            // over-long line: drop the rest of it
+            int c;
+            while ((c = fgetc(in)) != EOF && c != '\n') {}
+        }
+
+        const char *p = line;
+        while (*p == ' ') p++;
+        if (*p == '#' || *p == '\n' || *p == '\r' || *p == '\0') continue;
+
+        BatchPair *pair = &pairs[n];
+        batch_field(&p, pair->from, sizeof pair->from);
+        batch_field(&p, pair->to, sizeof pair->to);
+        if (first) {
+            first = 0;
+            if (batch_is_header(pair->from, pair->to)) continue;
+        }
+        rows++;
+
+        if (++n == BATCH_BLOCK_PAIRS) {
+            if (batch_block(pairs, n, format, stdout) < 0) failed = 1;
+            n = 0;
+        }
+        if (failed) break;
+    }
+    if (!failed && n > 0 && batch_block(pairs, n, format, stdout) < 0) failed = 1;
+    fflush(stdout);
+
+    if (in != stdin) fclose(in);
+    if (failed) {
+        fprintf(stderr, "batch: out of memory\n");
+        return 1;
+    }
+
+    double secs = wall_seconds() - started;
+    fprintf(stderr, "%ld routes in %.3f s on %d thread%s (%.0f routes/s)\n",
+            rows, secs, batch_threads, batch_threads == 1 ? "" : "s",
+            secs > 0 ? rows / secs : 0.0);
+    return 0;
+}
+
+// =============================================================
+// ISOCHRONE MODE (CLI ONLY)
+// =============================================================
+/*
+    metro --isochrone MIN|any [--max-fare RS] [--format csv|json]
+          [--threads N] [FROM ...]
+
+    Writes the isochrone of each FROM station (every station when
+    none is named) to stdout in one run: one bounded search per
+    source, spread over the batch pool, each formatted into its own
+    buffer and written in station order. A throughput line goes to
+    stderr at the end.
+
+    csv : from,to,time_min,fare,interchanges,distance_km,lines
+          (one row per reachable station, the source itself first;
+          lines = names joined by " + ", in line ID order)
+    json: one format_isochrone_json() object per line
+*/
+typedef struct {
+    const int *src;
+    int max_minutes;
+    int max_fare;
+    int format;
+    TextOut *chunks;            // rows of task k
+} IsoBatchJob;
+
+// One source's isochrone, formatted (runs on any pool worker)
+void iso_batch_task(void *job, int task, BatchWorker *w) {
+    const IsoBatchJob *j = job;
+    TextOut *t = &j->chunks[task];
+    int src = j->src[task];
+    int n = isochrone_with(src, iso_max_sec(j->max_minutes), j->max_fare,
+                           w->iso, &w->sc, &w->route);
+
+    text_reset(t);
+    w->answered += n;
+    if (j->format == BATCH_FORMAT_JSON) {
+        format_isochrone_json(t, src, j->max_minutes, j->max_fare, w->iso, n);
+        text_char(t, '\n');
+        return;
+    }
+
+    for (int i = 0; i < n; i++) {
+        const IsoStation *e = &w->iso[i];
+        text_csv(t, station_name(src));
+        text_char(t, ',');
+        text_csv(t, station_name(e->station));
+        text_char(t, ',');
+        text_int(t, (e->time_sec + 30) / 60);
+        text_char(t, ',');
+        text_int(t, e->fare);
+        text_char(t, ',');
+        text_int(t, e->interchanges);
+        text_char(t, ',');
+        text_km(t, e->km);
+        text_char(t, ',');
+
+        text_reset(&w->scratch);
+        for (int l = 0; l < lineCount; l++) {
+            if (!(e->line_mask & (1u << l))) continue;
+            if (w->scratch.len > 0) text_lit(&w->scratch, " + ");
+            text_str(&w->scratch, line_names[l]);
+        }
+        text_csv(t, text_cstr(&w->scratch));
+        text_char(t, '\n');
+    }
+}
+
+/*
+    run_isochrones(names, count, max_minutes, max_fare, format)
+
+    --isochrone: names are the FROM stations (count 0 = all of them).
+    Returns the process exit status; 1 after reporting an unknown name.
+*/
+int run_isochrones(char **names, int count, int max_minutes, int max_fare, int format) {
+    static char outbuf[1 << 16];
+
+    ensure_network(1);
+    int sources = count > 0 ? count : stationCount;
+    int *src = malloc((size_t)(sources > 0 ? sources : 1) * sizeof *src);
+    TextOut *chunks = calloc((size_t)(sources > 0 ? sources : 1), sizeof *chunks);
+    if (!src || !chunks) {
+        free(src);
+        free(chunks);
+        fprintf(stderr, "isochrone: out of memory\n");
+        return 1;
+    }
+
+    for (int i = 0; i < sources; i++) {
+        src[i] = i;
+        if (count == 0) continue;
+        char key[80];
+        strncpy(key, names[i], 79);
+        key[79] = '\0';
+        normalize_inplace(key);
+        src[i] = find_station_id(key, 1);
+        if (src[i] < 0) {
+            fprintf(stderr, "Unknown station: %s\n", names[i]);
+            free(src);
+            free(chunks);
+            return 1;
+        }
+    }
+    for (int i = 0; i < sources; i++) chunks[i].grows = 1;
+
+    setvbuf(stdout, outbuf, _IOFBF, sizeof outbuf);
+    if (format == BATCH_FORMAT_CSV)
+        fputs("from,to,time_min,fare,interchanges,distance_km,lines\n", stdout);
+
+    double started = wall_seconds();
+    IsoBatchJob job = { src, max_minutes, max_fare, format, chunks };
+    int workers = run_batch_tasks(sources, iso_batch_task, &job);
+    int failed = workers == 0;
+    long reached = 0;
+
+    for (int i = 0; i < workers; i++) reached += batch_workers[i]->answered;
+    for (int k = 0; k < sources && !failed; k++) {
+        if (chunks[k].len >= chunks[k].cap && chunks[k].cap > 0) failed = 1;
+        else fwrite(text_cstr(&chunks[k]), 1, chunks[k].len, stdout);
+    }
+    fflush(stdout);
+
+    for (int k = 0; k < sources; k++) text_free(&chunks[k]);
+    free(chunks);
+    free(src);
+    if (failed) {
+        fprintf(stderr, "isochrone: out of memory\n");
+        return 1;
+    }
+
+    double secs = wall_seconds() - started;
+    fprintf(stderr, "%d isochrones (%ld stations) in %.3f s on %d thread%s\n",
+            sources, reached, secs, batch_threads, batch_threads == 1 ? "" : "s");
+    return 0;
+}
+
+// =============================================================
+// HTTP/JSON SERVER (CLI ONLY, -DMETRO_SERVER)
+// =============================================================
+/*
+    metro [--network FILE] --serve [HOST:]PORT [--threads N]
+
+    Serves the network loaded at startup, frozen (no edits), over
+    HTTP/1.1 with keep-alive. Every reply is JSON:
+
+      GET  /route?from=A&to=B            get_route_json() object
+      GET  /alternates?from=A&to=B&k=3   {"status":0,"routes":[..]}
+      GET  /autocomplete?q=TEXT&max=8    {"query":..,"stations":[{"id","name"}]}
+      GET  /isochrone?from=A&minutes=30&fare=40
+                                         format_isochrone_json() object (either
+                                         budget may be left out: no limit)
+      POST /batch                        body: "from,to" lines as for --batch;
+                                         {"results":[..],"count":N} in input order
+
+    One thread runs the event loop (epoll on Linux, kqueue on the
+    BSDs and macOS): it accepts, reads and parses requests and writes
+    replies, never blocking on a socket. A complete request goes to
+    the worker pool (--threads, every core by default, with
+    -DMETRO_THREADS -pthread), which answers it and hands the
+    connection back through a pipe. A connection has at most one
+    request with the workers; pipelined requests wait in its buffer.
+    A body is framed by Content-Length only: Transfer-Encoding gets
+    501 and a POST without a length 411, so no body is ever left in
+    the buffer to be read as the next request.
+
+    The workers search in their own scratch, like batch workers. The
+    result cache and the autocomplete ranking are shared, so those
+    calls hold server_engine_lock; a cached OD is then a hash lookup
+    and a copy of its stored JSON.
+*/
+#ifdef METRO_SERVER
+
+#define SERVER_MAX_CONNS   1024
+#define SERVER_HEAD_MAX    8192         // request line + headers
+#define SERVER_BODY_MAX    (1 << 20)    // /batch input
+#define SERVER_TARGET_MAX  1024         // path + query
+#define SERVER_IDLE_SEC    30           // keep-alive connections idle longer are closed
+#define SERVER_EVENTS      64
+#define SERVER_AC_MAX      50
+
+typedef struct ServerConn {
+    int fd;                     // -1 once closed (a worker may still hold the conn)
+    char *in;                   // bytes read, the current request first
+    size_t in_len, in_cap;
+    size_t req_len;             // bytes of in the current request takes
+    char method[8];
+    char target[SERVER_TARGET_MAX];
+    const char *body;           // into in
+    size_t body_len;
+    int keep_alive;
+    int busy;                   // with a worker; in is not touched meanwhile
+    TextOut out;                // reply: status line, headers, body
+    size_t sent;
+    time_t last_active;
+    struct ServerConn *next;    // job / done queue link
+} ServerConn;
+
+typedef struct {
+    SearchScratch sc;
+    SearchScratch back;
+    Route route;
+    Route alts[MAX_ALTERNATES];
+    IsoStation iso[MAX];
+    TextOut body;
+} ServerWorker;
+
+ServerConn *server_conns[SERVER_MAX_CONNS];
+int server_conn_count = 0;
+int server_poll_fd = -1;
+int server_listen_fd = -1;
+int server_wake[2] = { -1, -1 };       // workers -> loop: a reply is ready
+volatile sig_atomic_t server_stop = 0;
+long server_requests = 0;
+
+// poller tags for the two fds that are not connections
+char server_tag_listen, server_tag_wake;
+
+#ifdef METRO_THREADS
+pthread_mutex_t server_engine_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t server_queue_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t server_queue_cond = PTHREAD_COND_INITIALIZER;
+#define SERVER_ENGINE_LOCK()   pthread_mutex_lock(&server_engine_lock)
+#define SERVER_ENGINE_UNLOCK() pthread_mutex_unlock(&server_engine_lock)
+#else
+#define SERVER_ENGINE_LOCK()   ((void)0)
+#define SERVER_ENGINE_UNLOCK() ((void)0)
+#endif
+
+ServerConn *server_jobs = NULL, *server_jobs_tail = NULL;
+ServerConn *server_done = NULL;
+int server_worker_threads = 0;          // 0 = requests run on the loop thread
+
+// --- poller (epoll / kqueue) --------------------------------------------
+
+typedef struct {
+    void *tag;
+    int readable;
+    int writable;
+    int hangup;
+} ServerEvent;
+
+int poller_open(void) {
+#ifdef SERVER_EPOLL
+    return epoll_create1(0);
+#else
+    return kqueue();
+#endif
+}
+
+// Watch fd for the given directions (add = first registration)
+void poller_set(int fd, void *tag, int want_read, int want_write, int add) {
+#ifdef SERVER_EPOLL
+    struct epoll_event ev;
+    ev.events = (want_read ? EPOLLIN : 0) | (want_write ? EPOLLOUT : 0);
+    ev.data.ptr = tag;
+    epoll_ctl(server_poll_fd, add ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, fd, &ev);
+#else
+    struct kevent ch[2];
+    EV_SET(&ch[0], fd, EVFILT_READ, EV_ADD | (want_read ? EV_ENABLE : EV_DISABLE), 0, 0, tag);
+    EV_SET(&ch[1], fd, EVFILT_WRITE, EV_ADD | (want_write ? EV_ENABLE : EV_DISABLE), 0, 0, tag);
+    (void)add;
+    kevent(server_poll_fd, ch, 2, NULL, 0, NULL);
+#endif
+}
+
+// Wait up to timeout_ms; returns the number of events (0 on timeout or a signal)
+int poller_wait(ServerEvent *out, int max, int timeout_ms) {
+    int n, count = 0;
+#ifdef SERVER_EPOLL
+    struct epoll_event ev[SERVER_EVENTS];
+    n = epoll_wait(server_poll_fd, ev, max < SERVER_EVENTS ? max : SERVER_EVENTS, timeout_ms);
+    for (int i = 0; i < n; i++) {
+        out[count].tag = ev[i].data.ptr;
+        out[count].readable = (ev[i].events & EPOLLIN) != 0;
+        out[count].writable = (ev[i].events & EPOLLOUT) != 0;
+        out[count].hangup = (ev[i].events & (EPOLLHUP | EPOLLERR)) != 0;
+        count++;
+    }
+#else
+    struct kevent ev[SERVER_EVENTS];
+    struct timespec ts = { timeout_ms / 1000, (timeout_ms % 1000) * 1000000L };
+    n = kevent(server_poll_fd, NULL, 0, ev, max < SERVER_EVENTS ? max : SERVER_EVENTS, &ts);
+    for (int i = 0; i < n; i++) {
+        out[count].tag = ev[i].udata;
+        out[count].readable = ev[i].filter == EVFILT_READ;
+        out[count].writable = ev[i].filter == EVFILT_WRITE;
+        out[count].hangup = (ev[i].flags & EV_ERROR) != 0;
+        count++;
+    }
+#endif
+    return n < 0 ? 0 : count;
+}
+
+// --- request parsing ----------------------------------------------------
+
+int hex_digit(int c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    c = tolower(c);
+    return c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+}
+
+/*
+    query_param(query, name, out, size)
+
+    URL-decoded value of name in a "k=v&k=v" query string ('+' is a
+    space). Returns 1 if present.
+*/
+int query_param(const char *query, const char *name, char *out, size_t size) {
+    size_t nl = strlen(name);
+    const char *p = query;
+
+    while (p && *p) {
+        const char *end = strchr(p, '&');
+        if (!end) end = p + strlen(p);
+        if ((size_t)(end - p) > nl && strncmp(p, name, nl) == 0 && p[nl] == '=') {
+            size_t n = 0;
+            for (const char *s = p + nl + 1; s < end; s++) {
+                int c = (unsigned char)*s;
+                if (c == '+') {
+                    c = ' ';
+                } else if (c == '%' && end - s > 2 && hex_digit(s[1]) >= 0 && hex_digit(s[2]) >= 0) {
+                    c = hex_digit(s[1]) * 16 + hex_digit(s[2]);
+                    s += 2;
+                }
+                if (n + 1 < size) out[n++] = (char)c;
+            }
+            out[n] = '\0';
+            return 1;
+        }
+        p = *end ? end + 1 : end;
+    }
+    return 0;
+}
+
+// Value of header name (case-insensitive) in head, or NULL; *len gets its length
+const char *server_header(const char *head, size_t head_len, const char *name, size_t *len) {
+    size_t nl = strlen(name);
+    const char *p = memchr(head, '\n', head_len);       // skip the request line
+    const char *end = head + head_len;
+
+    while (p && ++p < end) {
+        const char *eol = memchr(p, '\n', (size_t)(end - p));
+        if (!eol) eol = end;
+        if ((size_t)(eol - p) > nl && strncasecmp(p, name, nl) == 0 && p[nl] == ':') {
+            const char *v = p + nl + 1;
+            while (v < eol && (*v == ' ' || *v == '\t')) v++;
+            const char *ve = eol;
+            while (ve > v && (ve[-1] == '\r' || ve[-1] == ' ')) ve--;
+            *len = (size_t)(ve - v);
+            return v;
+        }
+        p = eol;
+    }
+    return NULL;
+}
+
+// --- replies ------------------------------------------------------------
+
+const char *server_reason(int code) {
+    switch (code) {
+    case 200: return "OK";
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 411: return "Length Required";
+    case 413: return "Payload Too Large";
+    case 414: return "URI Too Long";
+    case 431: return "Request Header Fields Too Large";
+    case 501: return "Not Implemented";
+    case 503: return "Service Unavailable";
+    default:  return "Internal Server Error";
+    }
+}
 
-    return altcount;
+// Status line + headers + body into out
+void server_reply(TextOut *out, int code, const TextOut *body, int keep_alive) {
+    text_reset(out);
+    text_lit(out, "HTTP/1.1 ");
+    text_int(out, code);
+    text_char(out, ' ');
+    text_str(out, server_reason(code));
+    text_lit(out, "\r\nContent-Type: application/json\r\n"
+                  "Access-Control-Allow-Origin: *\r\nContent-Length: ");
+    text_int(out, (int)body->len);
+    text_str(out, keep_alive ? "\r\nConnection: keep-alive\r\n\r\n" : "\r\nConnection: close\r\n\r\n");
+    text_put(out, text_cstr(body), body->len);
 }
 
-// =============================================================
-// AUTOCOMPLETE FOR STATION NAMES
-// =============================================================
+// {"error":message}; returns code
+int server_error(TextOut *body, int code, const char *message) {
+    text_reset(body);
+    text_lit(body, "{\"error\":");
+    text_json(body, message);
+    text_char(body, '}');
+    return code;
+}
 
-void autocomplete_print(const char *prefix) {
-    int printed = 0;
-    int plen = (int)strlen(prefix);
+// --- endpoints (run on a worker) ----------------------------------------
 
-    printf("\nMatches for \"%s\":\n", prefix);
+int serve_route(const char *query, ServerWorker *w) {
+    char from[160], to[160];
+    int status;
 
-    for (int i = 0; i < stationCount && printed < 20; i++) {
-        if (strncmp(stations[i].key_name, prefix, plen) == 0) {
-            const char *nm = stations[i].display_name[0]
-                             ? stations[i].display_name
-                             : stations[i].key_name;
-            printf("  - %s\n", nm);
-            printed++;
-        }
+    if (!query_param(query, "from", from, sizeof from) || !query_param(query, "to", to, sizeof to))
+        return server_error(&w->body, 400, "from and to are required");
+
+    SERVER_ENGINE_LOCK();
+    CachedRoute *e = resolve_cached(from, to, &status);
+    if (status == ROUTE_OK) {
+        const TextOut *summary = cached_route_json(e);
+        text_put(&w->body, text_cstr(summary), summary->len);
+    } else {
+        format_route_error_json(&w->body, status, from, to);
     }
+    SERVER_ENGINE_UNLOCK();
+    return 200;
+}
 
-    if (printed == 0) {
-        printf("  (no prefix matches)\n");
+int serve_alternates(const char *query, ServerWorker *w) {
+    char from[160], to[160], kbuf[12];
+    int src, dest;
+
+    if (!query_param(query, "from", from, sizeof from) || !query_param(query, "to", to, sizeof to))
+        return server_error(&w->body, 400, "from and to are required");
+    int k = query_param(query, "k", kbuf, sizeof kbuf) ? atoi(kbuf) : 3;
+    if (k < 1) k = 1;
+    if (k > MAX_ALTERNATES + 1) k = MAX_ALTERNATES + 1;
+
+    int status = resolve_stations(from, to, &src, &dest);
+    if (status == ROUTE_OK && !find_route_with(src, dest, &w->route, &w->sc, &w->back))
+        status = ROUTE_ERR_NO_PATH;
+    if (status != ROUTE_OK) {
+        format_route_error_json(&w->body, status, from, to);
+        return 200;
+    }
+
+    int n = find_alternates(&w->route, k - 1, w->alts);
+    text_lit(&w->body, "{\"status\":0,\"routes\":[");
+    format_route_json(&w->body, &w->route);
+    for (int a = 0; a < n; a++) {
+        text_char(&w->body, ',');
+        format_route_json(&w->body, &w->alts[a]);
     }
+    text_lit(&w->body, "]}");
+    return 200;
 }
 
-// =============================================================
-// FILE EXPORT (TXT + HTML REPORTS)
-// =============================================================
+int serve_autocomplete(const char *query, ServerWorker *w) {
+    char text[160], key[80], mbuf[12];
+    int ids[SERVER_AC_MAX];
+
+    if (!query_param(query, "q", text, sizeof text))
+        return server_error(&w->body, 400, "q is required");
+    int max = query_param(query, "max", mbuf, sizeof mbuf) ? atoi(mbuf) : 8;
+    if (max < 1) max = 1;
+    if (max > SERVER_AC_MAX) max = SERVER_AC_MAX;
+
+    strncpy(key, text, 79);
+    key[79] = '\0';
+    normalize_inplace(key);
+    SERVER_ENGINE_LOCK();
+    int n = autocomplete_ids(key, 1, ids, max);
+    SERVER_ENGINE_UNLOCK();
+
+    text_lit(&w->body, "{\"query\":");
+    text_json(&w->body, text);
+    text_lit(&w->body, ",\"stations\":[");
+    for (int i = 0; i < n; i++) {
+        if (i > 0) text_char(&w->body, ',');
+        text_lit(&w->body, "{\"id\":");
+        text_int(&w->body, ids[i]);
+        text_lit(&w->body, ",\"name\":");
+        text_json(&w->body, station_name(ids[i]));
+        text_char(&w->body, '}');
+    }
+    text_lit(&w->body, "]}");
+    return 200;
+}
 
-void export_route_to_txt(const char *fname, int path[], int len, char edgeLines[][30]) {
-    FILE *f = fopen(fname, "w");
-    if (!f) {
-        printf("Failed to create %s\n", fname);
-        return;
+int serve_isochrone(const char *query, ServerWorker *w) {
+    char from[160], key[80], num[12];
+
+    if (!query_param(query, "from", from, sizeof from))
+        return server_error(&w->body, 400, "from is required");
+    int minutes = query_param(query, "minutes", num, sizeof num) ? atoi(num) : -1;
+    int fare = query_param(query, "fare", num, sizeof num) ? atoi(num) : -1;
+
+    strncpy(key, from, 79);
+    key[79] = '\0';
+    normalize_inplace(key);
+    int src = find_station_id(key, 1);
+    if (src < 0) {
+        format_route_error_json(&w->body, ROUTE_ERR_SRC, from, "");
+        return 200;
     }
+    int n = isochrone_with(src, iso_max_sec(minutes), fare, w->iso, &w->sc, &w->route);
+    format_isochrone_json(&w->body, src, minutes, fare, w->iso, n);
+    return 200;
+}
 
-    time_t now = time(NULL);
-    fprintf(f, "NAMMA METRO — ROUTE REPORT\nGenerated: %s\n", asctime(localtime(&now)));
+int serve_batch(const char *body, size_t len, ServerWorker *w) {
+    char line[BATCH_LINE_MAX];
+    BatchPair pair;
+    int count = 0, first = 1;
+    const char *p = body, *end = body + len;
+
+    text_lit(&w->body, "{\"results\":[");
+
+    while (p < end) {
+        const char *eol = memchr(p, '\n', (size_t)(end - p));
+        size_t n = (size_t)((eol ? eol : end) - p);
+        if (n >= sizeof line) n = sizeof line - 1;      // over-long line: cut
+        memcpy(line, p, n);
+        line[n] = '\0';
+        p = eol ? eol + 1 : end;
+
+        const char *f = line;
+        while (*f == ' ') f++;
+        if (*f == '#' || *f == '\r' || *f == '\0') continue;
+        batch_field(&f, pair.from, sizeof pair.from);
+        batch_field(&f, pair.to, sizeof pair.to);
+        if (first) {
+            first = 0;
+            if (batch_is_header(pair.from, pair.to)) continue;
+        }
 
-    fprintf(f, "\nRoute:\n");
-    for (int i = 0; i < len; i++) {
-        const char *nm = stations[path[i]].display_name[0]
-                         ? stations[path[i]].display_name
-                         : stations[path[i]].key_name;
-        fprintf(f, "%s", nm);
-        if (i < len - 1) fprintf(f, " -> ");
+        int src, dest;
+        int status = resolve_stations(pair.from, pair.to, &src, &dest);
+        if (status == ROUTE_OK && !find_route_with(src, dest, &w->route, &w->sc, &w->back))
+            status = ROUTE_ERR_NO_PATH;
+        if (count++ > 0) text_char(&w->body, ',');
+        batch_json_row(&w->body, pair.from, pair.to, status, &w->route);
     }
+    text_lit(&w->body, "],\"count\":");
+    text_int(&w->body, count);
+    text_char(&w->body, '}');
+    return 200;
+}
 
-    fprintf(f, "\n\nLine segments:\n");
-    int i = 0;
-    while (i < len - 1) {
-        char curr[30];
-        strncpy(curr, edgeLines[i], 29);
-        curr[29] = '\0';
+// Route one complete request to its endpoint and build the reply in c->out
+void server_handle(ServerConn *c, ServerWorker *w) {
+    char path[64];
+    const char *query = strchr(c->target, '?');
+    size_t pl = query ? (size_t)(query - c->target) : strlen(c->target);
+    int get = strcmp(c->method, "GET") == 0;
+    int code;
+
+    snprintf(path, sizeof path, "%.*s", (int)(pl < sizeof path ? pl : sizeof path - 1), c->target);
+    query = query ? query + 1 : "";
+    text_reset(&w->body);
+
+    if (strcmp(path, "/route") == 0)
+        code = get ? serve_route(query, w) : server_error(&w->body, 405, "use GET");
+    else if (strcmp(path, "/alternates") == 0)
+        code = get ? serve_alternates(query, w) : server_error(&w->body, 405, "use GET");
+    else if (strcmp(path, "/autocomplete") == 0)
+        code = get ? serve_autocomplete(query, w) : server_error(&w->body, 405, "use GET");
+    else if (strcmp(path, "/isochrone") == 0)
+        code = get ? serve_isochrone(query, w) : server_error(&w->body, 405, "use GET");
+    else if (strcmp(path, "/batch") == 0)
+        code = strcmp(c->method, "POST") == 0 ? serve_batch(c->body, c->body_len, w)
+                                              : server_error(&w->body, 405, "use POST");
+    else
+        code = server_error(&w->body, 404, "no such endpoint");
+
+    if (w->body.len >= w->body.cap && w->body.len > 0) {
+        code = server_error(&w->body, 500, "out of memory");
+        c->keep_alive = 0;
+    }
+    server_reply(&c->out, code, &w->body, c->keep_alive);
+}
 
-        int s = i;
-        int e = i;
-        while (e + 1 < len - 1 && strcmp(edgeLines[e + 1], curr) == 0) {
-            e++;
-        }
+// --- worker pool --------------------------------------------------------
 
-        const char *start = stations[path[s]].display_name[0]
-                            ? stations[path[s]].display_name
-                            : stations[path[s]].key_name;
-        const char *end   = stations[path[e + 1]].display_name[0]
-                            ? stations[path[e + 1]].display_name
-                            : stations[path[e + 1]].key_name;
+ServerWorker *server_worker_new(void) {
+    ServerWorker *w = malloc(sizeof *w);
+    if (w) w->body = text_arena();
+    return w;
+}
 
-        fprintf(f, "%s : %s -> %s\n", curr, start, end);
+// A reply is ready: queue c for the loop and wake it
+void server_done_push(ServerConn *c) {
+#ifdef METRO_THREADS
+    pthread_mutex_lock(&server_queue_lock);
+#endif
+    c->next = server_done;
+    server_done = c;
+#ifdef METRO_THREADS
+    pthread_mutex_unlock(&server_queue_lock);
+#endif
+    char b = 1;
+    while (write(server_wake[1], &b, 1) < 0 && errno == EINTR) {}
+}
 
-        for (int k = s; k <= e; k++) {
-            const char *a = stations[path[k]].display_name[0]
-                            ? stations[path[k]].display_name
-                            : stations[path[k]].key_name;
-            const char *b = stations[path[k + 1]].display_name[0]
-                            ? stations[path[k + 1]].display_name
-                            : stations[path[k + 1]].key_name;
-            fprintf(f, "    - %s -> %s : %.2f km, %d min, slab Rs %d\n",
-                    a, b, AVG_KM_PER_EDGE, TIME_PER_EDGE_MIN,
-                    fare_from_distance(AVG_KM_PER_EDGE));
+#ifdef METRO_THREADS
+void *server_worker_main(void *arg) {
+    ServerWorker *w = arg;
+    for (;;) {
+        pthread_mutex_lock(&server_queue_lock);
+        while (!server_jobs && !server_stop)
+            pthread_cond_wait(&server_queue_cond, &server_queue_lock);
+        ServerConn *c = server_jobs;
+        if (c) {
+            server_jobs = c->next;
+            if (!server_jobs) server_jobs_tail = NULL;
         }
+        pthread_mutex_unlock(&server_queue_lock);
+        if (!c) return NULL;                    // stopping
 
-        i = e + 1;
+        server_handle(c, w);
+        server_done_push(c);
     }
+}
+#endif
 
-    fprintf(f, "\nTrip summary:\n");
-    int edges = len - 1;
-    double total_dist = edges * AVG_KM_PER_EDGE;
-
-    int interchanges = 0;
-    for (int ii = 0; ii < len; ii++) {
-        if (stations[path[ii]].line_count > 1)
-            interchanges++;
+// Hand a parsed request to the pool (or answer it here without one)
+void server_submit(ServerConn *c, ServerWorker *inline_worker) {
+    c->busy = 1;
+    server_requests++;
+#ifdef METRO_THREADS
+    if (server_worker_threads > 0) {
+        c->next = NULL;
+        pthread_mutex_lock(&server_queue_lock);
+        if (server_jobs_tail) server_jobs_tail->next = c;
+        else server_jobs = c;
+        server_jobs_tail = c;
+        pthread_cond_signal(&server_queue_cond);
+        pthread_mutex_unlock(&server_queue_lock);
+        return;
     }
+#endif
+    server_handle(c, inline_worker);
+    server_done_push(c);
+}
 
-    int time_min = edges * TIME_PER_EDGE_MIN + interchanges * INTERCHANGE_TIME_MIN;
-    int fare = fare_from_distance(total_dist);
+// --- connections (loop thread only) -------------------------------------
 
-    fprintf(f,
-            " - Stops traveled: %d\n"
-            " - Distance: %.2f km\n"
-            " - ETA (mins): %d\n"
-            " - Fare est: Rs %d\n",
-            edges, total_dist, time_min, fare);
+void server_conn_free(ServerConn *c) {
+    for (int i = 0; i < server_conn_count; i++) {
+        if (server_conns[i] == c) {
+            server_conns[i] = server_conns[--server_conn_count];
+            break;
+        }
+    }
+    free(c->in);
+    text_free(&c->out);
+    free(c);
+}
 
-    fclose(f);
-    printf("Saved TXT report: %s\n", fname);
+// Close the socket; the conn itself goes once no worker holds it
+void server_close(ServerConn *c) {
+    if (c->fd >= 0) close(c->fd);
+    c->fd = -1;
+    if (!c->busy) server_conn_free(c);
 }
 
-void export_route_to_html(const char *fname, int path[], int len, char edgeLines[][30]) {
-    FILE *f = fopen(fname, "w");
-    if (!f) {
-        printf("Failed to create %s\n", fname);
-        return;
+void server_accept(void) {
+    for (;;) {
+        int fd = accept(server_listen_fd, NULL, NULL);
+        if (fd < 0) return;                     // EAGAIN: accepted them all
+        ServerConn *c = server_conn_count < SERVER_MAX_CONNS ? calloc(1, sizeof *c) : NULL;
+        if (!c) {
+            close(fd);
+            continue;
+        }
+        int one = 1;
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+        c->fd = fd;
+        c->out = text_arena();
+        c->last_active = time(NULL);
+        server_conns[server_conn_count++] = c;
+        poller_set(fd, c, 1, 0, 1);
     }
+}
 
-    // Basic CSS for a clean look
-    fprintf(f, "<!doctype html>\n<html><head><meta charset='utf-8'>\n");
-    fprintf(f, "<title>Namma Metro Route Report</title>\n");
-    fprintf(f,
-        "<style>\n"
-        "body{font-family:Segoe UI,Roboto,Arial,sans-serif;margin:24px;color:#222}\n"
-        ".header{background:#f4f6fb;padding:14px;border-radius:8px;margin-bottom:18px}\n"
-        ".h1{font-size:20px;margin:0}\n"
-        ".badge{display:inline-block;padding:6px 10px;border-radius:12px;margin-right:6px;font-weight:700}\n"
-        ".badge.purple{background:#f3e8ff;color:#5b2b8a}\n"
-        ".badge.green{background:#e6f8f0;color:#0b7a42}\n"
-        ".badge.pink{background:#fff0f6;color:#9b3b76}\n"
-        ".section{margin-top:14px}\n"
-        ".table{width:100%%;border-collapse:collapse;margin-top:8px}\n"
-        ".table th,.table td{border:1px solid #e6e9ef;padding:8px;text-align:left}\n"
-        ".small{color:#666;font-size:13px}\n"
-        "</style>\n"
-    );
-    fprintf(f, "</head><body>\n");
+void server_try_request(ServerConn *c, ServerWorker *inline_worker);
 
-    // Header
-    time_t now = time(NULL);
-    char timestr[80];
-    strftime(timestr, sizeof timestr, "%c", localtime(&now));
-    fprintf(f,
-            "<div class='header'><div class='h1'>NAMMA METRO — ROUTE REPORT</div>"
-            "<div class='small'>Generated: %s</div></div>\n",
-            timestr);
+// Send what is left of c->out; on completion get ready for the next request
+void server_write(ServerConn *c, ServerWorker *inline_worker) {
+    while (c->sent < c->out.len) {
+#ifdef MSG_NOSIGNAL
+        ssize_t n = send(c->fd, c->out.buf + c->sent, c->out.len - c->sent, MSG_NOSIGNAL);
+#else
+        ssize_t n = send(c->fd, c->out.buf + c->sent, c->out.len - c->sent, 0);
+#endif
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            poller_set(c->fd, c, 0, 1, 0);
+            return;
+        }
+        if (n <= 0) {
+            server_close(c);
+            return;
+        }
+        c->sent += (size_t)n;
+    }
 
-    // Route
-    fprintf(f, "<div><strong>Route:</strong> ");
-    for (int i = 0; i < len; i++) {
-        const char *nm = stations[path[i]].display_name[0]
-                         ? stations[path[i]].display_name
-                         : stations[path[i]].key_name;
-        fprintf(f, "%s", nm);
-        if (i < len - 1) fprintf(f, " &rarr; ");
+    c->last_active = time(NULL);
+    if (!c->keep_alive) {
+        server_close(c);
+        return;
     }
-    fprintf(f, "</div>\n");
+    memmove(c->in, c->in + c->req_len, c->in_len - c->req_len);
+    c->in_len -= c->req_len;
+    c->req_len = 0;
+    c->sent = 0;
+    text_reset(&c->out);
+    poller_set(c->fd, c, 1, 0, 0);
+    server_try_request(c, inline_worker);       // a pipelined one may be waiting
+}
 
-    // Segments
-    fprintf(f,
-            "<div class='section'><h3>Line segments</h3>"
-            "<table class='table'><tr>"
-            "<th>Line</th><th>Start</th><th>End</th><th>Stops</th>"
-            "</tr>\n");
+// Answer a malformed or oversized request from the loop and close
+void server_reject(ServerConn *c, int code, const char *message, ServerWorker *inline_worker) {
+    static TextOut body = { NULL, 0, 0, 1 };
+    server_error(&body, code, message);
+    c->keep_alive = 0;
+    c->sent = 0;
+    server_reply(&c->out, code, &body, 0);
+    server_write(c, inline_worker);
+}
 
-    int i2 = 0;
-    while (i2 < len - 1) {
-        char curr[30];
-        strncpy(curr, edgeLines[i2], 29);
-        curr[29] = '\0';
+// Parse the request at the start of c->in; submit it once it is complete
+void server_try_request(ServerConn *c, ServerWorker *inline_worker) {
+    if (c->busy || c->fd < 0 || c->in_len == 0) return;
 
-        int s = i2;
-        int e = i2;
-        while (e + 1 < len - 1 && strcmp(edgeLines[e + 1], curr) == 0) {
-            e++;
+    const char *head_end = NULL;
+    for (size_t i = 3; i < c->in_len; i++) {
+        if (c->in[i] == '\n' && c->in[i - 1] == '\r' && c->in[i - 2] == '\n' && c->in[i - 3] == '\r') {
+            head_end = c->in + i + 1;
+            break;
         }
+    }
+    if (!head_end) {
+        if (c->in_len > SERVER_HEAD_MAX)
+            server_reject(c, 431, "request head too large", inline_worker);
+        return;
+    }
+    size_t head_len = (size_t)(head_end - c->in);
 
-        const char *start = stations[path[s]].display_name[0]
-                            ? stations[path[s]].display_name
-                            : stations[path[s]].key_name;
-        const char *end   = stations[path[e + 1]].display_name[0]
-                            ? stations[path[e + 1]].display_name
-                            : stations[path[e + 1]].key_name;
-
-        const char *cls =
-            strcmp(curr, "purple") == 0 ? "purple" :
-            strcmp(curr, "green")  == 0 ? "green"  :
-            strcmp(curr, "pink")   == 0 ? "pink"   : "";
+    // request line: METHOD SP TARGET SP HTTP/1.x
+    const char *sp1 = memchr(c->in, ' ', head_len);
+    const char *sp2 = sp1 ? memchr(sp1 + 1, ' ', head_len - (size_t)(sp1 + 1 - c->in)) : NULL;
+    if (!sp1 || !sp2 || sp1 - c->in >= (long)sizeof c->method || strncmp(sp2 + 1, "HTTP/1.", 7) != 0) {
+        server_reject(c, 400, "malformed request line", inline_worker);
+        return;
+    }
+    if (sp2 - sp1 - 1 >= SERVER_TARGET_MAX) {
+        server_reject(c, 414, "request target too long", inline_worker);
+        return;
+    }
+    memcpy(c->method, c->in, (size_t)(sp1 - c->in));
+    c->method[sp1 - c->in] = '\0';
+    memcpy(c->target, sp1 + 1, (size_t)(sp2 - sp1 - 1));
+    c->target[sp2 - sp1 - 1] = '\0';
+
+    size_t vlen;
+    const char *v = server_header(c->in, head_len, "Connection", &vlen);
+    if (sp2[8] == '0')
+        c->keep_alive = v && vlen == 10 && strncasecmp(v, "keep-alive", 10) == 0;
+    else
+        c->keep_alive = !(v && vlen == 5 && strncasecmp(v, "close", 5) == 0);
+
+    // bodies are framed by Content-Length alone (see above)
+    if (server_header(c->in, head_len, "Transfer-Encoding", &vlen)) {
+        server_reject(c, 501, "Transfer-Encoding is not supported", inline_worker);
+        return;
+    }
+    size_t body_len = 0;
+    v = server_header(c->in, head_len, "Content-Length", &vlen);
+    if (v) {
+        size_t rest;
+        int digits = vlen > 0;
+        for (size_t i = 0; i < vlen; i++)
+            digits = digits && isdigit((unsigned char)v[i]);
+        // a second Content-Length is searched for from the first one's line on
+        if (!digits || server_header(v, head_len - (size_t)(v - c->in), "Content-Length", &rest)) {
+            server_reject(c, 400, "bad Content-Length", inline_worker);
+            return;
+        }
+        for (size_t i = 0; i < vlen && body_len <= SERVER_BODY_MAX; i++)
+            body_len = body_len * 10 + (size_t)(v[i] - '0');
+        if (body_len > SERVER_BODY_MAX) {
+            server_reject(c, 413, "body too large", inline_worker);
+            return;
+        }
+    } else if (strcmp(c->method, "POST") == 0 || strcmp(c->method, "PUT") == 0) {
+        server_reject(c, 411, "Content-Length required", inline_worker);
+        return;
+    }
+    if (c->in_len < head_len + body_len) return;        // the rest is still coming
 
-        fprintf(f,
-                "<tr><td><span class='badge %s'>%s</span></td>"
-                "<td>%s</td><td>%s</td><td>%d</td></tr>\n",
-                cls, curr, start, end, e - s + 1);
+    c->body = c->in + head_len;
+    c->body_len = body_len;
+    c->req_len = head_len + body_len;
+    poller_set(c->fd, c, 0, 0, 0);                      // nothing more until it is answered
+    server_submit(c, inline_worker);
+}
 
-        i2 = e + 1;
+void server_read(ServerConn *c, ServerWorker *inline_worker) {
+    for (;;) {
+        if (c->in_len == c->in_cap) {
+            size_t cap = c->in_cap ? c->in_cap * 2 : 4096;
+            if (cap > SERVER_HEAD_MAX + SERVER_BODY_MAX) cap = SERVER_HEAD_MAX + SERVER_BODY_MAX;
+            char *grown = cap > c->in_cap ? realloc(c->in, cap) : NULL;
+            if (!grown) {
+                server_close(c);
+                return;
+            }
+            c->in = grown;
+            c->in_cap = cap;
+        }
+        ssize_t n = recv(c->fd, c->in + c->in_len, c->in_cap - c->in_len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        if (n <= 0) {
+            server_close(c);                        // peer closed, or an error
+            return;
+        }
+        c->in_len += (size_t)n;
+        c->last_active = time(NULL);
     }
-    fprintf(f, "</table></div>\n");
+    server_try_request(c, inline_worker);
+}
 
-    // Per-edge breakdown
-    fprintf(f,
-            "<div class='section'><h3>Per-stop breakdown</h3>"
-            "<table class='table'>"
-            "<tr><th>From</th><th>To</th><th>Distance (km)</th>"
-            "<th>Time (min)</th><th>Fare (slab)</th></tr>\n");
+// Replies the workers finished: send them
+void server_drain_done(ServerWorker *inline_worker) {
+    char buf[256];
+    while (read(server_wake[0], buf, sizeof buf) > 0) {}
 
-    int edges = len - 1;
-    double total_dist = 0.0;
-    int total_time = 0;
+#ifdef METRO_THREADS
+    pthread_mutex_lock(&server_queue_lock);
+#endif
+    ServerConn *c = server_done;
+    server_done = NULL;
+#ifdef METRO_THREADS
+    pthread_mutex_unlock(&server_queue_lock);
+#endif
 
-    for (int k = 0; k < edges; k++) {
-        const char *a = stations[path[k]].display_name[0]
-                        ? stations[path[k]].display_name
-                        : stations[path[k]].key_name;
-        const char *b = stations[path[k + 1]].display_name[0]
-                        ? stations[path[k + 1]].display_name
-                        : stations[path[k + 1]].key_name;
-
-        double dist = AVG_KM_PER_EDGE;
-        int tmin = TIME_PER_EDGE_MIN;
-        int fare = fare_from_distance(dist);
+    while (c) {
+        ServerConn *next = c->next;
+        c->busy = 0;
+        if (c->fd < 0) server_conn_free(c);         // closed while it was away
+        else server_write(c, inline_worker);
+        c = next;
+    }
+}
 
-        total_dist += dist;
-        total_time += tmin;
+void server_on_signal(int sig) {
+    (void)sig;
+    server_stop = 1;
+}
 
-        fprintf(f,
-                "<tr><td>%s</td><td>%s</td><td>%.2f</td>"
-                "<td>%d</td><td>Rs %d</td></tr>\n",
-                a, b, dist, tmin, fare);
+// Listening socket for "[HOST:]PORT"; -1 after reporting an error
+int server_listen(const char *addr) {
+    char host[64] = "127.0.0.1";
+    const char *colon = strrchr(addr, ':');
+    const char *port = addr;
+    if (colon) {
+        snprintf(host, sizeof host, "%.*s", (int)(colon - addr), addr);
+        port = colon + 1;
     }
-    int interchanges = 0;
-    for (int ii = 0; ii < len; ii++) {
-        if (stations[path[ii]].line_count > 1)
-            interchanges++;
+
+    struct sockaddr_in sa;
+    memset(&sa, 0, sizeof sa);
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons((unsigned short)atoi(port));
+    if (atoi(port) <= 0 || atoi(port) > 65535 || inet_pton(AF_INET, host, &sa.sin_addr) != 1) {
+        fprintf(stderr, "--serve: expected [HOST:]PORT with an IPv4 host, got '%s'\n", addr);
+        return -1;
     }
 
-    int est_time = total_time + interchanges * INTERCHANGE_TIME_MIN;
-    int est_fare = fare_from_distance(total_dist);
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    if (fd >= 0) setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+    if (fd < 0 || bind(fd, (struct sockaddr *)&sa, sizeof sa) < 0 || listen(fd, 512) < 0) {
+        fprintf(stderr, "--serve %s: %s\n", addr, strerror(errno));
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    return fd;
+}
 
-    fprintf(f, "</table></div>\n");
+/*
+    run_server(addr)
 
-    // Summary
-    fprintf(f,
-            "<div class='section'><h3>Trip Summary</h3>\n<ul>\n"
-            "<li>Stops traveled: %d</li>\n"
-            "<li>Distance: %.2f km</li>\n"
-            "<li>Estimated travel time: %d minutes (incl. %d mins interchange)</li>\n"
-            "<li>Estimated fare: Rs %d</li>\n"
-            "</ul>\n</div>\n",
-            edges, total_dist, est_time, interchanges * INTERCHANGE_TIME_MIN, est_fare);
-
-    fprintf(f,
-            "<div style='margin-top:18px' class='small'>"
-            "Generated by Namma Metro Route Finder"
-            "</div>");
-
-    fprintf(f, "</body></html>");
-    fclose(f);
-    printf("Saved HTML report: %s\n", fname);
-}
+    --serve: builds the network and route table, then serves until
+    SIGINT or SIGTERM. Returns the process exit status.
+*/
+int run_server(const char *addr) {
+    ensure_network(1);
+    route_table_usable();
+    build_autocomplete_index();
+
+    server_listen_fd = server_listen(addr);
+    if (server_listen_fd < 0) return 1;
+    server_poll_fd = poller_open();
+    if (server_poll_fd < 0 || pipe(server_wake) < 0) {
+        fprintf(stderr, "--serve: %s\n", strerror(errno));
+        return 1;
+    }
+    fcntl(server_wake[0], F_SETFL, fcntl(server_wake[0], F_GETFL, 0) | O_NONBLOCK);
+    fcntl(server_wake[1], F_SETFL, fcntl(server_wake[1], F_GETFL, 0) | O_NONBLOCK);
+    poller_set(server_listen_fd, &server_tag_listen, 1, 0, 1);
+    poller_set(server_wake[0], &server_tag_wake, 1, 0, 1);
+
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, server_on_signal);
+    signal(SIGTERM, server_on_signal);
+
+    ServerWorker *inline_worker = server_worker_new();
+    if (!inline_worker) return 1;
+
+#ifdef METRO_THREADS
+    pthread_t tid[MAX_BATCH_THREADS];
+    for (int i = 0; i < batch_threads; i++) {
+        ServerWorker *w = server_worker_new();
+        if (!w || pthread_create(&tid[i], NULL, server_worker_main, w) != 0) {
+            free(w);
+            break;
+        }
+        server_worker_threads++;
+    }
+#endif
 
-// =============================================================
-// CROSS-PLATFORM FILE OPEN (DEFAULT APP)
-// =============================================================
-void open_file_crossplatform(const char *filename) {
-#ifdef _WIN32
-    char cmd[1024];
-    snprintf(cmd, sizeof cmd, "start \"\" \"%s\"", filename);
-    system(cmd);
-#elif __APPLE__
-    char cmd[1024];
-    snprintf(cmd, sizeof cmd, "open \"%s\"", filename);
-    system(cmd);
-#else
-    char cmd[1024];
-    snprintf(cmd, sizeof cmd, "xdg-open \"%s\" >/dev/null 2>&1 &", filename);
-    system(cmd);
+    fprintf(stderr, "serving %d stations on http://%s%s (%d worker%s)\n",
+            stationCount, strchr(addr, ':') ? "" : "127.0.0.1:", addr,
+            server_worker_threads ? server_worker_threads : 1,
+            server_worker_threads > 1 ? "s" : "");
+
+    ServerEvent ev[SERVER_EVENTS];
+    time_t swept = time(NULL);
+    double started = wall_seconds();
+
+    while (!server_stop) {
+        int n = poller_wait(ev, SERVER_EVENTS, 1000);
+        for (int i = 0; i < n; i++) {
+            if (ev[i].tag == &server_tag_listen) {
+                server_accept();
+            } else if (ev[i].tag == &server_tag_wake) {
+                server_drain_done(inline_worker);
+            } else {
+                ServerConn *c = ev[i].tag;
+                // a conn closed earlier in this batch may still have events queued
+                int live = 0;
+                for (int k = 0; k < server_conn_count && !live; k++) live = server_conns[k] == c;
+                if (!live || c->fd < 0 || c->busy) continue;
+                if (ev[i].writable && c->sent < c->out.len) server_write(c, inline_worker);
+                else if (ev[i].readable) server_read(c, inline_worker);
+                else if (ev[i].hangup) server_close(c);
+            }
+        }
+
+        time_t now = time(NULL);
+        if (now != swept) {
+            swept = now;
+            for (int k = server_conn_count - 1; k >= 0; k--) {
+                ServerConn *c = server_conns[k];
+                if (!c->busy && c->fd >= 0 && now - c->last_active > SERVER_IDLE_SEC)
+                    server_close(c);
+            }
+        }
+    }
+
+#ifdef METRO_THREADS
+    pthread_mutex_lock(&server_queue_lock);
+    pthread_cond_broadcast(&server_queue_cond);
+    pthread_mutex_unlock(&server_queue_lock);
+    for (int i = 0; i < server_worker_threads; i++) pthread_join(tid[i], NULL);
 #endif
+
+    double secs = wall_seconds() - started;
+    fprintf(stderr, "served %ld requests in %.1f s\n", server_requests, secs);
+    return 0;
 }
 
+#endif // METRO_SERVER
+
 // =============================================================
-// SHOW ALL STATIONS
+// MAIN MENU / INTERACTIVE LOOP (CLI ONLY)
 // =============================================================
-void show_all_stations(int include_planned) {
-    printf("\n%sStation list (total: %d)%s\n",
-           CLR_BOLD, stationCount, CLR_RESET);
-
-    for (int i = 0; i < stationCount; i++) {
-        if (!include_planned && stations[i].planned)
-            continue;
+void print_usage(const char *prog) {
+    printf("Usage: %s [--network FILE]\n"
+           "       %s --compile SOURCE IMAGE [--with-table]\n"
+           "       %s [--network FILE] --report OUT [--css FILE] FROM TO [FROM TO ...]\n"
+           "       %s [--network FILE] --batch FILE|- [--format csv|json] [--threads N]\n"
+           "       %s [--network FILE] --serve [HOST:]PORT [--threads N]\n"
+           "       %s [--network FILE] --isochrone MIN|any [--max-fare RS] [--format csv|json]\n"
+           "            [--threads N] [FROM ...]\n"
+           "\n"
+           "  --network FILE   load stations from a source text or binary image\n"
+           "  --compile        turn a source text (e.g. stations.txt) into an image\n"
+           "  --with-table     also store the all-pairs route table in the image\n"
+           "  --report OUT     write one report per FROM TO pair into OUT\n"
+           "                   (.txt for plain text, otherwise HTML)\n"
+           "  --css FILE       write the report stylesheet to FILE and link it\n"
+           "                   instead of inlining it\n"
+           "  --batch FILE     route every \"from,to\" line of FILE (- = stdin)\n"
+           "                   and stream one result per line to stdout\n"
+           "  --format F       batch output: csv (default) or json lines\n"
+           "  --serve ADDR     answer /route, /alternates, /autocomplete,\n"
+           "                   /isochrone and POST /batch as JSON over HTTP\n"
+           "                   on ADDR (host defaults to 127.0.0.1; needs\n"
+           "                   -DMETRO_SERVER)\n"
+           "  --isochrone MIN  list every station within MIN minutes (any = no\n"
+           "                   limit) of each FROM, or of every station\n"
+           "  --max-fare RS    isochrone fare budget (default: none)\n"
+           "  --threads N      batch or server workers (default: every core;\n"
+           "                   needs a -DMETRO_THREADS -pthread build)\n"
+           "  --stats          print per-phase counters to stderr on exit\n"
+           "                   (needs a -DMETRO_STATS build)\n"
+           "  --close NAME     treat station NAME as closed (repeatable)\n"
+           "  --close-segment A B\n"
+           "                   take the segment between adjacent stations\n"
+           "                   A and B out of service (repeatable)\n"
+           "  --timetable FILE service bands per line, as a GTFS-style\n"
+           "                   route_id,start_time,end_time,headway_secs CSV\n"
+           "  --depart HH:MM   time the route summary's ETA is for (default now)\n",
+           prog, prog, prog, prog, prog, prog);
+}
 
-        const char *nm = stations[i].display_name[0]
-                         ? stations[i].display_name
-                         : stations[i].key_name;
-        printf(" - %s", nm);
+/*
+    apply_closures(names, count, segments)
 
-        if (stations[i].line_count > 0) {
-            printf(" (");
-            for (int j = 0; j < stations[i].line_count; j++) {
-                printf("%s", stations[i].lines[j]);
-                if (j + 1 < stations[i].line_count) printf(", ");
+    --close / --close-segment: closes each named station, or with
+    segments = 1 each consecutive pair of names. Returns 0, or 1
+    after reporting a name or segment that does not exist.
+*/
+int apply_closures(char **names, int count, int segments) {
+    int step = segments ? 2 : 1;
+    for (int i = 0; i + step <= count; i += step) {
+        int id[2] = { -1, -1 };
+        for (int j = 0; j < step; j++) {
+            char key[80];
+            strncpy(key, names[i + j], 79);
+            key[79] = '\0';
+            normalize_inplace(key);
+            id[j] = station_lookup(key);
+            if (id[j] < 0) {
+                fprintf(stderr, "Unknown station: %s\n", names[i + j]);
+                return 1;
             }
-            printf(")");
         }
-        if (stations[i].planned)
-            printf(" [planned]");
-
-        printf("\n");
+        if (segments && set_segment_closed(id[0], id[1], 1) < 0) {
+            fprintf(stderr, "'%s' and '%s' are not adjacent\n", names[i], names[i + 1]);
+            return 1;
+        }
+        if (!segments) set_station_closed(id[0], 1);
     }
+    return 0;
 }
 
-// =============================================================
-// WEBASSEMBLY ENTRY: get_route(from, to)
-// =============================================================
-EMSCRIPTEN_KEEPALIVE
-const char* get_route(const char* from, const char* to) {
-    static char buffer[4096];
-    buffer[0] = '\0';
-
-    int include_planned = 1;
-    build_network(include_planned);
+/*
+    print_stats()
 
-    if (stationCount == 0) {
-        snprintf(buffer, sizeof buffer, "Error: station data not loaded.");
-        return buffer;
+    --stats: one line per phase (calls, total and mean time) plus the
+    search counters, on stderr so batch output stays clean. The result
+    cache line is always available; it is skipped if nothing used it.
+*/
+void print_stats(void) {
+    MetroStats s;
+    int cache[6];
+    get_result_cache_stats(cache);
+    if (cache[0] + cache[1] > 0)
+        fprintf(stderr, "result cache: %d hits, %d misses, %d evictions, %d stale, %d/%d used\n",
+                cache[0], cache[1], cache[2], cache[3], cache[4], cache[5]);
+
+    if (!get_stats(&s)) {
+        fprintf(stderr, "--stats: counters are compiled out; rebuild with -DMETRO_STATS\n");
+        return;
     }
+    const struct { const char *name; double calls, us; } phases[] = {
+        { "build",      s.build_calls,      s.build_us },
+        { "resolve",    s.resolve_calls,    s.resolve_us },
+        { "search",     s.search_calls,     s.search_us },
+        { "alternates", s.alternates_calls, s.alternates_us },
+        { "render",     s.render_calls,     s.render_us },
+    };
+    fprintf(stderr, "%-11s %10s %12s %10s\n", "phase", "calls", "total ms", "mean us");
+    for (size_t i = 0; i < sizeof phases / sizeof phases[0]; i++)
+        fprintf(stderr, "%-11s %10.0f %12.3f %10.2f\n", phases[i].name, phases[i].calls,
+                phases[i].us / 1000.0, phases[i].calls > 0 ? phases[i].us / phases[i].calls : 0.0);
+    fprintf(stderr, "nodes expanded %.0f (searches, alternates and table builds), queue peak %.0f\n",
+            s.nodes_expanded, s.queue_peak);
+}
 
-    if (!from || !to || !from[0] || !to[0]) {
-        snprintf(buffer, sizeof buffer, "Please provide both source and destination.");
-        return buffer;
-    }
+/*
+    write_reports(out, css, pairs, npairs)
 
-    char srckey[80], dstkey[80];
-    strncpy(srckey, from, 79);
-    srckey[79] = '\0';
-    normalize_inplace(srckey);
+    --report: routes each FROM TO pair (station names, as typed) into
+    one multi-report file. Pairs that don't resolve are reported on
+    stderr and skipped. Returns the process exit status.
+*/
+int write_reports(const char *out, const char *css, char **pairs, int npairs) {
+    static TextOut buf = { NULL, 0, 0, 1 };
+    static Route route;
 
-    strncpy(dstkey, to, 79);
-    dstkey[79] = '\0';
-    normalize_inplace(dstkey);
+    size_t n = strlen(out);
+    int format = n >= 4 && strcmp(out + n - 4, ".txt") == 0 ? REPORT_TXT : REPORT_HTML;
 
-    int src = -1, dest = -1;
-    for (int i = 0; i < stationCount; i++) {
-        if (!include_planned && stations[i].planned) continue;
-        if (strcmp(srckey, stations[i].key_name) == 0) src = i;
-        if (strcmp(dstkey, stations[i].key_name) == 0) dest = i;
+    if (css && format == REPORT_HTML && write_report_stylesheet(css) < 0) {
+        fprintf(stderr, "Failed to create %s\n", css);
+        return 1;
     }
 
-    if (src == -1 && dest == -1) {
-        snprintf(buffer, sizeof buffer,
-                 "Stations not found:\n - From: %s\n - To: %s\nCheck spellings or station availability.",
-                 from, to);
-        return buffer;
-    } else if (src == -1) {
-        snprintf(buffer, sizeof buffer,
-                 "Start station not found: %s\nCheck spelling or choose another station.", from);
-        return buffer;
-    } else if (dest == -1) {
-        snprintf(buffer, sizeof buffer,
-                 "Destination station not found: %s\nCheck spelling or choose another station.", to);
-        return buffer;
+    ReportWriter w;
+    if (report_open(&w, &buf, out, format, format == REPORT_HTML ? css : NULL) < 0) {
+        fprintf(stderr, "Failed to create %s\n", out);
+        return 1;
     }
 
-    int parent[MAX];
-    for (int i = 0; i < MAX; i++) parent[i] = -1;
-
-    if (!bfs_simple(src, dest, parent)) {
-        snprintf(buffer, sizeof buffer,
-                 "No route found between '%s' and '%s'.", from, to);
-        return buffer;
+    for (int i = 0; i + 1 < npairs; i += 2) {
+        int src, dest;
+        int status = resolve_route(pairs[i], pairs[i + 1], &route, &src, &dest);
+        if (status != ROUTE_OK) {
+            TextOut err = text_arena();
+            format_route_error(&err, status, pairs[i], pairs[i + 1]);
+            fprintf(stderr, "%s\n", text_cstr(&err));
+            text_free(&err);
+            continue;
+        }
+        report_add(&w, &route);
     }
 
-    // reconstruct path
-    int path[MAX];
-    int len = 0;
-    int cur = dest;
-    while (cur != -1) {
-        path[len++] = cur;
-        cur = parent[cur];
-    }
-    for (int i = 0; i < len / 2; i++) {
-        int t = path[i];
-        path[i] = path[len - 1 - i];
-        path[len - 1 - i] = t;
+    int count = w.count;
+    if (report_close(&w) < 0) {
+        fprintf(stderr, "Failed to write %s\n", out);
+        return 1;
     }
+    printf("Saved %d report%s: %s\n", count, count == 1 ? "" : "s", out);
+    return 0;
+}
 
-    char edgeLines[ MAX ][30]; // safe upper bound
-    build_edge_lines(path, len, edgeLines);
+// bench.c (and other programs that #include this file) bring their own main
+#ifndef METRO_NO_MAIN
+int main(int argc, char **argv) {
+    // On Windows: switch console to UTF-8 so em-dash, arrows, emojis work.
+#ifdef _WIN32
+    SetConsoleOutputCP(CP_UTF8);
+    SetConsoleCP(CP_UTF8);
+#endif
 
-    int edges = len - 1;
-    double total_dist = edges * AVG_KM_PER_EDGE;
-
-    // count interchanges
-    int interchanges = 0;
-    for (int ii = 0; ii < len; ii++) {
-        if (stations[path[ii]].line_count > 1)
-            interchanges++;
-    }
-    int base_time = edges * TIME_PER_EDGE_MIN;
-    int est_time = base_time + interchanges * INTERCHANGE_TIME_MIN;
-    int est_fare = fare_from_distance(total_dist);
-
-    const char *srcName = stations[path[0]].display_name[0]
-                          ? stations[path[0]].display_name
-                          : stations[path[0]].key_name;
-    const char *dstName = stations[path[len - 1]].display_name[0]
-                          ? stations[path[len - 1]].display_name
-                          : stations[path[len - 1]].key_name;
-
-    // build text
-    size_t offset = 0;
-    size_t remaining = sizeof buffer;
-
-    #define APPEND_FMT(fmt, ...) do { \
-        int n = snprintf(buffer + offset, remaining, fmt, __VA_ARGS__); \
-        if (n < 0 || (size_t)n >= remaining) { \
-            buffer[sizeof(buffer)-1] = '\0'; \
-            return buffer; \
-        } \
-        offset += (size_t)n; \
-        remaining -= (size_t)n; \
-    } while (0)
-
-    APPEND_FMT("Namma Metro — Route Summary\n\n", 0);
-    // use dummy 0 because fmt has no %; to keep macro simple
-    offset -= 1; remaining += 1; /* remove extra "0" printed above */
-    buffer[offset] = '\0';
-
-    // overwrite header properly without dummy:
-    offset = 0; remaining = sizeof buffer;
-    APPEND_FMT("Namma Metro — Route Summary\n\n", "");
-
-    APPEND_FMT("From: %s\n", srcName);
-    APPEND_FMT("To:   %s\n\n", dstName);
-
-    APPEND_FMT("Route:\n", "");
-    for (int i = 0; i < len; i++) {
-        const char *nm = stations[path[i]].display_name[0]
-                         ? stations[path[i]].display_name
-                         : stations[path[i]].key_name;
-        APPEND_FMT("%s", nm);
-        if (i < len - 1) {
-            APPEND_FMT(" -> ", "");
+    const char *network_file = NULL;
+    const char *compile_src = NULL;
+    const char *compile_out = NULL;
+    int with_table = 0;
+    const char *report_out = NULL;
+    const char *report_css = NULL;
+    char **pairs = NULL;
+    int npairs = 0;
+    const char *batch_file = NULL;
+    const char *serve_addr = NULL;
+    int iso_mode = 0, iso_minutes = -1, iso_fare = -1;
+    char **iso_from = NULL;
+    int niso = 0;
+    int batch_format = BATCH_FORMAT_CSV;
+    int threads = 0;
+    int stats = 0;
+    const char *timetable_file = NULL;
+    char **closed = NULL, **closed_segs = NULL;
+    int nclosed = 0, nclosed_segs = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--network") == 0 && i + 1 < argc) {
+            network_file = argv[++i];
+        } else if (strcmp(argv[i], "--compile") == 0 && i + 2 < argc) {
+            compile_src = argv[++i];
+            compile_out = argv[++i];
+        } else if (strcmp(argv[i], "--with-table") == 0) {
+            with_table = 1;
+        } else if (strcmp(argv[i], "--report") == 0 && i + 1 < argc) {
+            report_out = argv[++i];
+        } else if (strcmp(argv[i], "--css") == 0 && i + 1 < argc) {
+            report_css = argv[++i];
+        } else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            batch_file = argv[++i];
+        } else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc) {
+            serve_addr = argv[++i];
+        } else if (strcmp(argv[i], "--isochrone") == 0 && i + 1 < argc &&
+                   (strcmp(argv[i + 1], "any") == 0 || isdigit((unsigned char)argv[i + 1][0]))) {
+            iso_mode = 1;
+            i++;
+            iso_minutes = strcmp(argv[i], "any") == 0 ? -1 : atoi(argv[i]);
+        } else if (strcmp(argv[i], "--max-fare") == 0 && i + 1 < argc &&
+                   isdigit((unsigned char)argv[i + 1][0])) {
+            iso_fare = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc &&
+                   (strcmp(argv[i + 1], "csv") == 0 || strcmp(argv[i + 1], "json") == 0)) {
+            batch_format = strcmp(argv[++i], "json") == 0 ? BATCH_FORMAT_JSON : BATCH_FORMAT_CSV;
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            stats = 1;
+        } else if (strcmp(argv[i], "--timetable") == 0 && i + 1 < argc) {
+            timetable_file = argv[++i];
+        } else if (strcmp(argv[i], "--depart") == 0 && i + 1 < argc &&
+                   parse_service_time(argv[i + 1], &cli_depart)) {
+            i++;
+        } else if (strcmp(argv[i], "--close") == 0 && i + 1 < argc) {
+            if (!closed && !(closed = malloc((size_t)argc * sizeof *closed))) return 1;
+            closed[nclosed++] = argv[++i];
+        } else if (strcmp(argv[i], "--close-segment") == 0 && i + 2 < argc) {
+            if (!closed_segs && !(closed_segs = malloc((size_t)argc * sizeof *closed_segs)))
+                return 1;
+            closed_segs[nclosed_segs++] = argv[++i];
+            closed_segs[nclosed_segs++] = argv[++i];
+        } else if (iso_mode && !report_out && argv[i][0] != '-') {
+            // source stations after --isochrone
+            if (!iso_from && !(iso_from = malloc((size_t)argc * sizeof *iso_from))) return 1;
+            iso_from[niso++] = argv[i];
+        } else if (report_out && argv[i][0] != '-') {
+            // station names after --report, two per report
+            if (!pairs && !(pairs = malloc((size_t)argc * sizeof *pairs))) return 1;
+            pairs[npairs++] = argv[i];
+        } else {
+            print_usage(argv[0]);
+            return 2;
         }
     }
-    APPEND_FMT("\n\n", "");
-
-    // segments by line
-    APPEND_FMT("Segments by line:\n", "");
-    int i = 0;
-    while (i < len - 1) {
-        char curr[30];
-        strncpy(curr, edgeLines[i], 29);
-        curr[29] = '\0';
 
-        int s = i;
-        int e = i;
-        while (e + 1 < len - 1 && strcmp(edgeLines[e + 1], curr) == 0) {
-            e++;
+    // offline compiler: source text -> binary image
+    if (compile_src) {
+        if (load_network_file(compile_src) < 0 ||
+            write_network_image(compile_out, with_table) < 0) {
+            fprintf(stderr, "%s: %s\n", compile_src, network_error);
+            return 1;
         }
+        printf("Wrote %s (%d stations, %d lines%s)\n", compile_out, stationCount, lineCount,
+               with_table ? ", route table" : "");
+        return 0;
+    }
 
-        const char *start = stations[path[s]].display_name[0]
-                            ? stations[path[s]].display_name
-                            : stations[path[s]].key_name;
-        const char *end   = stations[path[e + 1]].display_name[0]
-                            ? stations[path[e + 1]].display_name
-                            : stations[path[e + 1]].key_name;
-
-        APPEND_FMT(" - Line %s: %s -> %s (%d stops)\n",
-                   curr, start, end, e - s + 1);
-
-        i = e + 1;
+    if (network_file && load_network_file(network_file) < 0) {
+        fprintf(stderr, "%s: %s\n", network_file, network_error);
+        return 1;
     }
 
-    APPEND_FMT("\nInterchanges:\n", "");
-    if (interchanges == 0) {
-        APPEND_FMT(" - None\n", "");
-    } else {
-        for (int ii = 0; ii < len; ii++) {
-            if (stations[path[ii]].line_count > 1) {
-                const char *nm = stations[path[ii]].display_name[0]
-                                 ? stations[path[ii]].display_name
-                                 : stations[path[ii]].key_name;
-                APPEND_FMT(" - %s (", nm);
-                for (int j = 0; j < stations[path[ii]].line_count; j++) {
-                    APPEND_FMT("%s", stations[path[ii]].lines[j]);
-                    if (j + 1 < stations[path[ii]].line_count) {
-                        APPEND_FMT(", ", "");
-                    }
-                }
-                APPEND_FMT(")\n", "");
-            }
-        }
+    if (timetable_file && load_timetable_file(timetable_file) < 0) {
+        fprintf(stderr, "%s: %s\n", timetable_file, network_error);
+        return 1;
     }
 
-    APPEND_FMT("\nSummary:\n", "");
-    APPEND_FMT(" - Total stops: %d\n", edges);
-    APPEND_FMT(" - Distance   : %.2f km\n", total_dist);
-    APPEND_FMT(" - Time       : %d min (incl. interchange buffer)\n", est_time);
-    APPEND_FMT(" - Fare est.  : Rs %d\n", est_fare);
+    if (nclosed || nclosed_segs) {
+        ensure_network(1);
+        int bad = apply_closures(closed, nclosed, 0) || apply_closures(closed_segs, nclosed_segs, 1);
+        free(closed);
+        free(closed_segs);
+        if (bad) return 1;
+    }
 
-    #undef APPEND_FMT
+    if (batch_file) {
+        set_batch_threads(threads);
+        int status = run_batch(batch_file, batch_format);
+        if (stats) print_stats();
+        return status;
+    }
 
-    return buffer;
-}
+    if (iso_mode) {
+        set_batch_threads(threads);
+        int status = run_isochrones(iso_from, niso, iso_minutes, iso_fare, batch_format);
+        free(iso_from);
+        if (stats) print_stats();
+        return status;
+    }
 
-// =============================================================
-// MAIN MENU / INTERACTIVE LOOP (CLI ONLY)
-// =============================================================
-#ifndef __EMSCRIPTEN__
-int main(void) {
-    // On Windows: switch console to UTF-8 so em-dash, arrows, emojis work.
-#ifdef _WIN32
-    SetConsoleOutputCP(CP_UTF8);
-    SetConsoleCP(CP_UTF8);
+    if (serve_addr) {
+#ifdef METRO_SERVER
+        set_batch_threads(threads);
+        int status = run_server(serve_addr);
+        if (stats) print_stats();
+        return status;
+#else
+        fprintf(stderr, "--serve needs a build with -DMETRO_SERVER\n");
+        return 2;
 #endif
+    }
+
+    if (report_out) {
+        if (npairs == 0 || npairs % 2 != 0) {
+            print_usage(argv[0]);
+            return 2;
+        }
+        int status = write_reports(report_out, report_css, pairs, npairs);
+        free(pairs);
+        if (stats) print_stats();
+        return status;
+    }
 
     int include_planned = 1; // currently all stations open; reserved for future
-    build_network(include_planned);
+    ensure_network(include_planned);
+    route_table_usable();
 
     if (stationCount == 0) {
         printf("No stations loaded. Exiting.\n");
         return 0;
     }
 
-    int last_path[MAX];
+    static Route last_route;
     int last_len = 0; // track if we have a last route
 
     while (1) {
@@ -1269,13 +8699,14 @@ int main(void) {
 
         if (choice == 6) {
             printf("Goodbye!\n");
+            if (stats) print_stats();
             break;
         } else if (choice == 2) {
             show_all_stations(include_planned);
             continue;
         } else if (choice == 5) {
             include_planned = !include_planned;
-            build_network(include_planned);
+            ensure_network(include_planned);
             printf("Toggled include_planned -> %d\n", include_planned);
             continue;
         } else if (choice == 3) {
@@ -1292,10 +8723,6 @@ int main(void) {
                 printf("No last route available. Run 'Find route' first.\n");
                 continue;
             }
-            // build edge lines for last path
-            char edgeLines[last_len][30];
-            build_edge_lines(last_path, last_len, edgeLines);
-
             // timestamped file names
             time_t t = time(NULL);
             struct tm *tm = localtime(&t);
@@ -1311,8 +8738,8 @@ int main(void) {
                      tm->tm_year + 1900, tm->tm_mon + 1, tm->tm_mday,
                      tm->tm_hour, tm->tm_min);
 
-            // export_route_to_txt(txtfile, last_path, last_len, edgeLines); txt export optional
-            export_route_to_html(htmlfile, last_path, last_len, edgeLines);
+            // export_route_to_txt(txtfile, &last_route); txt export optional
+            export_route_to_html(htmlfile, &last_route);
 
 #ifdef _WIN32
             // highlight the file in Explorer
@@ -1355,12 +8782,8 @@ int main(void) {
             dstkey[79] = '\0';
             normalize_inplace(dstkey);
 
-            int src = -1, dest = -1;
-            for (int i = 0; i < stationCount; i++) {
-                if (!include_planned && stations[i].planned) continue;
-                if (strcmp(srckey, stations[i].key_name) == 0) src = i;
-                if (strcmp(dstkey, stations[i].key_name) == 0) dest = i;
-            }
+            int src = find_station_id(srckey, include_planned);
+            int dest = find_station_id(dstkey, include_planned);
 
             if (src == -1) {
                 printf("Start station not found: '%s'\n", srcraw);
@@ -1372,69 +8795,49 @@ int main(void) {
                 autocomplete_print(dstkey);
                 continue;
             }
-
-            int parent[MAX];
-            for (int i = 0; i < MAX; i++) parent[i] = -1;
-
-            if (!bfs_simple(src, dest, parent)) {
-                printf("No route found between '%s' and '%s'\n", srcraw, dstra);
+            // same case as ROUTE_ERR_CLOSED from the exports
+            if (station_closed(src) || station_closed(dest)) {
+                printf("Station closed: '%s'. No service from '%s' to '%s' right now.\n",
+                       station_closed(src) ? srcraw : dstra, srcraw, dstra);
                 continue;
             }
 
-            // reconstruct shortest path from BFS parent[]
-            int path[MAX];
-            int len = 0;
-            int cur = dest;
-
-            while (cur != -1) {
-                path[len++] = cur;
-                cur = parent[cur];
-            }
-
-            // reverse path to get src -> dest
-            for (int i = 0; i < len / 2; i++) {
-                int t = path[i];
-                path[i] = path[len - 1 - i];
-                path[len - 1 - i] = t;
+            static Route route;
+            if (!find_route(src, dest, &route)) {
+                printf("No route found between '%s' and '%s'\n", srcraw, dstra);
+                continue;
             }
-
-            // determine lines for each edge
-            char edgeLines[len][30];
-            build_edge_lines(path, len, edgeLines);
+            int *path = route.path;
+            int len = route.len;
 
             // professional output
-            print_final_output_professional(path, len, edgeLines);
+            print_final_output_professional(&route);
 
             // ASCII preview
             print_ascii_map_preview(path, len);
 
             // alternate routes
-            int alternates[MAX_ALTERNATES][MAX];
-            int altlens[MAX_ALTERNATES];
-            for (int i = 0; i < MAX_ALTERNATES; i++) altlens[i] = 0;
-
-            int altc = find_alternates(path, len, alternates, altlens);
+            static Route alternates[MAX_ALTERNATES];
+            int altc = find_alternates(&route, MAX_ALTERNATES, alternates);
             if (altc > 0) {
                 printf("%sAlternate suggestions:%s\n", CLR_BOLD, CLR_RESET);
                 for (int a = 0; a < altc; a++) {
                     printf(" Alt %d) ", a + 1);
-                    for (int p = 0; p < altlens[a]; p++) {
-                        const char *nm = stations[alternates[a][p]].display_name[0]
-                                         ? stations[alternates[a][p]].display_name
-                                         : stations[alternates[a][p]].key_name;
-                        printf("%s", nm);
-                        if (p + 1 < altlens[a]) printf(" -> ");
+                    for (int p = 0; p < alternates[a].len; p++) {
+                        printf("%s", station_name(alternates[a].path[p]));
+                        if (p + 1 < alternates[a].len) printf(" -> ");
                     }
-                    printf("\n");
+                    printf(" %s(%d min, %d change%s)%s\n", CLR_DIM,
+                           (alternates[a].time_sec + 30) / 60, alternates[a].interchanges,
+                           alternates[a].interchanges == 1 ? "" : "s", CLR_RESET);
                 }
             } else {
                 printf("No alternate routes found.\n");
             }
 
-            // store last path for export
+            // store last route for export
+            last_route = route;
             last_len = len;
-            for (int i = 0; i < len; i++)
-                last_path[i] = path[i];
 
         } else {
             printf("Unknown selection\n");
@@ -1443,4 +8846,5 @@ int main(void) {
 
     return 0;
 }
+#endif // METRO_NO_MAIN
 #endif // __EMSCRIPTEN__
@@ -0,0 +1,586 @@
+// =============================================================
+// Namma Metro — routing worker
+// =============================================================
+/*
+    Hosts metro.wasm off the main thread so route searches, network
+    loads and result marshalling never block rendering. Load it with
+    metro-client.js (or new Worker("metro.worker.js")).
+
+    metro.wasm is streamed and compiled as soon as the worker starts;
+    requests that arrive before the runtime is up simply wait in the
+    queue. In a release build (asset-manifest.js present) the binaries
+    have content-hashed names and the compiled WebAssembly.Module is
+    kept in IndexedDB under that name, so a warm start skips compiling.
+    Browsers that cannot store modules just compile every time.
+
+    On a cross-origin isolated page the threaded build (metro-mt.*) is
+    used instead, and "batch" requests spread over every core.
+
+    Protocol (every request carries a numeric id, echoed in the reply):
+
+      -> { type: "init", id, includePlanned }
+      <- { type: "ready", id, stations: [names], lines: [names], lineStations: [..] }
+         names come from one get_names_table() decode; lineStations[l]
+         is an Int32Array of line l's station IDs in travel order
+
+      -> { type: "route", id, src, dst, channel? }
+      <- { type: "route", id, status, buffer }          (buffer transferred)
+
+      -> { type: "journey", id, src, dst, depart, channel? }
+      <- { type: "journey", id, status, buffer, times }  (both transferred)
+         depart: seconds after midnight. The buffer is a route buffer
+         whose minutes include waiting; times (Int32Array) holds when
+         the train leaves each station, then the arrival at the last,
+         in seconds after midnight (status 8 = no more trains today)
+
+      -> { type: "options", id, src, dst, depart, max, channel? }
+      <- { type: "options", id, status, count, buffers: [..], times: [..] }
+         the Pareto set (arrival, changes, fare) in arrival order, one
+         journey-style route buffer and times array per option; with
+         count 0, status says why
+
+      -> { type: "timetable", id, text }                (GTFS-style frequencies CSV; "" = default)
+      <- { type: "timetable", id, bands }
+
+      -> { type: "alternates", id, src, dst, k, channel? }
+      <- { type: "alternates", id, count, buffers: [..] }
+
+      -> { type: "autocomplete", id, text, max, includePlanned, channel? }
+      <- { type: "autocomplete", id, buffer }           (Int32Array of IDs)
+
+      -> { type: "loadImage", id, buffer }              (compiled network image)
+      <- { type: "ready", id, stations, lines }
+
+      -> { type: "batch", id, src, dst }                (Int32Arrays of station IDs)
+      <- { type: "batch", id, answered, threads, buffer }
+         buffer: Int32Array, 4 per pair (stops, minutes, fare, changes; -1 = none)
+
+      -> { type: "fares", id, src, dst }                (Int32Arrays of station IDs)
+      <- { type: "fares", id, answered, fares, distances }
+         Int32Array buffers, one entry per pair: fare in Rs and route
+         length in metres (-1 = none); a lookup when the table is on
+
+      -> { type: "isochrone", id, src, minutes, fare, channel? }
+      <- { type: "isochrone", id, count, buffer }
+         every station reachable from src within minutes and fare Rs
+         (-1 = no limit), src first, then by time; buffer: Int32Array,
+         6 per station (ID, minutes, fare, changes, distance_m, line
+         mask with bit l = line l of the ready message)
+
+      -> { type: "segment", id, a, b, closed }          (segment a - b out of / back in service)
+      -> { type: "station", id, station, closed?, planned? }
+      <- { type: "edited", id, changed }                (changed: 0 = it already was so)
+         Edits patch the route table and caches in place; later
+         route replies reflect them (status 7 = station closed).
+
+      -> { type: "stats", id, reset? }                  (reset: zero the counters after reading)
+      <- { type: "stats", id, stats }
+         stats: { enabled, build_calls, build_us, ... } as in MetroStats;
+         all zeros with enabled = 0 unless built with METRO_STATS=1.
+         stats.cache: { hits, misses, evictions, stale, used, capacity }
+         from the route result cache, in every build
+
+      -> { type: "cancel", id }                         (drop a queued request)
+      <- { type: "cancelled", id }                      (also for superseded ones)
+
+      <- { type: "error", id, message }
+         if the runtime cannot start (no glue, wasm failed to compile),
+         every queued and later request gets this, with its own id
+
+    A route buffer is an Int32Array laid out like RouteResult, trimmed
+    to the stations actually used:
+
+      [0] status  [1] station_count  [2] time_min  [3] fare
+      [4] interchanges  [5] distance_m
+      [6 .. 6+n)        station IDs
+      [6+n .. 6+2n-1)   line ID of each segment
+      [6+2n-1 .. +c)    route replies only: route index of each of the
+                        c = [4] interchange stations (get_route_packed)
+
+    Requests are queued and run one per task, so a cancel that arrives
+    while a search is running still reaches queued work. A request
+    with a channel replaces any older queued request on the same
+    channel (e.g. "typing"), which is then answered with "cancelled".
+*/
+
+const RESULT_HEADER = 6;
+const ISO_FIELDS = 6;       // ISO_FIELDS in metro.c
+
+// MetroStats in metro.c, one double each, in declaration order
+const STATS_FIELDS = [
+  "enabled",
+  "build_calls", "build_us",
+  "resolve_calls", "resolve_us",
+  "search_calls", "search_us",
+  "alternates_calls", "alternates_us",
+  "render_calls", "render_us",
+  "nodes_expanded", "queue_peak"
+];
+
+// get_result_cache_stats() order
+const CACHE_FIELDS = ["hits", "misses", "evictions", "stale", "used", "capacity"];
+
+let ready = false;
+let initError = null;       // why the runtime could not start; fails every request
+let queue = [];             // requests that arrived before the runtime or are waiting their turn
+let pumping = false;
+
+let resultPtr = 0;          // one RouteResult reused for every route request
+let resultInts = 0;
+let packedPtr = 0;          // one packed record for route requests
+let altPtr = 0;             // k RouteResults for alternates
+let altCap = 0;
+let timesPtr = 0;           // station times for journey requests
+let optPtr = 0;             // max RouteResults + times for options
+let optCap = 0;
+let idsPtr = 0;             // int buffer for autocomplete
+let idsCap = 0;
+let isoPtr = 0;             // station_count() isochrone records
+let isoCap = 0;
+let imagePtr = 0;           // network image in wasm memory (used in place)
+
+// Hashed names from "build_wasm.sh release"; a dev tree uses plain names
+let ASSETS = {};
+try {
+  importScripts("asset-manifest.js");
+  ASSETS = self.METRO_ASSETS.files;
+} catch (e) {}
+
+// wasm threads need SharedArrayBuffer, which needs cross-origin isolation
+const THREADED = self.crossOriginIsolated === true && !!ASSETS["metro-mt.js"];
+const GLUE_URL = THREADED ? ASSETS["metro-mt.js"] : ASSETS["metro.js"] || "metro.js";
+
+// Start fetching + compiling metro.wasm before the glue is even loaded,
+// so compilation overlaps the importScripts download and parse.
+const WASM_URL = THREADED ? ASSETS["metro-mt.wasm"] : ASSETS["metro.wasm"] || "metro.wasm";
+const compiled = ASSETS["metro.wasm"] ? cachedWasm(WASM_URL) : compileWasm(WASM_URL);
+compiled.catch(() => {});   // reported by instantiateWasm, if the glue gets that far
+
+// --- compiled-module cache -------------------------------------------------
+
+const DB_NAME = "namma-metro";
+const DB_STORE = "wasm";
+
+function idbRequest(req) {
+  return new Promise((resolve, reject) => {
+    req.onsuccess = () => resolve(req.result);
+    req.onerror = () => reject(req.error);
+  });
+}
+
+function openModuleDb() {
+  if (typeof indexedDB === "undefined") return Promise.reject(new Error("no IndexedDB"));
+  const req = indexedDB.open(DB_NAME, 1);
+  req.onupgradeneeded = () => req.result.createObjectStore(DB_STORE);
+  return idbRequest(req);
+}
+
+// Only the current hashed name is ever worth keeping
+function storeModule(db, url, module) {
+  try {
+    const store = db.transaction(DB_STORE, "readwrite").objectStore(DB_STORE);
+    store.clear();
+    store.put(module, url);                      // DataCloneError where unsupported
+  } catch (e) {}
+}
+
+// The hashed name is the cache key, so a new build never reuses an old module
+function cachedWasm(url) {
+  return openModuleDb()
+    .then(db => idbRequest(db.transaction(DB_STORE).objectStore(DB_STORE).get(url))
+      .then(module => ({ db, module })))
+    .catch(() => ({ db: null, module: null }))
+    .then(({ db, module }) => {
+      if (module instanceof WebAssembly.Module) return module;
+      return compileWasm(url).then(fresh => {
+        if (db) storeModule(db, url, fresh);
+        return fresh;
+      });
+    });
+}
+
+function compileWasm(url) {
+  if (WebAssembly.compileStreaming) {
+    return WebAssembly.compileStreaming(fetch(url)).catch(() =>
+      // e.g. served without the application/wasm MIME type
+      fetch(url).then(r => r.arrayBuffer()).then(bytes => WebAssembly.compile(bytes)));
+  }
+  return fetch(url).then(r => r.arrayBuffer()).then(bytes => WebAssembly.compile(bytes));
+}
+
+self.Module = {
+  locateFile: path => path,
+  mainScriptUrlOrBlob: GLUE_URL,          // what pthread workers load
+  instantiateWasm(imports, receive) {
+    compiled
+      .then(module => WebAssembly.instantiate(module, imports)
+        .then(instance => receive(instance, module)))
+      .catch(err => failInit("wasm: " + err));
+    return {};            // exports arrive asynchronously through receive()
+  },
+  onRuntimeInitialized() {
+    resultInts = Module._route_result_size() >> 2;
+    resultPtr = Module._malloc(resultInts * 4);
+    packedPtr = Module._malloc(Module._route_packed_size());
+    if (THREADED) Module._set_batch_threads(0);
+    ready = true;
+    schedule();
+  },
+  print: () => {},
+  printErr: msg => console.warn("[metro.worker]", msg)
+};
+
+// Answer everything waiting, and everything that comes later, with message
+function failInit(message) {
+  initError = message;
+  for (const q of queue) self.postMessage({ type: "error", id: q.id, message });
+  queue = [];
+}
+
+try {
+  importScripts(GLUE_URL);
+} catch (err) {
+  failInit("glue: " + (err && err.message || err));
+}
+
+// --- queue ---------------------------------------------------------------
+
+self.onmessage = event => {
+  const msg = event.data;
+
+  if (initError) {
+    if (msg.type !== "cancel") self.postMessage({ type: "error", id: msg.id, message: initError });
+    return;
+  }
+
+  if (msg.type === "cancel") {
+    const i = queue.findIndex(q => q.id === msg.id);
+    if (i >= 0) {
+      queue.splice(i, 1);
+      self.postMessage({ type: "cancelled", id: msg.id });
+    }
+    return;
+  }
+
+  // coalesce: a newer request on the same channel supersedes queued ones
+  if (msg.channel) {
+    queue = queue.filter(q => {
+      if (q.channel !== msg.channel) return true;
+      self.postMessage({ type: "cancelled", id: q.id });
+      return false;
+    });
+  }
+
+  queue.push(msg);
+  schedule();
+};
+
+function schedule() {
+  if (pumping || !ready || queue.length === 0) return;
+  pumping = true;
+  setTimeout(pump, 0);
+}
+
+// Run one request, then yield so cancels queued meanwhile are seen
+function pump() {
+  pumping = false;
+  const msg = queue.shift();
+  if (msg) {
+    try {
+      handle(msg);
+    } catch (err) {
+      self.postMessage({ type: "error", id: msg.id, message: String(err && err.message || err) });
+    }
+  }
+  schedule();
+}
+
+// --- handlers ------------------------------------------------------------
+
+function handle(msg) {
+  switch (msg.type) {
+    case "init":
+      Module._init_network(msg.includePlanned ? 1 : 0);
+      postReady(msg.id);
+      break;
+
+    case "loadImage":
+      loadImage(msg);
+      break;
+
+    case "route": {
+      const ints = Module._get_route_packed(msg.src, msg.dst, packedPtr);
+      const out = Module.HEAP32.slice(packedPtr >> 2, (packedPtr >> 2) + ints);
+      self.postMessage({ type: "route", id: msg.id, status: out[0], buffer: out.buffer }, [out.buffer]);
+      break;
+    }
+
+    case "journey": {
+      if (!timesPtr) timesPtr = Module._malloc(((resultInts - RESULT_HEADER) >> 1) * 4);
+      const status = Module._get_journey_ids(msg.src, msg.dst, msg.depart | 0, resultPtr, timesPtr);
+      const out = readResult(resultPtr);
+      const n = out[1];
+      const times = Module.HEAP32.slice(timesPtr >> 2, (timesPtr >> 2) + n);
+      self.postMessage({ type: "journey", id: msg.id, status, buffer: out.buffer, times: times.buffer },
+                       [out.buffer, times.buffer]);
+      break;
+    }
+
+    case "options": {
+      const max = Math.max(1, msg.max | 0);
+      const stride = (resultInts - RESULT_HEADER) >> 1;
+      if (max > optCap) {
+        if (optPtr) Module._free(optPtr);
+        optPtr = Module._malloc(max * (resultInts + stride) * 4);
+        optCap = max;
+      }
+      const optTimes = optPtr + max * resultInts * 4;
+      const count = Module._get_pareto_journeys(msg.src, msg.dst, msg.depart | 0, max, optPtr, optTimes);
+      const status = count > 0 ? 0 : Module.HEAP32[optPtr >> 2];
+      const buffers = [], times = [];
+      for (let i = 0; i < count; i++) {
+        const out = readResult(optPtr + i * resultInts * 4);
+        const base = (optTimes >> 2) + i * stride;
+        buffers.push(out.buffer);
+        times.push(Module.HEAP32.slice(base, base + out[1]).buffer);
+      }
+      self.postMessage({ type: "options", id: msg.id, status, count, buffers, times },
+                       buffers.concat(times));
+      break;
+    }
+
+    case "timetable": {
+      const bands = withString(msg.text || "", ptr => Module._load_timetable_text(ptr));
+      if (bands < 0) {
+        const message = Module.UTF8ToString(Module._get_network_error());
+        self.postMessage({ type: "error", id: msg.id, message });
+      } else {
+        self.postMessage({ type: "timetable", id: msg.id, bands });
+      }
+      break;
+    }
+
+    case "alternates": {
+      const k = Math.max(1, msg.k | 0);
+      if (k > altCap) {
+        if (altPtr) Module._free(altPtr);
+        altPtr = Module._malloc(k * resultInts * 4);
+        altCap = k;
+      }
+      const count = Module._get_alternates_ids(msg.src, msg.dst, k, altPtr);
+      const buffers = [];
+      for (let i = 0; i < count; i++)
+        buffers.push(readResult(altPtr + i * resultInts * 4).buffer);
+      self.postMessage({ type: "alternates", id: msg.id, count, buffers }, buffers);
+      break;
+    }
+
+    case "autocomplete": {
+      const max = Math.max(1, msg.max | 0);
+      if (max > idsCap) {
+        if (idsPtr) Module._free(idsPtr);
+        idsPtr = Module._malloc(max * 4);
+        idsCap = max;
+      }
+      const count = withString(msg.text || "", ptr =>
+        Module._get_autocomplete(ptr, msg.includePlanned === false ? 0 : 1, idsPtr, max));
+      const out = Module.HEAP32.slice(idsPtr >> 2, (idsPtr >> 2) + count);
+      self.postMessage({ type: "autocomplete", id: msg.id, buffer: out.buffer }, [out.buffer]);
+      break;
+    }
+
+    case "batch":
+      runBatch(msg);
+      break;
+
+    case "fares":
+      runFares(msg);
+      break;
+
+    case "isochrone": {
+      const n = Module._station_count();
+      if (n > isoCap) {
+        if (isoPtr) Module._free(isoPtr);
+        isoPtr = Module._malloc(n * ISO_FIELDS * 4);
+        isoCap = n;
+      }
+      const minutes = msg.minutes == null ? -1 : msg.minutes | 0;
+      const fare = msg.fare == null ? -1 : msg.fare | 0;
+      const count = Math.max(0, Module._get_isochrone(msg.src, minutes, fare, isoPtr));
+      const out = Module.HEAP32.slice(isoPtr >> 2, (isoPtr >> 2) + count * ISO_FIELDS);
+      self.postMessage({ type: "isochrone", id: msg.id, count, buffer: out.buffer }, [out.buffer]);
+      break;
+    }
+
+    case "segment":
+    case "station":
+      applyEdit(msg);
+      break;
+
+    case "stats":
+      postStats(msg);
+      break;
+
+    default:
+      self.postMessage({ type: "error", id: msg.id, message: "unknown request " + msg.type });
+  }
+}
+
+// Copy the used part of a RouteResult out of wasm memory
+function readResult(ptr) {
+  const base = ptr >> 2;
+  const heap = Module.HEAP32;
+  const n = heap[base + 1];
+  const max = (resultInts - RESULT_HEADER) >> 1;      // MAX in metro.c
+  const out = new Int32Array(RESULT_HEADER + n + Math.max(0, n - 1));
+
+  out.set(heap.subarray(base, base + RESULT_HEADER));
+  out.set(heap.subarray(base + RESULT_HEADER, base + RESULT_HEADER + n), RESULT_HEADER);
+  if (n > 1) {
+    const lines = base + RESULT_HEADER + max;
+    out.set(heap.subarray(lines, lines + n - 1), RESULT_HEADER + n);
+  }
+  return out;
+}
+
+function loadImage(msg) {
+  const bytes = new Uint8Array(msg.buffer);
+  const ptr = Module._malloc(bytes.length);
+  Module.HEAPU8.set(bytes, ptr);
+
+  if (Module._load_network_image(ptr, bytes.length) < 0) {
+    // the previous network (and its image) stays in use
+    Module._free(ptr);
+    const message = Module.UTF8ToString(Module._get_network_error());
+    self.postMessage({ type: "error", id: msg.id, message });
+    return;
+  }
+  // the image is used in place, so only the one it replaced can go
+  if (imagePtr) Module._free(imagePtr);
+  imagePtr = ptr;
+  postReady(msg.id);
+}
+
+// One get_routes_batch() call; the three arrays live in wasm memory only for it
+function runBatch(msg) {
+  const src = Int32Array.from(msg.src);
+  const dst = Int32Array.from(msg.dst);
+  const count = Math.min(src.length, dst.length);
+  const srcPtr = Module._malloc(count * 4);
+  const dstPtr = Module._malloc(count * 4);
+  const outPtr = Module._malloc(count * 16);
+  try {
+    Module.HEAP32.set(src.subarray(0, count), srcPtr >> 2);
+    Module.HEAP32.set(dst.subarray(0, count), dstPtr >> 2);
+    const answered = Module._get_routes_batch(srcPtr, dstPtr, count, outPtr);
+    const threads = Module._get_batch_threads();
+    const out = Module.HEAP32.slice(outPtr >> 2, (outPtr >> 2) + count * 4);
+    self.postMessage({ type: "batch", id: msg.id, answered, threads, buffer: out.buffer }, [out.buffer]);
+  } finally {
+    Module._free(srcPtr);
+    Module._free(dstPtr);
+    Module._free(outPtr);
+  }
+}
+
+function runFares(msg) {
+  const src = Int32Array.from(msg.src);
+  const dst = Int32Array.from(msg.dst);
+  const count = Math.min(src.length, dst.length);
+  const srcPtr = Module._malloc(count * 4);
+  const dstPtr = Module._malloc(count * 4);
+  const farePtr = Module._malloc(count * 4);
+  const distPtr = Module._malloc(count * 4);
+  try {
+    Module.HEAP32.set(src.subarray(0, count), srcPtr >> 2);
+    Module.HEAP32.set(dst.subarray(0, count), dstPtr >> 2);
+    const answered = Module._get_fares_batch(srcPtr, dstPtr, count, farePtr, distPtr);
+    const fares = Module.HEAP32.slice(farePtr >> 2, (farePtr >> 2) + count);
+    const distances = Module.HEAP32.slice(distPtr >> 2, (distPtr >> 2) + count);
+    self.postMessage({ type: "fares", id: msg.id, answered, fares: fares.buffer, distances: distances.buffer },
+                     [fares.buffer, distances.buffer]);
+  } finally {
+    Module._free(srcPtr);
+    Module._free(dstPtr);
+    Module._free(farePtr);
+    Module._free(distPtr);
+  }
+}
+
+// One closure / planned-flag edit; a bad station ID or segment is an error
+function applyEdit(msg) {
+  let changed = 0;
+  if (msg.type === "segment") {
+    changed = Module._set_segment_closed(msg.a, msg.b, msg.closed ? 1 : 0);
+  } else {
+    if (msg.closed !== undefined)
+      changed = Module._set_station_closed(msg.station, msg.closed ? 1 : 0);
+    if (changed >= 0 && msg.planned !== undefined)
+      changed = Math.max(changed, Module._set_station_planned(msg.station, msg.planned ? 1 : 0));
+  }
+  if (changed < 0) {
+    const what = msg.type === "segment" ? "segment " + msg.a + "-" + msg.b : "station " + msg.station;
+    self.postMessage({ type: "error", id: msg.id, message: "no such " + what });
+    return;
+  }
+  self.postMessage({ type: "edited", id: msg.id, changed });
+}
+
+function postStats(msg) {
+  const size = Module._stats_size();
+  const ptr = Module._malloc(Math.max(size, CACHE_FIELDS.length * 4));
+  try {
+    Module._get_stats(ptr);
+    const values = Module.HEAPF64.subarray(ptr >> 3, (ptr >> 3) + size / 8);
+    const stats = {};
+    STATS_FIELDS.forEach((name, i) => { stats[name] = values[i]; });
+
+    Module._get_result_cache_stats(ptr);
+    stats.cache = {};
+    CACHE_FIELDS.forEach((name, i) => { stats.cache[name] = Module.HEAP32[(ptr >> 2) + i]; });
+
+    if (msg.reset) {
+      Module._reset_stats();
+      Module._reset_result_cache_stats();
+    }
+    self.postMessage({ type: "stats", id: msg.id, stats });
+  } finally {
+    Module._free(ptr);
+  }
+}
+
+// Names in one decode (copied first: TextDecoder refuses shared memory)
+function postReady(id) {
+  const n = Module._station_count();
+  const sizePtr = Module._malloc(4);
+  const idsPtr = Module._malloc(Math.max(1, n) * 4);
+  try {
+    const table = Module._get_names_table(sizePtr);
+    const size = Module.HEAP32[sizePtr >> 2];
+    const names = new TextDecoder().decode(Module.HEAPU8.slice(table, table + size)).split("\0");
+    names.pop();                                 // after the last terminator
+    const stations = names.slice(0, n);
+    const lines = names.slice(n);
+    const lineStations = lines.map((name, l) => {
+      const count = Module._get_line_stations(l, idsPtr);
+      return Module.HEAP32.slice(idsPtr >> 2, (idsPtr >> 2) + Math.max(0, count));
+    });
+    self.postMessage({ type: "ready", id, stations, lines, lineStations },
+                     lineStations.map(a => a.buffer));
+  } finally {
+    Module._free(sizePtr);
+    Module._free(idsPtr);
+  }
+}
+
+// Call fn with a temporary NUL-terminated copy of str in wasm memory
+function withString(str, fn) {
+  const size = Module.lengthBytesUTF8(str) + 1;
+  const ptr = Module._malloc(size);
+  try {
+    Module.stringToUTF8(str, ptr, size);
+    return fn(ptr);
+  } finally {
+    Module._free(ptr);
+  }
+}
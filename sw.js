@@ -1,15 +1,33 @@
-const CACHE_NAME = "namma-metro-route-v1";
-const ASSETS = [
+// Hashed binary names + build version, written by "build_wasm.sh release".
+// A dev tree has no manifest: plain names, and everything network-first.
+let METRO = { version: "dev", files: {} };
+try {
+  importScripts("asset-manifest.js");
+  METRO = self.METRO_ASSETS;
+} catch (e) {}
+
+const CACHE_NAME = "namma-metro-route-" + METRO.version;
+const DATA_CACHE = "namma-metro-data";          // survives app updates
+const NETWORK_IMAGE = "network.bin";
+
+const asset = name => METRO.files[name] || name;
+
+// Content-hashed files never change under their name: cache-first
+const IMMUTABLE = new Set(Object.values(METRO.files));
+
+const SHELL = [
   "./",
   "./index.html",
-  "./metro.js",
-  "./metro.wasm",
-  "./manifest.json"
-];
+  "./manifest.json",
+  "./metro-client.js",
+  "./metro.worker.js",
+  "./" + asset("metro.js"),
+  "./" + asset("metro.wasm")
+].concat(METRO.version === "dev" ? [] : ["./asset-manifest.js"]);
 
 self.addEventListener("install", event => {
   event.waitUntil(
-    caches.open(CACHE_NAME).then(cache => cache.addAll(ASSETS))
+    caches.open(CACHE_NAME).then(cache => cache.addAll(SHELL))
   );
 });
 
@@ -18,15 +36,59 @@ self.addEventListener("activate", event => {
     caches.keys().then(keys =>
       Promise.all(
         keys
-          .filter(k => k !== CACHE_NAME)
+          .filter(k => k !== CACHE_NAME && k !== DATA_CACHE)
           .map(k => caches.delete(k))
       )
-    )
+    ).then(() => self.clients.claim())
   );
 });
 
 self.addEventListener("fetch", event => {
-  event.respondWith(
-    caches.match(event.request).then(resp => resp || fetch(event.request))
-  );
+  const request = event.request;
+  const url = new URL(request.url);
+  if (request.method !== "GET" || url.origin !== self.location.origin) return;
+
+  const name = url.pathname.slice(url.pathname.lastIndexOf("/") + 1);
+  if (IMMUTABLE.has(name))
+    event.respondWith(cacheFirst(request));
+  else if (name === NETWORK_IMAGE)
+    event.respondWith(staleWhileRevalidate(event, request));
+  else
+    event.respondWith(networkFirst(request));
 });
+
+function cacheFirst(request) {
+  return caches.match(request).then(resp => resp || fetch(request));
+}
+
+// Shell files keep their names across builds, so prefer the network
+// and fall back to the cached copy offline
+function networkFirst(request) {
+  return fetch(request)
+    .then(resp => {
+      if (resp.ok) {
+        const copy = resp.clone();
+        caches.open(CACHE_NAME).then(cache => cache.put(request, copy));
+      }
+      return resp;
+    })
+    .catch(() => caches.match(request).then(resp => resp || Response.error()));
+}
+
+// Network data: answer from cache at once, refresh it for the next load
+function staleWhileRevalidate(event, request) {
+  return caches.open(DATA_CACHE).then(cache =>
+    cache.match(request).then(cached => {
+      const refresh = fetch(request)
+        .then(resp => {
+          if (resp.ok) return cache.put(request, resp.clone()).then(() => resp);
+          return resp;
+        });
+      if (cached) {
+        event.waitUntil(refresh.catch(() => {}));
+        return cached;
+      }
+      return refresh;
+    })
+  );
+}
@@ -0,0 +1,154 @@
+/***************************************************************
+    Namma Metro — network image loader checks
+
+    Builds metro.c into this program (like bench.c), compiles the
+    built-in network into an image with its route table, then feeds
+    load_network_image_mem() damaged copies of it. Every damaged copy
+    must be rejected and leave the loaded network answering routes:
+
+        cc -O2 -o test_image test_image.c
+        ./test_image                     exit status 0 = all passed
+****************************************************************/
+
+#define METRO_NO_MAIN
+#include "metro.c"
+
+#define TEST_IMAGE_PATH "test_image.bin"
+
+unsigned char *test_image = NULL;       // the intact image
+size_t test_image_size = 0;
+unsigned char *test_good = NULL;        // loaded copy of it, restored after a bad accept
+int test_failures = 0;
+
+// Start of section id in img, NULL if the image has none
+unsigned char *test_section(unsigned char *img, int id, size_t *size) {
+    NetImageHeader h;
+    memcpy(&h, img, sizeof h);
+    for (uint32_t i = 0; i < h.section_count; i++) {
+        NetImageSection e;
+        memcpy(&e, img + sizeof h + i * sizeof e, sizeof e);
+        if ((int)e.id == id) {
+            if (size) *size = e.size;
+            return img + e.offset;
+        }
+    }
+    return NULL;
+}
+
+// A fresh copy of the intact image (malloc keeps the 8-byte alignment)
+unsigned char *test_copy(void) {
+    unsigned char *img = malloc(test_image_size);
+    if (img) memcpy(img, test_image, test_image_size);
+    return img;
+}
+
+// Load img (size bytes): it must be accepted or rejected as expected
+void test_load(const char *name, unsigned char *img, size_t size, int accept) {
+    int n = load_network_image_mem(img, size, IMAGE_BORROWED);
+    if (n >= 0 && !accept) {
+        // never route on (or free under) a damaged image that got in
+        printf("FAIL %-28s accepted\n", name);
+        test_failures++;
+        load_network_image_mem(test_good, test_image_size, IMAGE_BORROWED);
+        return;
+    }
+
+    Route r;
+    int routes = route_between_ids(0, 1, &r);
+    if ((n >= 0) != accept || !routes) {
+        printf("FAIL %-28s %s%s\n", name, n >= 0 ? "accepted" : "rejected",
+               routes ? "" : ", route 0 -> 1 lost");
+        test_failures++;
+    } else {
+        printf("ok   %-28s %s\n", name, n >= 0 ? "accepted" : network_error);
+    }
+}
+
+int main(void) {
+    ensure_network(1);
+    if (write_network_image(TEST_IMAGE_PATH, 1) < 0) {
+        fprintf(stderr, "%s\n", network_error);
+        return 1;
+    }
+    FILE *f = fopen(TEST_IMAGE_PATH, "rb");
+    if (f) {
+        fseek(f, 0, SEEK_END);
+        test_image_size = (size_t)ftell(f);
+        fseek(f, 0, SEEK_SET);
+        test_image = malloc(test_image_size);
+        if (test_image && fread(test_image, 1, test_image_size, f) != test_image_size) {
+            free(test_image);
+            test_image = NULL;
+        }
+        fclose(f);
+    }
+    remove(TEST_IMAGE_PATH);
+    if (!test_image) {
+        fprintf(stderr, "cannot read back %s\n", TEST_IMAGE_PATH);
+        return 1;
+    }
+
+    // the intact image stays loaded (borrowed) while the damaged copies are tried
+    test_good = test_copy();
+    unsigned char *good = test_good;
+    test_load("intact image", good, test_image_size, 1);
+
+    int n = stationCount, nodes = nodeCount;
+    unsigned char *img;
+    unsigned short *next, *start;
+    const int *station = (const int *)test_section(good, NET_SEC_NODE_STATION, NULL);
+
+    // truncated: as read, and with the header's size patched to match
+    img = test_copy();
+    test_load("truncated", img, test_image_size / 2, 0);
+    NetImageHeader h;
+    memcpy(&h, img, sizeof h);
+    h.total_size = (uint32_t)(test_image_size / 2);
+    memcpy(img, &h, sizeof h);
+    test_load("truncated, size patched", img, test_image_size / 2, 0);
+    free(img);
+
+    // rt_next entry of a route's first node pointing back at itself
+    img = test_copy();
+    next = (unsigned short *)test_section(img, NET_SEC_RT_NEXT, NULL);
+    start = (unsigned short *)test_section(img, NET_SEC_RT_START, NULL);
+    int x = start[0 * n + 1];
+    next[1 * nodes + x] = (unsigned short)x;
+    test_load("rt_next self loop", img, test_image_size, 0);
+    free(img);
+
+    // two nodes of an interchange station pointing at each other
+    img = test_copy();
+    next = (unsigned short *)test_section(img, NET_SEC_RT_NEXT, NULL);
+    int a = -1;
+    for (int y = 0; y + 1 < nodes && a < 0; y++)
+        if (station[y] == station[y + 1]) a = y;
+    if (a >= 0) {
+        int t = station[a] == 0 ? 1 : 0;
+        next[t * nodes + a] = (unsigned short)(a + 1);
+        next[t * nodes + a + 1] = (unsigned short)a;
+    }
+    test_load("rt_next interchange cycle", img, test_image_size, a < 0);
+    free(img);
+
+    // a hop between stations with no segment between them
+    img = test_copy();
+    next = (unsigned short *)test_section(img, NET_SEC_RT_NEXT, NULL);
+    int far = -1;
+    for (int y = 0; y < nodes && far < 0; y++)
+        if (station[y] != 0 && find_edge_slot(0, station[y]) < 0) far = y;
+    next[(n - 1) * nodes + 0] = (unsigned short)far;
+    test_load("rt_next hop off the track", img, test_image_size, 0);
+    free(img);
+
+    // rt_start naming a node of another station
+    img = test_copy();
+    start = (unsigned short *)test_section(img, NET_SEC_RT_START, NULL);
+    start[0 * n + 1] = (unsigned short)(nodes - 1);
+    test_load("rt_start at another station", img, test_image_size, station[nodes - 1] == 0);
+    free(img);
+
+    free(test_image);
+    printf("%s\n", test_failures ? "FAILED" : "all passed");
+    return test_failures ? 1 : 0;
+}
@@ -0,0 +1,98 @@
+/***************************************************************
+    Namma Metro — routing checks on small source networks
+
+    Builds metro.c into this program (like bench.c), loads networks
+    written for one case each and checks the routes every strategy
+    finds, with and without the all-pairs route table:
+
+        cc -O2 -o test_routes test_routes.c
+        ./test_routes                    exit status 0 = all passed
+****************************************************************/
+
+#define METRO_NO_MAIN
+#include "metro.c"
+
+int test_failures = 0;
+
+#define TEST_ROUTES_IMAGE "test_routes.bin"
+
+// 0 = answered from the route table, then the strategies 0..2 searching
+const char *test_mode_names[] = { "route table", "dijkstra", "astar", "bidir" };
+
+// Station ID of name in the loaded network (-1 if missing)
+int test_station(const char *name) {
+    char key[80];
+    strncpy(key, name, 79);
+    key[79] = '\0';
+    normalize_inplace(key);
+    return find_station_id(key, 1);
+}
+
+// Route from -> to must ride only line on, with no interchange
+void test_one_line(const char *name, const char *from, const char *to, const char *on) {
+    int line = find_or_add_line(on);
+
+    for (int mode = 0; mode < 4; mode++) {
+        set_route_table_mode(mode == 0);
+        if (mode > 0) set_route_strategy(mode - 1);
+        Route r;
+        int ok = find_route(test_station(from), test_station(to), &r);
+        int off_line = 0;
+        for (int i = 0; ok && i < r.len - 1; i++)
+            if (route_line(&r, i) != line) off_line++;
+
+        if (!ok || r.interchanges != 0 || off_line) {
+            printf("FAIL %-28s %s: %s\n", name, test_mode_names[mode],
+                   !ok ? "no route" : r.interchanges ? "interchanges" : "left the line");
+            test_failures++;
+        } else {
+            printf("ok   %-28s %s\n", name, test_mode_names[mode]);
+        }
+    }
+    set_route_table_mode(0);
+    set_route_strategy(ROUTE_STRATEGY_ASTAR);
+}
+
+int main(void) {
+    // two lines over the shared track B - C - D - E: each keeps its own slots
+    if (load_network_text("line red 5\nA\nB\nC\nD\nE\nF\n"
+                          "line blue 5\nX\nB\nC\nD\nE\nY\n") < 0) {
+        fprintf(stderr, "%s\n", network_error);
+        return 1;
+    }
+    test_one_line("shared track, blue", "X", "Y", "blue");
+    test_one_line("shared track, red", "A", "F", "red");
+    test_one_line("shared track, blue segment", "B", "Y", "blue");
+
+    // closing shared track closes it for every line riding it
+    int c = test_station("C"), d = test_station("D");
+    for (int table = 1; table >= 0; table--) {
+        Route r;
+        set_route_table_mode(table);
+        find_route(0, 1, &r);                   // build the table before the edit
+        set_segment_closed(c, d, 1);
+        int blue = find_route(test_station("X"), test_station("Y"), &r);
+        int red = find_route(test_station("A"), test_station("F"), &r);
+        if (blue || red) {
+            printf("FAIL %-28s %s: %s still rides it\n", "shared track closed",
+                   table ? "route table" : "astar", blue ? "blue" : "red");
+            test_failures++;
+        } else {
+            printf("ok   %-28s %s\n", "shared track closed", table ? "route table" : "astar");
+        }
+        set_segment_closed(c, d, 0);
+    }
+    test_one_line("shared track reopened", "X", "Y", "blue");
+
+    // the same network from an image carrying its route table
+    if (write_network_image(TEST_ROUTES_IMAGE, 1) < 0 || load_network_file(TEST_ROUTES_IMAGE) < 0) {
+        printf("FAIL %-28s %s\n", "shared track image", network_error);
+        test_failures++;
+    } else {
+        test_one_line("shared track image, blue", "X", "Y", "blue");
+    }
+    remove(TEST_ROUTES_IMAGE);
+
+    printf("%s\n", test_failures ? "FAILED" : "all passed");
+    return test_failures ? 1 : 0;
+}